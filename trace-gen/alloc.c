@@ -0,0 +1,204 @@
+/*
+ * File:
+ *   alloc.c
+ * Description:
+ *   Node allocator: plain malloc, per-thread slab pools, or slabs carved
+ *   from one contiguous (optionally hugepage-backed) arena.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "alloc.h"
+
+alloc_kind_t alloc_kind = ALLOC_MALLOC;
+__thread alloc_tls_t alloc_tls;
+
+/* Arena: slabs are handed out by bumping an offset into one mapping */
+static char *arena;
+static size_t arena_size;
+static size_t arena_off;
+static int arena_owned;                 /* Mapped by us, not by the caller */
+static int arena_bind;                  /* Bind slabs to their thread's node */
+
+/* Pool: malloc'ed slabs are chained through their first word */
+static void *pool_slabs;
+static size_t pool_used;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *names[] = { "malloc", "pool", "arena", "huge" };
+
+int alloc_parse(const char *s, alloc_kind_t *kind)
+{
+  int i;
+
+  for (i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+    if (strcmp(s, names[i]) == 0) {
+      *kind = (alloc_kind_t)i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+const char *alloc_name(alloc_kind_t kind)
+{
+  return names[kind];
+}
+
+void alloc_init(alloc_kind_t kind, size_t arena_mb)
+{
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+
+  alloc_kind = kind;
+  if (kind != ALLOC_ARENA && kind != ALLOC_HUGE)
+    return;
+
+  arena_size = arena_mb << 20;
+  arena_off = 0;
+  arena = MAP_FAILED;
+  if (kind == ALLOC_HUGE) {
+    /* Reserve the huge pages up front: faulting them in later may SIGBUS */
+    arena = mmap(NULL, arena_size, PROT_READ | PROT_WRITE,
+                 (flags & ~MAP_NORESERVE) | MAP_HUGETLB, -1, 0);
+    if (arena == MAP_FAILED)
+      printf("WARNING: no hugetlbfs pages, falling back to transparent huge pages\n");
+  }
+  if (arena == MAP_FAILED) {
+    arena = mmap(NULL, arena_size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (arena == MAP_FAILED) {
+      perror("mmap");
+      exit(1);
+    }
+    if (kind == ALLOC_HUGE)
+      madvise(arena, arena_size, MADV_HUGEPAGE);
+  }
+  arena_owned = 1;
+}
+
+/* Apply a NUMA memory policy to the node arena */
+void alloc_place(mem_kind_t mem, int nb_nodes)
+{
+  arena_bind = 0;
+  if (mem == MEM_FIRST_TOUCH)
+    return;
+  if (!arena_owned || (mem == MEM_BIND && alloc_kind != ALLOC_ARENA)) {
+    /* Huge pages cannot be bound per 64KB slab */
+    printf("WARNING: memory policy %s needs --alloc=%s, using first-touch\n",
+           place_mem_name(mem), mem == MEM_BIND ? "arena" : "arena or huge");
+    return;
+  }
+  if (mem == MEM_INTERLEAVE)
+    place_interleave(arena, arena_size, nb_nodes);
+  else
+    arena_bind = 1;
+}
+
+/* Node of the calling thread, or -1 to leave its slabs unbound */
+void alloc_thread_node(int node)
+{
+  alloc_tls.node = node;
+  alloc_tls.bound = (node >= 0);
+}
+
+/* Carve the pools from a region mapped elsewhere (e.g., a pmem pool) */
+void alloc_init_region(char *base, size_t size)
+{
+  alloc_kind = ALLOC_ARENA;
+  arena = base;
+  arena_size = size;
+  arena_off = 0;
+  arena_owned = 0;
+  arena_bind = 0;
+}
+
+void alloc_fini(void)
+{
+  void *slab;
+
+  if (arena != NULL) {
+    if (arena_owned)
+      munmap(arena, arena_size);
+    arena = NULL;
+  }
+  while ((slab = pool_slabs) != NULL) {
+    pool_slabs = *(void **)slab;
+    free(slab);
+  }
+  pool_used = 0;
+  memset(&alloc_tls, 0, sizeof(alloc_tls));
+}
+
+size_t alloc_used(void)
+{
+  if (arena != NULL)
+    return __atomic_load_n(&arena_off, __ATOMIC_RELAXED);
+  return pool_used;
+}
+
+static char *new_slab(void)
+{
+  size_t off;
+  char *slab;
+
+  if (alloc_kind == ALLOC_POOL) {
+    /* Keep the first grain for chaining the slab */
+    slab = (char *)xmalloc(ALLOC_SLAB_SIZE);
+    pthread_mutex_lock(&pool_lock);
+    *(void **)slab = pool_slabs;
+    pool_slabs = slab;
+    pool_used += ALLOC_SLAB_SIZE;
+    pthread_mutex_unlock(&pool_lock);
+    return slab + ALLOC_GRAIN;
+  }
+  off = __atomic_fetch_add(&arena_off, ALLOC_SLAB_SIZE, __ATOMIC_RELAXED);
+  if (off + ALLOC_SLAB_SIZE > arena_size) {
+    fprintf(stderr, "Node arena exhausted (%lu MB), use a larger --arena-size\n",
+            (unsigned long)(arena_size >> 20));
+    exit(1);
+  }
+  if (arena_bind && alloc_tls.bound)
+    place_bind(arena + off, ALLOC_SLAB_SIZE, alloc_tls.node);
+  return arena + off;
+}
+
+/* Line-sized nodes must not straddle cache lines */
+static inline char *slab_align(char *p, size_t size)
+{
+  if (size % ALLOC_LINE != 0)
+    return p;
+  return (char *)(((uintptr_t)p + ALLOC_LINE - 1) & ~(uintptr_t)(ALLOC_LINE - 1));
+}
+
+void *alloc_slow(size_t c)
+{
+  size_t size = (c + 1) * ALLOC_GRAIN;
+  char *p;
+
+  if (alloc_tls.cur == NULL || slab_align(alloc_tls.cur, size) + size > alloc_tls.end) {
+    /* The tail of the previous slab is simply abandoned */
+    alloc_tls.cur = new_slab();
+    alloc_tls.end = alloc_tls.cur + ALLOC_SLAB_SIZE - (alloc_kind == ALLOC_POOL ? ALLOC_GRAIN : 0);
+  }
+  p = slab_align(alloc_tls.cur, size);
+  alloc_tls.cur = p + size;
+
+  return p;
+}
@@ -0,0 +1,120 @@
+/*
+ * File:
+ *   alloc.h
+ * Description:
+ *   Node allocator: plain malloc, per-thread slab pools, or slabs carved
+ *   from one contiguous (optionally hugepage-backed) arena.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _ALLOC_H_
+# define _ALLOC_H_
+
+# include <stddef.h>
+# include <stdio.h>
+# include <stdlib.h>
+
+# include "place.h"
+
+# define DEFAULT_ALLOC                  malloc
+# define DEFAULT_ARENA_SIZE             4096    /* MB of address space */
+
+# define ALLOC_GRAIN                    16
+# define ALLOC_CLASSES                  32      /* Pooled sizes up to 512 bytes */
+# define ALLOC_SLAB_SIZE                (64 * 1024)
+/* Nodes whose size is a multiple of a cache line start on a line */
+# define ALLOC_LINE                     64
+
+typedef enum {
+  ALLOC_MALLOC,                         /* malloc/free per node */
+  ALLOC_POOL,                           /* Per-thread slabs from malloc */
+  ALLOC_ARENA,                          /* Per-thread slabs from one mapping */
+  ALLOC_HUGE                            /* Same, backed by huge pages */
+} alloc_kind_t;
+
+/* Per-thread state: one free list per size class and the current slab */
+typedef struct alloc_tls {
+  void *free[ALLOC_CLASSES];
+  char *cur;
+  char *end;
+  int node;                             /* NUMA node for new slabs, if bound */
+  int bound;
+} alloc_tls_t;
+
+extern alloc_kind_t alloc_kind;
+extern __thread alloc_tls_t alloc_tls;
+
+int alloc_parse(const char *s, alloc_kind_t *kind);
+const char *alloc_name(alloc_kind_t kind);
+void alloc_init(alloc_kind_t kind, size_t arena_mb);
+void alloc_init_region(char *base, size_t size);
+void alloc_place(mem_kind_t mem, int nb_nodes);
+void alloc_thread_node(int node);
+void alloc_fini(void);
+size_t alloc_used(void);
+void *alloc_slow(size_t c);
+
+static inline void *xmalloc(size_t size)
+{
+  void *p;
+
+  if ((p = malloc(size)) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  return p;
+}
+
+static inline void *xmalloc_line(size_t size)
+{
+  void *p;
+
+  if (posix_memalign(&p, ALLOC_LINE, size) != 0) {
+    perror("posix_memalign");
+    exit(1);
+  }
+  return p;
+}
+
+static inline void *node_alloc(size_t size)
+{
+  size_t c = (size - 1) / ALLOC_GRAIN;
+  void *p;
+
+  if (alloc_kind == ALLOC_MALLOC || c >= ALLOC_CLASSES)
+    return (size % ALLOC_LINE == 0) ? xmalloc_line(size) : xmalloc(size);
+  if ((p = alloc_tls.free[c]) != NULL) {
+    alloc_tls.free[c] = *(void **)p;
+    return p;
+  }
+  return alloc_slow(c);
+}
+
+static inline void node_free(void *p, size_t size)
+{
+  size_t c = (size - 1) / ALLOC_GRAIN;
+
+  if (alloc_kind == ALLOC_MALLOC || c >= ALLOC_CLASSES) {
+    free(p);
+    return;
+  }
+  /* Recycled by the freeing thread */
+  *(void **)p = alloc_tls.free[c];
+  alloc_tls.free[c] = p;
+}
+
+#endif /* _ALLOC_H_ */
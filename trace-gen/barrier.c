@@ -0,0 +1,81 @@
+/*
+ * File:
+ *   barrier.c
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Thread barrier.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "barrier.h"
+
+/* ################################################################### *
+ * BARRIER
+ * ################################################################### */
+
+static inline void futex_wait(unsigned int *addr, unsigned int val)
+{
+  syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static inline void futex_wake(unsigned int *addr)
+{
+  syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+void barrier_init(barrier_t *b, int n)
+{
+  b->count = n;
+  b->remaining = n;
+  b->sense = 0;
+  b->sleepers = 0;
+  b->spin = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? BARRIER_SPIN : 0;
+}
+
+int barrier_cross(barrier_t *b)
+{
+  unsigned int sense = __atomic_load_n(&b->sense, __ATOMIC_ACQUIRE);
+  int i;
+
+  if (__atomic_sub_fetch(&b->remaining, 1, __ATOMIC_ACQ_REL) == 0) {
+    /* Last one in: reset for next time, then release the others */
+    b->remaining = b->count;
+    __atomic_store_n(&b->sense, sense ^ 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&b->sleepers, __ATOMIC_SEQ_CST) > 0)
+      futex_wake(&b->sense);
+    return 1;
+  }
+  for (i = 0; i < b->spin; i++) {
+    if (__atomic_load_n(&b->sense, __ATOMIC_ACQUIRE) != sense)
+      return 0;
+    __builtin_ia32_pause();
+  }
+  /* The sense is re-checked after registering: no wake-up is lost */
+  __atomic_add_fetch(&b->sleepers, 1, __ATOMIC_SEQ_CST);
+  while (__atomic_load_n(&b->sense, __ATOMIC_ACQUIRE) == sense)
+    futex_wait(&b->sense, sense);
+  __atomic_sub_fetch(&b->sleepers, 1, __ATOMIC_RELAXED);
+
+  return 0;
+}
@@ -0,0 +1,49 @@
+/*
+ * File:
+ *   barrier.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Thread barrier.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _BARRIER_H_
+# define _BARRIER_H_
+
+/* Spins before sleeping (none on a single CPU) */
+# define BARRIER_SPIN                   100000
+
+/*
+ * Sense-reversing barrier: threads spin on the sense word, which the
+ * last thread to arrive flips, and sleep on it with a futex once they
+ * have spun for long enough.  Reusable for any number of episodes.
+ */
+typedef struct barrier {
+  int count;
+  int remaining;                        /* Threads yet to arrive */
+  unsigned int sense;                   /* Futex word, flips per episode */
+  int sleepers;                         /* Threads in futex_wait */
+  int spin;
+} barrier_t;
+
+void barrier_init(barrier_t *b, int n);
+/* Returns 1 in the thread that completed the episode, 0 in the others */
+int barrier_cross(barrier_t *b);
+
+#endif /* _BARRIER_H_ */
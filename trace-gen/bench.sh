@@ -0,0 +1,231 @@
+#!/bin/sh
+#
+# File:
+#   bench.sh
+# Description:
+#   Runs tracegen over a sweep matrix and summarizes the repetitions of
+#   each cell, with confidence intervals, as CSV and JSON.
+#
+# Copyright (c) 2007-2014.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation, version 2
+# of the License.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# This program has a dual license and can also be distributed
+# under the terms of the MIT license.
+#
+
+usage() {
+  cat <<EOF
+Usage:
+  bench.sh [options...] [<matrix>]
+
+Runs every cell of the sweep matrix (default=bench.conf) once per seed,
+each a warmup phase then a measured phase, and writes the runs to
+<prefix>.runs.csv and the summary by cell to <prefix>.csv and
+<prefix>.json.
+
+Options:
+  -h
+        Print this message
+  -o <prefix>
+        Output file prefix (default=bench)
+  -b <csv>
+        Compare with an earlier <prefix>.csv: cells whose throughput
+        interval lies entirely below the baseline's are regressions
+EOF
+}
+
+TRACEGEN=${TRACEGEN:-./tracegen}
+out=bench
+baseline=
+
+while getopts "ho:b:" opt; do
+  case $opt in
+    h) usage; exit 0 ;;
+    o) out=$OPTARG ;;
+    b) baseline=$OPTARG ;;
+    *) echo "Use -h for help" >&2; exit 1 ;;
+  esac
+done
+shift $((OPTIND - 1))
+matrix=${1:-bench.conf}
+
+# ################################################################### #
+# MATRIX
+# ################################################################### #
+
+backends=list
+threads=1
+update=20
+size=256
+dist=uniform
+seeds=3
+duration=200
+warmup=50
+
+if [ ! -r "$matrix" ]; then
+  echo "$matrix: cannot read the matrix" >&2
+  exit 1
+fi
+while read -r key vals; do
+  case $key in
+    '') ;;
+    backends|threads|update|size|dist|seeds|duration|warmup)
+      eval "$key=\$vals" ;;
+    *)
+      echo "$matrix: unknown key: $key" >&2
+      exit 1 ;;
+  esac
+done <<EOF
+$(sed 's/#.*//' "$matrix")
+EOF
+
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT INT TERM
+
+# The warmup phase, if any, runs the same mix; the last phase is measured
+measured=0
+: > "$tmp/workload"
+if [ "$warmup" -gt 0 ]; then
+  echo "warmup duration=$warmup warmup=1" >> "$tmp/workload"
+  measured=1
+fi
+echo "measure duration=$duration" >> "$tmp/workload"
+
+# ################################################################### #
+# RUNS
+# ################################################################### #
+
+runs=$out.runs.csv
+echo "backend,threads,update,size,dist,seed,ok,tput,p50_ns,p99_ns,p999_ns" > "$runs"
+failed=0
+for b in $backends; do
+  # Sequential backends only make sense with one thread
+  safe=1
+  if "$TRACEGEN" -b "$b" -n 2 -o 0 -i 0 2>/dev/null | grep -q "not thread-safe"; then
+    safe=0
+  fi
+  for t in $threads; do
+    if [ "$t" -gt 1 ] && [ $safe -eq 0 ]; then
+      echo "skip: $b is not thread-safe, threads=$t" >&2
+      continue
+    fi
+    for u in $update; do
+      for s in $size; do
+        for d in $dist; do
+          seed=1
+          while [ $seed -le "$seeds" ]; do
+            echo "run: $b threads=$t update=$u size=$s dist=$d seed=$seed" >&2
+            "$TRACEGEN" -b "$b" -n "$t" -u "$u" -i "$s" -r $((2 * s)) -d "$d" \
+              -s $seed -l -f binary -W "$tmp/workload" > "$tmp/out" 2>/dev/null
+            ok=$?
+            # The measured phase's throughput and the latency of all ops
+            awk -v cell="$b,$t,$u,$s,$d,$seed" -v ok=$ok -v phase=$measured '
+              $1 == "Phase" && $2 == phase && $3 ~ /^\(/ { tput = $(NF - 2); sub(/^\(/, "", tput) }
+              /^  all / {
+                for (i = 1; i <= NF; i++) {
+                  split($i, kv, "=")
+                  if (kv[1] == "p50") p50 = kv[2]
+                  else if (kv[1] == "p99") p99 = kv[2]
+                  else if (kv[1] == "p99.9") p999 = kv[2]
+                }
+              }
+              END {
+                if (tput == "")
+                  ok = 1
+                printf "%s,%d,%s,%s,%s,%s\n", cell, ok == 0, tput, p50, p99, p999
+              }' "$tmp/out" >> "$runs"
+            if [ $ok -ne 0 ]; then
+              echo "FAILED: $b threads=$t update=$u size=$s dist=$d seed=$seed" >&2
+              failed=$((failed + 1))
+            fi
+            seed=$((seed + 1))
+          done
+        done
+      done
+    done
+  done
+done
+
+# ################################################################### #
+# SUMMARY
+# ################################################################### #
+
+# Mean, sample standard deviation and 95% Student t interval per cell
+awk -F, -v csv="$out.csv" -v json="$out.json" '
+  BEGIN {
+    split("12.706 4.303 3.182 2.776 2.571 2.447 2.365 2.306 2.262 2.228 " \
+          "2.201 2.179 2.160 2.145 2.131 2.120 2.110 2.101 2.093 2.086 " \
+          "2.080 2.074 2.069 2.064 2.060 2.056 2.052 2.048 2.045 2.042", t, " ")
+    print "backend,threads,update,size,dist,runs,failed,tput_mean,tput_sd,tput_ci95,p50_ns,p99_ns,p999_ns" > csv
+    printf "[" > json
+    nc = 0
+  }
+  function flush(   mean, sd, ci, sep) {
+    if (key == "")
+      return
+    mean = sd = ci = 0
+    if (n > 0) {
+      mean = sum / n
+      if (n > 1) {
+        sd = (sq - n * mean * mean) / (n - 1)
+        sd = (sd > 0) ? sqrt(sd) : 0
+        ci = (n - 1 <= 30 ? t[n - 1] : 1.960) * sd / sqrt(n)
+      }
+      p50 /= n; p99 /= n; p999 /= n
+    }
+    printf "%s,%d,%d,%.1f,%.1f,%.1f,%.0f,%.0f,%.0f\n", key, n, bad, mean, sd, ci, p50, p99, p999 > csv
+    split(key, k, ",")
+    sep = (nc++ > 0) ? "," : ""
+    printf "%s\n  {\"backend\": \"%s\", \"threads\": %d, \"update\": %d, \"size\": %d, \"dist\": \"%s\", " \
+           "\"runs\": %d, \"failed\": %d, \"tput_mean\": %.1f, \"tput_sd\": %.1f, \"tput_ci95\": %.1f, " \
+           "\"p50_ns\": %.0f, \"p99_ns\": %.0f, \"p999_ns\": %.0f}",
+           sep, k[1], k[2], k[3], k[4], k[5],
+           n, bad, mean, sd, ci, p50, p99, p999 > json
+  }
+  NR > 1 {
+    cell = $1 "," $2 "," $3 "," $4 "," $5
+    if (cell != key) {
+      flush()
+      key = cell
+      n = bad = sum = sq = p50 = p99 = p999 = 0
+    }
+    if ($7 == 0) {
+      bad++
+      next
+    }
+    n++
+    sum += $8; sq += $8 * $8
+    p50 += $9; p99 += $10; p999 += $11
+  }
+  END {
+    flush()
+    print "\n]" > json
+  }' "$runs"
+echo "Results in $out.csv and $out.json (runs in $runs)" >&2
+
+if [ -n "$baseline" ]; then
+  # Intervals that do not overlap, in the slower direction
+  awk -F, '
+    FNR == 1 { next }
+    NR == FNR { lo[$1 "," $2 "," $3 "," $4 "," $5] = $8 - $10; base[$1 "," $2 "," $3 "," $4 "," $5] = $8; next }
+    {
+      cell = $1 "," $2 "," $3 "," $4 "," $5
+      if ((cell in lo) && $8 + $10 < lo[cell]) {
+        printf "REGRESSION: %s: %.0f -> %.0f ops/s (%.1f%%)\n", cell, base[cell], $8,
+               100.0 * ($8 - base[cell]) / base[cell]
+        found = 1
+      }
+    }
+    END { exit found }' "$baseline" "$out.csv" >&2 || failed=$((failed + 1))
+fi
+
+[ $failed -eq 0 ]
@@ -0,0 +1,156 @@
+/*
+ * File:
+ *   bulk.c
+ * Description:
+ *   Bulk loading: distinct key sampling and radix sort.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bulk.h"
+
+/* Skewed draws that keep hitting drawn keys fall back to uniform */
+#define BULK_RETRIES                    16
+#define RADIX_BITS                      11
+#define RADIX_SIZE                      (1 << RADIX_BITS)
+
+/* ################################################################### *
+ * KEY SET
+ * ################################################################### */
+
+/* Open-addressing set of the keys drawn so far (0 marks empty slots) */
+typedef struct keyset {
+  uint32_t *table;
+  size_t mask;
+} keyset_t;
+
+static void keyset_init(keyset_t *ks, int n)
+{
+  size_t size = 16;
+
+  while (size < 2 * (size_t)n)
+    size *= 2;
+  if ((ks->table = (uint32_t *)calloc(size, sizeof(uint32_t))) == NULL) {
+    perror("calloc");
+    exit(1);
+  }
+  ks->mask = size - 1;
+}
+
+/* Returns 0 if key was already present */
+static int keyset_insert(keyset_t *ks, uint32_t key)
+{
+  size_t i = (size_t)((key * 0x9e3779b97f4a7c15ULL) >> 32) & ks->mask;
+
+  while (ks->table[i] != 0) {
+    if (ks->table[i] == key)
+      return 0;
+    i = (i + 1) & ks->mask;
+  }
+  ks->table[i] = key;
+
+  return 1;
+}
+
+/* ################################################################### *
+ * SAMPLING
+ * ################################################################### */
+
+void bulk_sample(const dist_t *d, dist_state_t *st, rng_t *r, int range,
+                 val_t *out, int n)
+{
+  keyset_t ks;
+  int i, j, t, retries;
+
+  assert(n <= range);
+  keyset_init(&ks, n);
+
+  if (d->kind == DIST_UNIFORM) {
+    /* Floyd: n draws, no rejection, however close n is to range */
+    i = 0;
+    for (j = range - n + 1; j <= range; j++) {
+      t = rand_range(j, r) + 1;
+      if (!keyset_insert(&ks, t)) {
+        t = j;
+        keyset_insert(&ks, t);
+      }
+      out[i++] = t;
+    }
+  } else {
+    /* Skewed draws cannot be sampled without replacement: reject */
+    i = retries = 0;
+    while (i < n) {
+      if (retries < BULK_RETRIES)
+        t = dist_next(d, st, r);
+      else
+        t = rand_range(range, r) + 1;
+      if (keyset_insert(&ks, t)) {
+        out[i++] = t;
+        dist_inserted(st, t);
+        retries = 0;
+      } else {
+        retries++;
+      }
+    }
+  }
+
+  free(ks.table);
+}
+
+/* ################################################################### *
+ * SORTING
+ * ################################################################### */
+
+void bulk_sort(val_t *vals, int n)
+{
+  val_t *src = vals, *dst, *tmp;
+  int count[RADIX_SIZE];
+  int i, shift, d, sum;
+
+  if (n < 2)
+    return;
+  if ((tmp = (val_t *)malloc(n * sizeof(val_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  dst = tmp;
+  for (shift = 0; shift < 32; shift += RADIX_BITS) {
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < n; i++)
+      count[(src[i] >> shift) & (RADIX_SIZE - 1)]++;
+    /* Skip digits that are the same for every key */
+    if (count[(src[0] >> shift) & (RADIX_SIZE - 1)] == n)
+      continue;
+    for (d = 0, sum = 0; d < RADIX_SIZE; d++) {
+      int c = count[d];
+      count[d] = sum;
+      sum += c;
+    }
+    for (i = 0; i < n; i++)
+      dst[count[(src[i] >> shift) & (RADIX_SIZE - 1)]++] = src[i];
+    dst = src;
+    src = (src == vals) ? tmp : vals;
+  }
+  if (src != vals)
+    memcpy(vals, src, n * sizeof(val_t));
+  free(tmp);
+}
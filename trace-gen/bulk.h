@@ -0,0 +1,36 @@
+/*
+ * File:
+ *   bulk.h
+ * Description:
+ *   Bulk loading: distinct key sampling and radix sort.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _BULK_H_
+# define _BULK_H_
+
+# include "dist.h"
+# include "intset.h"
+# include "rng.h"
+
+/* Draw n distinct keys in [1, range] (Floyd's algorithm if uniform) */
+void bulk_sample(const dist_t *d, dist_state_t *st, rng_t *r, int range,
+                 val_t *out, int n);
+/* Sort keys in [0, 2^32) with an LSD radix sort */
+void bulk_sort(val_t *vals, int n);
+
+#endif /* _BULK_H_ */
@@ -0,0 +1,228 @@
+#!/bin/sh
+#
+# File:
+#   check.sh
+# Description:
+#   Short end-to-end checks of the tools: each runs a small trace and
+#   fails on any mismatch with the expected result.
+#
+# Copyright (c) 2007-2014.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation, version 2
+# of the License.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# This program has a dual license and can also be distributed
+# under the terms of the MIT license.
+#
+
+usage() {
+  cat <<EOF
+Usage:
+  check.sh [options...]
+
+Runs every check and reports the ones that fail; exits with 1 if any
+did.
+
+Options:
+  -h
+        Print this message
+  -v
+        Show the output of the failed checks
+EOF
+}
+
+TRACEGEN=${TRACEGEN:-./tracegen}
+TRACESTAT=${TRACESTAT:-./tracestat}
+TRACEMERGE=${TRACEMERGE:-./tracemerge}
+TRACEREPLAY=${TRACEREPLAY:-./tracereplay}
+verbose=0
+
+while getopts "hv" opt; do
+  case $opt in
+    h) usage; exit 0 ;;
+    v) verbose=1 ;;
+    *) echo "Use -h for help" >&2; exit 1 ;;
+  esac
+done
+
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT INT TERM
+
+failed=0
+
+# check <name> <command...>: the command must succeed
+check() {
+  name=$1
+  shift
+  if "$@" > "$tmp/log" 2>&1; then
+    echo "ok: $name" >&2
+  else
+    echo "FAILED: $name" >&2
+    [ $verbose -eq 1 ] && cat "$tmp/log" >&2
+    failed=$((failed + 1))
+  fi
+}
+
+# ################################################################### #
+# CRASH CONSISTENCY
+# ################################################################### #
+
+# Every write-back is a crash point: each image must recover, and the
+# last one to the final set (tracegen exits with 1 otherwise)
+crash() {
+  backend=$1
+  shift
+  rm -f "$tmp/pool"
+  "$TRACEGEN" -P "$tmp/pool" -M 16 -C -b "$backend" -u 50 -i 64 -r 128 -o 400 -s 3 "$@" \
+    2>/dev/null
+}
+
+if "$TRACEGEN" -o 0 -i 0 2>/dev/null | grep -q "^Compiled out.* pmem"; then
+  echo "skip: crash, made with PMEM=0" >&2
+else
+  for b in list coarse hoh lazy harris unrolled; do
+    check "crash: $b" crash "$b"
+    check "crash: $b, do not alternate" crash "$b" -a
+  done
+fi
+
+# ################################################################### #
+# CHECKPOINTS
+# ################################################################### #
+
+# A run cut short past its last checkpoint, then resumed into the same
+# file, must end with the uninterrupted run's trace, byte for byte
+resume() {
+  "$TRACEGEN" "$@" -k "$tmp/ckpt" 2>"$tmp/full.txt" >/dev/null || return 1
+  # A partial last line, as a run killed past its last checkpoint leaves
+  head -c $(($(wc -c < "$tmp/full.txt") - 3)) "$tmp/full.txt" > "$tmp/cut.txt"
+  "$TRACEGEN" "$@" -k "$tmp/ckpt" -J "$tmp/ckpt" 2>>"$tmp/cut.txt" > "$tmp/out" || return 1
+  grep -q "cut back to the checkpoint" "$tmp/out" || return 1
+  cmp "$tmp/full.txt" "$tmp/cut.txt" || return 1
+  # Into a pipe, only the rest of the trace is written
+  "$TRACEGEN" "$@" -J "$tmp/ckpt" 2>&1 >/dev/null | cat > "$tmp/rest.txt"
+  tail -c "$(wc -c < "$tmp/rest.txt")" "$tmp/full.txt" | cmp - "$tmp/rest.txt"
+}
+
+# An initial set checkpoint stands in for populating with -L
+initial() {
+  "$TRACEGEN" "$@" -L 2>"$tmp/full.txt" >/dev/null || return 1
+  "$TRACEGEN" "$@" -L -o 0 -k "$tmp/ckpt" 2>/dev/null >/dev/null || return 1
+  "$TRACEGEN" "$@" -J "$tmp/ckpt" 2>"$tmp/resumed.txt" >/dev/null || return 1
+  cmp "$tmp/full.txt" "$tmp/resumed.txt"
+}
+
+for b in list coarse tx hoh lazy harris skiplist hashset unrolled; do
+  # hashset has no range scans
+  scans="-S 10"
+  [ "$b" = hashset ] && scans=
+  check "resume: $b" resume -b "$b" -s 7 -u 40 $scans -i 128 -o 20000 -e 3000
+done
+check "resume: zipf, interleaved" resume -s 7 -d zipf -G 8 -o 20000 -e 4096
+check "resume: latest, xoshiro" resume -s 7 -b hashset -d latest -g xoshiro -a -o 20000 -e 1
+cat > "$tmp/phases" <<EOF
+warmup  ops=5000 update=0
+mixed   ops=12000 update=30 scan=20
+burst   ops=4000 update=80 alternate=0 range=1024
+EOF
+check "resume: phases" resume -s 7 -W "$tmp/phases" -e 2000
+check "resume: initial set" initial -s 7 -i 1000 -r 4000 -o 5000
+
+# ################################################################### #
+# TRACE STATISTICS
+# ################################################################### #
+
+# Accesses 3 1 3 2 1 1 3 4 1 (the scan counts for its lower bound): the
+# reuse distances are 1, 2, 0, 2 and 2, with 4 cold accesses
+cat > "$tmp/known.txt" <<EOF
+1, 2, 
+0 - 3
+2 - 1
+2 - 3
+1 - 2
+2 - 1
+3 - 1 2
+9 - 1
+2 - 3
+2 - 4
+0 - 1
+EOF
+cat > "$tmp/known.out" <<EOF
+Ops
+  add        : 2 (22.22%)
+  remove     : 1 (11.11%)
+  contains   : 5 (55.56%)
+  scan       : 1 (11.11%, 2.00 keys / scan)
+  phase      : 1 markers
+Keys         : 4 distinct, 2.25 accesses / key
+Key frequency (accesses per key: keys, share of accesses)
+  1          : 2 keys (50.00%), 22.22% of accesses
+  2-3        : 1 keys (25.00%), 33.33% of accesses
+  4-7        : 1 keys (25.00%), 44.44% of accesses
+Hottest keys
+  1          : 4 (44.44%)
+  3          : 3 (33.33%)
+  2          : 1 (11.11%)
+  4          : 1 (11.11%)
+Reuse distance (distinct keys in between: accesses, LRU hits up to then)
+  cold       : 4 (44.44%)
+  0          : 1 (11.11%, 11.11%)
+  1          : 1 (11.11%, 22.22%)
+  2-3        : 3 (33.33%, 55.56%)
+  mean       : 1.40 (0 compactions)
+Working set (distinct keys per 3 accesses)
+  0          : 2
+  3          : 2
+  6          : 3
+EOF
+
+# The report from the op mix on, which leaves out the timing
+stat() {
+  "$TRACESTAT" -w 3 "$1" > "$tmp/stat" || return 1
+  sed -n '/^Ops/,$p' "$tmp/stat" | diff "$tmp/known.out" -
+}
+
+check "tracestat: known trace" stat "$tmp/known.txt"
+
+# ################################################################### #
+# SHARDED TRACES
+# ################################################################### #
+
+# The per-thread streams of a sharded run with scans, merged as text and
+# as binary: both must parse to the same records
+sharded() {
+  "$TRACEGEN" -H range -n "$1" -S 20 -u 30 -o 3000 -s 5 -p "$tmp/pt" >/dev/null 2>&1 || return 1
+  "$TRACEMERGE" -f text -o "$tmp/merged.txt" "$tmp/pt" || return 1
+  "$TRACEMERGE" -o "$tmp/merged.bin" "$tmp/pt" || return 1
+  grep -q "^3 [0-9]" "$tmp/merged.txt" || return 1
+  for f in txt bin; do
+    "$TRACESTAT" "$tmp/merged.$f" | sed -n '/^Ops/,$p' > "$tmp/stat.$f" || return 1
+    "$TRACEREPLAY" "$tmp/merged.$f" | sed -n '/^Thread/,$p' | grep -v "^Duration\|^#txs" \
+      > "$tmp/replay.$f" || return 1
+  done
+  cmp "$tmp/stat.txt" "$tmp/stat.bin" && cmp "$tmp/replay.txt" "$tmp/replay.bin" || return 1
+  # One thread is deterministic: the merged text is tracegen's own
+  [ "$1" -gt 1 ] && return 0
+  "$TRACEGEN" -H range -n 1 -S 20 -u 30 -o 3000 -s 5 2>"$tmp/direct.txt" >/dev/null || return 1
+  cmp "$tmp/direct.txt" "$tmp/merged.txt"
+}
+
+check "sharded text: one thread" sharded 1
+check "sharded text: three threads" sharded 3
+
+# ################################################################### #
+# SUMMARY
+# ################################################################### #
+
+if [ $failed -ne 0 ]; then
+  echo "$failed check(s) failed" >&2
+  exit 1
+fi
+echo "All checks passed" >&2
@@ -0,0 +1,136 @@
+/*
+ * File:
+ *   ckpt.c
+ * Description:
+ *   Checkpoints of a run: the set, and where each thread is in its ops.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ckpt.h"
+
+/* Keys converted to the file's int64_t at a time */
+#define CKPT_CHUNK                      4096
+
+static void ckpt_fwrite(const void *p, size_t size, FILE *f, const char *path)
+{
+  if (size > 0 && fwrite(p, size, 1, f) != 1) {
+    perror(path);
+    exit(1);
+  }
+}
+
+static void ckpt_fread(void *p, size_t size, FILE *f, const char *path)
+{
+  if (size > 0 && fread(p, size, 1, f) != 1) {
+    fprintf(stderr, "%s: truncated checkpoint\n", path);
+    exit(1);
+  }
+}
+
+void ckpt_write(ckpt_t *c, intset_t *set, int nb_threads, int phase, uint64_t offset)
+{
+  char tmp[PATH_MAX];
+  int64_t buf[CKPT_CHUNK];
+  val_t *keys;
+  FILE *f;
+  int i, j, n;
+
+  n = set_size(set);
+  if ((keys = (val_t *)malloc((n + 1) * sizeof(val_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  n = set_snapshot(set, keys, n);
+
+  memset(&c->h, 0, sizeof(c->h));
+  c->h.magic = CKPT_MAGIC;
+  c->h.version = CKPT_VERSION;
+  c->h.rec_size = sizeof(ckpt_thread_t);
+  c->h.nb_threads = nb_threads;
+  c->h.phase = phase;
+  c->h.nb_keys = n;
+  c->h.offset = offset;
+
+  snprintf(tmp, sizeof(tmp), "%s.tmp", c->path);
+  if ((f = fopen(tmp, "wb")) == NULL) {
+    perror(tmp);
+    exit(1);
+  }
+  ckpt_fwrite(&c->h, sizeof(c->h), f, tmp);
+  ckpt_fwrite(c->threads, nb_threads * sizeof(ckpt_thread_t), f, tmp);
+  for (i = 0; i < n; i += CKPT_CHUNK) {
+    for (j = 0; j < CKPT_CHUNK && i + j < n; j++)
+      buf[j] = keys[i + j];
+    ckpt_fwrite(buf, j * sizeof(int64_t), f, tmp);
+  }
+  /* On disk before it replaces the previous one */
+  if (fflush(f) != 0 || fsync(fileno(f)) != 0 || fclose(f) != 0) {
+    perror(tmp);
+    exit(1);
+  }
+  if (rename(tmp, c->path) != 0) {
+    perror(c->path);
+    exit(1);
+  }
+  free(keys);
+}
+
+void ckpt_read(ckpt_t *c, const char *path)
+{
+  int64_t buf[CKPT_CHUNK];
+  uint64_t i, j;
+  FILE *f;
+
+  if ((f = fopen(path, "rb")) == NULL) {
+    perror(path);
+    exit(1);
+  }
+  ckpt_fread(&c->h, sizeof(c->h), f, path);
+  if (c->h.magic != CKPT_MAGIC || c->h.version != CKPT_VERSION ||
+      c->h.rec_size != sizeof(ckpt_thread_t) || c->h.nb_keys > INT_MAX) {
+    fprintf(stderr, "%s: not a checkpoint of this version of tracegen\n", path);
+    exit(1);
+  }
+  if ((c->threads = (ckpt_thread_t *)malloc((c->h.nb_threads + 1) *
+                                             sizeof(ckpt_thread_t))) == NULL ||
+      (c->keys = (val_t *)malloc((c->h.nb_keys + 1) * sizeof(val_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  ckpt_fread(c->threads, c->h.nb_threads * sizeof(ckpt_thread_t), f, path);
+  for (i = 0; i < c->h.nb_keys; i += CKPT_CHUNK) {
+    j = c->h.nb_keys - i < CKPT_CHUNK ? c->h.nb_keys - i : CKPT_CHUNK;
+    ckpt_fread(buf, j * sizeof(int64_t), f, path);
+    while (j-- > 0)
+      c->keys[i + j] = (val_t)buf[j];
+  }
+  fclose(f);
+}
+
+void ckpt_free(ckpt_t *c)
+{
+  free(c->threads);
+  free(c->keys);
+  c->threads = NULL;
+  c->keys = NULL;
+}
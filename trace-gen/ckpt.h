@@ -0,0 +1,81 @@
+/*
+ * File:
+ *   ckpt.h
+ * Description:
+ *   Checkpoints of a run: the set, and where each thread is in its ops.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _CKPT_H_
+# define _CKPT_H_
+
+# include <stdint.h>
+
+# include "barrier.h"
+# include "dist.h"
+# include "intset.h"
+# include "rng.h"
+
+# define CKPT_MAGIC                     0x4b434d50      /* "PMCK" */
+# define CKPT_VERSION                   1
+
+/*
+ * File layout: header, nb_threads thread records, then nb_keys int64_t
+ * keys in increasing order.  A checkpoint without threads is taken
+ * right after populating: it only holds the initial set.
+ */
+typedef struct ckpt_header {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t rec_size;                    /* sizeof(ckpt_thread_t) */
+  uint32_t nb_threads;
+  uint32_t phase;                       /* Of the threads' next op */
+  uint64_t nb_keys;
+  uint64_t offset;                      /* End of the shared trace stream */
+} ckpt_header_t;
+
+/* What a thread needs to go on with exactly the same ops */
+typedef struct ckpt_thread {
+  rng_t rng;
+  dist_state_t dist_state;
+  int32_t last;                         /* Alternate: the key to remove, or -1 */
+  uint64_t n;                           /* Ops done in the phase */
+  uint64_t seq;                         /* Of the next trace record */
+  uint64_t offset;                      /* End of its own trace stream, if any */
+} ckpt_thread_t;
+
+typedef struct ckpt {
+  ckpt_header_t h;
+  ckpt_thread_t *threads;
+  val_t *keys;
+  /* Taking checkpoints: every this many ops of each thread (0: none) */
+  const char *path;
+  long every;
+  barrier_t barrier;                    /* Of the worker threads */
+} ckpt_t;
+
+/*
+ * Writes the set of a quiescent run, with c->threads if nb_threads > 0,
+ * to a temporary file renamed over c->path: a run that is killed leaves
+ * the previous checkpoint intact.
+ */
+void ckpt_write(ckpt_t *c, intset_t *set, int nb_threads, int phase, uint64_t offset);
+/* Reads path into c; exits if it is not a checkpoint of this build */
+void ckpt_read(ckpt_t *c, const char *path);
+void ckpt_free(ckpt_t *c);
+
+#endif /* _CKPT_H_ */
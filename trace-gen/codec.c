@@ -0,0 +1,516 @@
+/*
+ * File:
+ *   codec.c
+ * Description:
+ *   Streaming trace compression (gzip, zstd, lz4).
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef TRACE_ZLIB
+# include <zlib.h>
+#endif
+#ifdef TRACE_ZSTD
+# include <zstd.h>
+#endif
+#ifdef TRACE_LZ4
+# include <lz4frame.h>
+#endif
+
+#include "codec.h"
+#include "trace.h"
+
+/* LZ4 frames are fed in blocks, so that the output buffer bounds them */
+#define CODEC_LZ4_BLOCK                 (1 << 16)
+
+static const char *codec_names[] = { "none", "gzip", "zstd", "lz4" };
+/* The fastest setting of each codec: traces are written at I/O speed */
+static const int codec_levels[] = { 0, 1, 1, 0 };
+static const int codec_max_levels[] = { 0, 9, 22, 12 };
+static const char *codec_flags[] = { "", "ZLIB", "ZSTD", "LZ4" };
+static const int codec_builtin[] = {
+  1,
+#ifdef TRACE_ZLIB
+  1,
+#else
+  0,
+#endif
+#ifdef TRACE_ZSTD
+  1,
+#else
+  0,
+#endif
+#ifdef TRACE_LZ4
+  1
+#else
+  0
+#endif
+};
+
+#if defined(TRACE_ZLIB) || defined(TRACE_ZSTD) || defined(TRACE_LZ4)
+static void codec_error(const char *what, const char *msg)
+{
+  fprintf(stderr, "%s: %s\n", what, msg);
+  exit(1);
+}
+#endif
+
+static void *codec_malloc(size_t size)
+{
+  void *p;
+
+  if ((p = malloc(size)) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  return p;
+}
+
+/* ################################################################### *
+ * CODECS
+ * ################################################################### */
+
+int codec_available(codec_kind_t kind)
+{
+  return kind <= CODEC_LZ4 && codec_builtin[kind];
+}
+
+const char *codec_name(codec_kind_t kind)
+{
+  return codec_names[kind];
+}
+
+int codec_parse(const char *s, codec_t *c)
+{
+  size_t len = strcspn(s, ":");
+  char *end;
+  int k;
+
+  for (k = CODEC_NONE; k <= CODEC_LZ4; k++) {
+    if (strlen(codec_names[k]) == len && strncmp(s, codec_names[k], len) == 0)
+      break;
+  }
+  if (k > CODEC_LZ4 || !codec_available((codec_kind_t)k))
+    return -1;
+  c->kind = (codec_kind_t)k;
+  c->level = codec_levels[k];
+  if (s[len] == ':') {
+    c->level = (int)strtol(s + len + 1, &end, 10);
+    if (end == s + len + 1 || *end != '\0' ||
+        c->level < 0 || c->level > codec_max_levels[k])
+      return -1;
+  }
+
+  return 0;
+}
+
+codec_kind_t codec_detect(const void *data, size_t len)
+{
+  const unsigned char *p = (const unsigned char *)data;
+
+  if (len >= 2 && p[0] == 0x1f && p[1] == 0x8b)
+    return CODEC_GZIP;
+  if (len >= 4 && p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f && p[3] == 0xfd)
+    return CODEC_ZSTD;
+  if (len >= 4 && p[0] == 0x04 && p[1] == 0x22 && p[2] == 0x4d && p[3] == 0x18)
+    return CODEC_LZ4;
+  return CODEC_NONE;
+}
+
+/* ################################################################### *
+ * COMPRESSION
+ * ################################################################### */
+
+static void out_emit(codec_out_t *o, const void *data, size_t len)
+{
+  trace_write_all(o->fd, data, len);
+  o->nb_out += len;
+}
+
+void codec_out_open(codec_out_t *o, int fd, const codec_t *c)
+{
+  o->fd = fd;
+  o->codec = *c;
+  o->ctx = NULL;
+  o->buf = NULL;
+  o->size = CODEC_BUFSIZE;
+  o->nb_in = o->nb_out = 0;
+
+  switch (c->kind) {
+#ifdef TRACE_ZLIB
+   case CODEC_GZIP: {
+     z_stream *z = (z_stream *)codec_malloc(sizeof(z_stream));
+     memset(z, 0, sizeof(*z));
+     /* 16 + window bits: gzip wrapper, so that zcat reads the trace */
+     if (deflateInit2(z, c->level, Z_DEFLATED, 16 + 15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+       codec_error("deflateInit2", z->msg ? z->msg : "failed");
+     o->ctx = z;
+     break;
+   }
+#endif
+#ifdef TRACE_ZSTD
+   case CODEC_ZSTD: {
+     ZSTD_CCtx *z;
+     if ((z = ZSTD_createCCtx()) == NULL)
+       codec_error("ZSTD_createCCtx", "failed");
+     ZSTD_CCtx_setParameter(z, ZSTD_c_compressionLevel, c->level);
+     o->size = ZSTD_CStreamOutSize();
+     o->ctx = z;
+     break;
+   }
+#endif
+#ifdef TRACE_LZ4
+   case CODEC_LZ4: {
+     LZ4F_cctx *z;
+     LZ4F_preferences_t prefs;
+     size_t n;
+     memset(&prefs, 0, sizeof(prefs));
+     prefs.compressionLevel = c->level;
+     if (LZ4F_isError(LZ4F_createCompressionContext(&z, LZ4F_VERSION)))
+       codec_error("LZ4F_createCompressionContext", "failed");
+     o->size = LZ4F_compressBound(CODEC_LZ4_BLOCK, &prefs) + LZ4F_HEADER_SIZE_MAX;
+     o->buf = (char *)codec_malloc(o->size);
+     n = LZ4F_compressBegin(z, o->buf, o->size, &prefs);
+     if (LZ4F_isError(n))
+       codec_error("LZ4F_compressBegin", LZ4F_getErrorName(n));
+     out_emit(o, o->buf, n);
+     o->ctx = z;
+     break;
+   }
+#endif
+   default:
+     break;
+  }
+  if (o->buf == NULL && c->kind != CODEC_NONE)
+    o->buf = (char *)codec_malloc(o->size);
+}
+
+void codec_out_write(codec_out_t *o, const void *data, size_t len)
+{
+  o->nb_in += len;
+
+  switch (o->codec.kind) {
+#ifdef TRACE_ZLIB
+   case CODEC_GZIP: {
+     z_stream *z = (z_stream *)o->ctx;
+     z->next_in = (Bytef *)data;
+     z->avail_in = len;
+     do {
+       z->next_out = (Bytef *)o->buf;
+       z->avail_out = o->size;
+       if (deflate(z, Z_NO_FLUSH) == Z_STREAM_ERROR)
+         codec_error("deflate", z->msg ? z->msg : "stream error");
+       out_emit(o, o->buf, o->size - z->avail_out);
+     } while (z->avail_in > 0 || z->avail_out == 0);
+     break;
+   }
+#endif
+#ifdef TRACE_ZSTD
+   case CODEC_ZSTD: {
+     ZSTD_inBuffer in = { data, len, 0 };
+     ZSTD_outBuffer out;
+     size_t r;
+     while (in.pos < in.size) {
+       out.dst = o->buf;
+       out.size = o->size;
+       out.pos = 0;
+       r = ZSTD_compressStream2((ZSTD_CCtx *)o->ctx, &out, &in, ZSTD_e_continue);
+       if (ZSTD_isError(r))
+         codec_error("ZSTD_compressStream2", ZSTD_getErrorName(r));
+       out_emit(o, o->buf, out.pos);
+     }
+     break;
+   }
+#endif
+#ifdef TRACE_LZ4
+   case CODEC_LZ4: {
+     const char *p = (const char *)data;
+     size_t n, r;
+     while (len > 0) {
+       n = len < CODEC_LZ4_BLOCK ? len : CODEC_LZ4_BLOCK;
+       r = LZ4F_compressUpdate((LZ4F_cctx *)o->ctx, o->buf, o->size, p, n, NULL);
+       if (LZ4F_isError(r))
+         codec_error("LZ4F_compressUpdate", LZ4F_getErrorName(r));
+       out_emit(o, o->buf, r);
+       p += n;
+       len -= n;
+     }
+     break;
+   }
+#endif
+   default:
+     out_emit(o, data, len);
+     break;
+  }
+}
+
+void codec_out_close(codec_out_t *o)
+{
+  switch (o->codec.kind) {
+#ifdef TRACE_ZLIB
+   case CODEC_GZIP: {
+     z_stream *z = (z_stream *)o->ctx;
+     int r;
+     z->next_in = NULL;
+     z->avail_in = 0;
+     do {
+       z->next_out = (Bytef *)o->buf;
+       z->avail_out = o->size;
+       r = deflate(z, Z_FINISH);
+       if (r == Z_STREAM_ERROR)
+         codec_error("deflate", z->msg ? z->msg : "stream error");
+       out_emit(o, o->buf, o->size - z->avail_out);
+     } while (r != Z_STREAM_END);
+     deflateEnd(z);
+     free(z);
+     break;
+   }
+#endif
+#ifdef TRACE_ZSTD
+   case CODEC_ZSTD: {
+     ZSTD_inBuffer in = { NULL, 0, 0 };
+     ZSTD_outBuffer out;
+     size_t r;
+     do {
+       out.dst = o->buf;
+       out.size = o->size;
+       out.pos = 0;
+       r = ZSTD_compressStream2((ZSTD_CCtx *)o->ctx, &out, &in, ZSTD_e_end);
+       if (ZSTD_isError(r))
+         codec_error("ZSTD_compressStream2", ZSTD_getErrorName(r));
+       out_emit(o, o->buf, out.pos);
+     } while (r != 0);
+     ZSTD_freeCCtx((ZSTD_CCtx *)o->ctx);
+     break;
+   }
+#endif
+#ifdef TRACE_LZ4
+   case CODEC_LZ4: {
+     size_t r = LZ4F_compressEnd((LZ4F_cctx *)o->ctx, o->buf, o->size, NULL);
+     if (LZ4F_isError(r))
+       codec_error("LZ4F_compressEnd", LZ4F_getErrorName(r));
+     out_emit(o, o->buf, r);
+     LZ4F_freeCompressionContext((LZ4F_cctx *)o->ctx);
+     break;
+   }
+#endif
+   default:
+     break;
+  }
+  free(o->buf);
+  o->buf = NULL;
+  o->ctx = NULL;
+}
+
+/* ################################################################### *
+ * DECOMPRESSION
+ * ################################################################### */
+
+static void in_refill(codec_in_t *in)
+{
+  ssize_t n;
+
+  in->pos = 0;
+  do {
+    n = read(in->fd, in->buf, CODEC_BUFSIZE);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    perror("read");
+    exit(1);
+  }
+  in->len = n;
+  in->eof = (n == 0);
+}
+
+void codec_in_open(codec_in_t *in, int fd)
+{
+  in->fd = fd;
+  in->ctx = NULL;
+  in->buf = (char *)codec_malloc(CODEC_BUFSIZE);
+  in->pending = 0;
+  in_refill(in);
+  in->kind = codec_detect(in->buf, in->len);
+  if (!codec_available(in->kind)) {
+    fprintf(stderr, "%s-compressed trace: rebuild with make %s=1\n",
+            codec_name(in->kind), codec_flags[in->kind]);
+    exit(1);
+  }
+
+  switch (in->kind) {
+#ifdef TRACE_ZLIB
+   case CODEC_GZIP: {
+     z_stream *z = (z_stream *)codec_malloc(sizeof(z_stream));
+     memset(z, 0, sizeof(*z));
+     if (inflateInit2(z, 16 + 15) != Z_OK)
+       codec_error("inflateInit2", z->msg ? z->msg : "failed");
+     in->ctx = z;
+     break;
+   }
+#endif
+#ifdef TRACE_ZSTD
+   case CODEC_ZSTD:
+     if ((in->ctx = ZSTD_createDCtx()) == NULL)
+       codec_error("ZSTD_createDCtx", "failed");
+     break;
+#endif
+#ifdef TRACE_LZ4
+   case CODEC_LZ4: {
+     LZ4F_dctx *z;
+     if (LZ4F_isError(LZ4F_createDecompressionContext(&z, LZ4F_VERSION)))
+       codec_error("LZ4F_createDecompressionContext", "failed");
+     in->ctx = z;
+     break;
+   }
+#endif
+   default:
+     break;
+  }
+}
+
+/*
+ * Decompress from the input buffer into [dst, dst + len): sets the
+ * bytes consumed and produced, and returns 1 at the end of a frame.
+ */
+static int in_decode(codec_in_t *in, char *dst, size_t len,
+                     size_t *consumed, size_t *produced)
+{
+  const char *src = in->buf + in->pos;
+  size_t avail = in->len - in->pos;
+
+  switch (in->kind) {
+#ifdef TRACE_ZLIB
+   case CODEC_GZIP: {
+     z_stream *z = (z_stream *)in->ctx;
+     int r;
+     z->next_in = (Bytef *)src;
+     z->avail_in = avail;
+     z->next_out = (Bytef *)dst;
+     z->avail_out = len;
+     r = inflate(z, Z_NO_FLUSH);
+     if (r != Z_OK && r != Z_STREAM_END && r != Z_BUF_ERROR)
+       codec_error("inflate", z->msg ? z->msg : "corrupt stream");
+     *consumed = avail - z->avail_in;
+     *produced = len - z->avail_out;
+     if (r == Z_STREAM_END) {
+       /* Concatenated members, as written by cat a.gz b.gz */
+       inflateReset(z);
+       return 1;
+     }
+     return 0;
+   }
+#endif
+#ifdef TRACE_ZSTD
+   case CODEC_ZSTD: {
+     ZSTD_inBuffer zin = { src, avail, 0 };
+     ZSTD_outBuffer zout = { dst, len, 0 };
+     size_t r = ZSTD_decompressStream((ZSTD_DCtx *)in->ctx, &zout, &zin);
+     if (ZSTD_isError(r))
+       codec_error("ZSTD_decompressStream", ZSTD_getErrorName(r));
+     *consumed = zin.pos;
+     *produced = zout.pos;
+     return r == 0;
+   }
+#endif
+#ifdef TRACE_LZ4
+   case CODEC_LZ4: {
+     size_t r;
+     *consumed = avail;
+     *produced = len;
+     r = LZ4F_decompress((LZ4F_dctx *)in->ctx, dst, produced, src, consumed, NULL);
+     if (LZ4F_isError(r))
+       codec_error("LZ4F_decompress", LZ4F_getErrorName(r));
+     return r == 0;
+   }
+#endif
+   default:
+     *consumed = *produced = avail < len ? avail : len;
+     memcpy(dst, src, *produced);
+     return 1;
+  }
+}
+
+size_t codec_in_read(codec_in_t *in, void *dst, size_t len)
+{
+  char *p = (char *)dst;
+  size_t got = 0, consumed, produced;
+  ssize_t n;
+
+  while (got < len) {
+    if (in->pos == in->len) {
+      if (in->eof)
+        break;
+      if (in->kind == CODEC_NONE && len - got >= CODEC_BUFSIZE) {
+        /* Large uncompressed reads bypass the buffer */
+        do {
+          n = read(in->fd, p + got, len - got);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) {
+          perror("read");
+          exit(1);
+        }
+        if (n == 0) {
+          in->eof = 1;
+          break;
+        }
+        got += n;
+        continue;
+      }
+      in_refill(in);
+      continue;
+    }
+    in->pending = !in_decode(in, p + got, len - got, &consumed, &produced);
+    in->pos += consumed;
+    got += produced;
+  }
+  if (in->eof && in->pending) {
+    fprintf(stderr, "Truncated %s stream\n", codec_name(in->kind));
+    exit(1);
+  }
+
+  return got;
+}
+
+void codec_in_close(codec_in_t *in)
+{
+  switch (in->kind) {
+#ifdef TRACE_ZLIB
+   case CODEC_GZIP:
+     inflateEnd((z_stream *)in->ctx);
+     free(in->ctx);
+     break;
+#endif
+#ifdef TRACE_ZSTD
+   case CODEC_ZSTD:
+     ZSTD_freeDCtx((ZSTD_DCtx *)in->ctx);
+     break;
+#endif
+#ifdef TRACE_LZ4
+   case CODEC_LZ4:
+     LZ4F_freeDecompressionContext((LZ4F_dctx *)in->ctx);
+     break;
+#endif
+   default:
+     break;
+  }
+  free(in->buf);
+  in->buf = NULL;
+}
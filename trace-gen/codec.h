@@ -0,0 +1,87 @@
+/*
+ * File:
+ *   codec.h
+ * Description:
+ *   Streaming trace compression (gzip, zstd, lz4).
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _CODEC_H_
+# define _CODEC_H_
+
+# include <stddef.h>
+# include <stdint.h>
+
+# define DEFAULT_COMPRESS               none
+# define CODEC_BUFSIZE                  (1 << 18)
+
+/*
+ * Codecs are built in with make ZLIB=1 (the default), ZSTD=1 and LZ4=1.
+ * Compressed streams are recognized by their magic number on input.
+ */
+typedef enum {
+  CODEC_NONE,
+  CODEC_GZIP,
+  CODEC_ZSTD,
+  CODEC_LZ4
+} codec_kind_t;
+
+typedef struct codec {
+  codec_kind_t kind;
+  int level;
+} codec_t;
+
+/* Compressing writer to a file descriptor */
+typedef struct codec_out {
+  int fd;
+  codec_t codec;
+  void *ctx;
+  char *buf;
+  size_t size;
+  uint64_t nb_in;                       /* Bytes before compression */
+  uint64_t nb_out;                      /* Bytes written to fd */
+} codec_out_t;
+
+/* Decompressing reader from a file descriptor */
+typedef struct codec_in {
+  int fd;
+  codec_kind_t kind;
+  void *ctx;
+  char *buf;                            /* Compressed bytes [pos, len) */
+  size_t pos;
+  size_t len;
+  int eof;
+  int pending;                          /* Inside a compressed frame */
+} codec_in_t;
+
+/* "<none|gzip|zstd|lz4>[:<level>]": returns -1 if unknown or not built in */
+int codec_parse(const char *s, codec_t *c);
+const char *codec_name(codec_kind_t kind);
+int codec_available(codec_kind_t kind);
+codec_kind_t codec_detect(const void *data, size_t len);
+
+void codec_out_open(codec_out_t *o, int fd, const codec_t *c);
+void codec_out_write(codec_out_t *o, const void *data, size_t len);
+/* Ends the stream; the file descriptor stays open */
+void codec_out_close(codec_out_t *o);
+
+void codec_in_open(codec_in_t *in, int fd);
+/* Reads up to len decompressed bytes: returns fewer only at the end */
+size_t codec_in_read(codec_in_t *in, void *dst, size_t len);
+void codec_in_close(codec_in_t *in);
+
+#endif /* _CODEC_H_ */
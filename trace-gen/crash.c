@@ -0,0 +1,131 @@
+/*
+ * File:
+ *   crash.c
+ * Description:
+ *   Crash-consistency checker: simulated crashes of the pmem pool, each
+ *   followed by the backend's recovery check.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "crash.h"
+
+typedef struct crash_node {
+  val_t val;
+  uintptr_t next;
+} crash_node_t;
+
+int crash_check_list(const pmem_image_t *img, size_t node_size, uintptr_t mark,
+                     const char **why)
+{
+  const crash_node_t *node;
+  uintptr_t p = pmem_image_root(img);
+  val_t last;
+  int keys = 0;
+
+  /* Strictly increasing keys also rule out cycles */
+  if (p == 0)
+    return 0;
+  if ((node = pmem_image_at(img, p, node_size)) == NULL || p % sizeof(uintptr_t) != 0) {
+    *why = "root out of the pool";
+    return -1;
+  }
+  if (node->val != VAL_MIN) {
+    *why = "no VAL_MIN sentinel at the root";
+    return -1;
+  }
+  while (node->val != VAL_MAX) {
+    p = node->next & ~mark;
+    if (p == 0) {
+      *why = "list ends before the VAL_MAX sentinel";
+      return -1;
+    }
+    if (p % sizeof(uintptr_t) != 0) {
+      *why = "misaligned link";
+      return -1;
+    }
+    if ((node->next & mark) == 0 && node->val != VAL_MIN)
+      keys++;
+    last = node->val;
+    if ((node = pmem_image_at(img, p, node_size)) == NULL) {
+      *why = "link out of the pool";
+      return -1;
+    }
+    if (node->val <= last) {
+      *why = "keys out of order";
+      return -1;
+    }
+  }
+  if (node->next != 0) {
+    *why = "VAL_MAX sentinel has a successor";
+    return -1;
+  }
+
+  return keys;
+}
+
+void crash_check(const set_ops_t *ops, crash_stats_t *st, FILE *f)
+{
+  pmem_image_t img;
+  const pmem_log_rec_t *r;
+  const char *why;
+  struct timespec start, end;
+  size_t i;
+
+  memset(st, 0, sizeof(*st));
+  st->fences = pmem_log.fences;
+  img.addr = (uintptr_t)pmem_root;
+  img.size = pmem_root->size;
+  /* Zero pages cost nothing until a replayed line lands on them */
+  img.base = mmap(NULL, img.size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (img.base == MAP_FAILED) {
+    perror("mmap");
+    exit(1);
+  }
+
+  /* Not stats_ticks(): its rate is only calibrated with -l */
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  /* Point i crashes after i write-backs; the last one is the final state */
+  for (i = 0; i <= pmem_log.nb; i++) {
+    if (i > 0) {
+      r = &pmem_log.recs[i - 1];
+      memcpy(img.base + r->off, r->line, PMEM_CACHE_LINE);
+    }
+    why = NULL;
+    st->points++;
+    if ((st->keys = ops->recover(&img, &why)) >= 0)
+      continue;
+    if (st->failed++ < CRASH_REPORT) {
+      r = &pmem_log.recs[i > 0 ? i - 1 : 0];
+      fprintf(f, "  point %-7lu: %s (", (unsigned long)i, why != NULL ? why : "not consistent");
+      if (r->op < 0)
+        fprintf(f, "populating");
+      else
+        fprintf(f, "op %lld", (long long)r->op);
+      fprintf(f, ", after fence %llu)\n", (unsigned long long)r->fence);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  st->elapsed = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0;
+
+  munmap(img.base, img.size);
+}
@@ -0,0 +1,63 @@
+/*
+ * File:
+ *   crash.h
+ * Description:
+ *   Crash-consistency checker: simulated crashes of the pmem pool, each
+ *   followed by the backend's recovery check.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _CRASH_H_
+# define _CRASH_H_
+
+# include <stddef.h>
+# include <stdint.h>
+# include <stdio.h>
+
+# include "intset.h"
+# include "pmem.h"
+
+/* Inconsistent crash points that are reported one by one */
+# define CRASH_REPORT                   10
+
+typedef struct crash_stats {
+  unsigned long points;                 /* Crash points checked */
+  unsigned long failed;                 /* Of which the set did not recover */
+  unsigned long fences;
+  int keys;                             /* Recovered after the last write-back */
+  double elapsed;                       /* ms */
+} crash_stats_t;
+
+/*
+ * Replays the write-backs logged by the pool (pmem_logging) into a
+ * zeroed image, one at a time: the image after each one is what a crash
+ * right then leaves, if lines reach memory in the order they are
+ * written back and unflushed stores are lost.  The backend's recover()
+ * checks every image; the first failures are printed to f.
+ */
+void crash_check(const set_ops_t *ops, crash_stats_t *st, FILE *f);
+
+/*
+ * Recovery check of a sorted list whose nodes start with { val_t val;
+ * node *next; }: from the root, strictly increasing keys between the
+ * VAL_MIN and VAL_MAX sentinels.  Returns the keys of nodes whose next
+ * has none of the mark bits set, or -1 and the broken invariant.
+ */
+int crash_check_list(const pmem_image_t *img, size_t node_size, uintptr_t mark,
+                     const char **why);
+
+#endif /* _CRASH_H_ */
@@ -0,0 +1,144 @@
+/*
+ * File:
+ *   dist.c
+ * Description:
+ *   Key distributions: uniform, Zipfian, hotspot, sequential and latest.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dist.h"
+
+#define DEFAULT_ZIPF_THETA              0.99
+
+int dist_parse(const char *s, dist_t *d)
+{
+  memset(d, 0, sizeof(*d));
+  if (strcmp(s, "uniform") == 0) {
+    d->kind = DIST_UNIFORM;
+  } else if (strcmp(s, "sequential") == 0) {
+    d->kind = DIST_SEQUENTIAL;
+  } else if (strncmp(s, "zipf", 4) == 0 && (s[4] == '\0' || s[4] == ':')) {
+    d->kind = DIST_ZIPF;
+    d->theta = (s[4] == ':') ? atof(s + 5) : DEFAULT_ZIPF_THETA;
+    if (d->theta <= 0.0 || d->theta >= 1.0)
+      return -1;
+  } else if (strncmp(s, "latest", 6) == 0 && (s[6] == '\0' || s[6] == ':')) {
+    d->kind = DIST_LATEST;
+    d->theta = (s[6] == ':') ? atof(s + 7) : DEFAULT_ZIPF_THETA;
+    if (d->theta <= 0.0 || d->theta >= 1.0)
+      return -1;
+  } else if (strncmp(s, "hotspot:", 8) == 0) {
+    d->kind = DIST_HOTSPOT;
+    if (sscanf(s + 8, "%lf:%lf", &d->hot_frac, &d->hot_prob) != 2 ||
+        d->hot_frac < 0.0 || d->hot_frac > 1.0 ||
+        d->hot_prob < 0.0 || d->hot_prob > 1.0)
+      return -1;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+/* Precompute everything so that sampling is constant time */
+void dist_init(dist_t *d, int range)
+{
+  int i;
+
+  d->range = range;
+  if (d->kind == DIST_ZIPF || d->kind == DIST_LATEST) {
+    d->zetan = 0.0;
+    for (i = 1; i <= range; i++)
+      d->zetan += 1.0 / pow((double)i, d->theta);
+    d->zeta2 = 1.0 + pow(0.5, d->theta);
+    d->alpha = 1.0 / (1.0 - d->theta);
+    d->eta = (1.0 - pow(2.0 / range, 1.0 - d->theta)) / (1.0 - d->zeta2 / d->zetan);
+  }
+  if (d->kind == DIST_HOTSPOT)
+    d->hot_size = (int)(d->hot_frac * range);
+}
+
+void dist_state_init(const dist_t *d, dist_state_t *st, int tid, int nb_threads)
+{
+  /* Threads scan disjoint stretches of the range */
+  st->next = (int)((long)d->range * tid / nb_threads);
+  st->latest = d->range;
+}
+
+void dist_print(const dist_t *d, FILE *f)
+{
+  switch (d->kind) {
+   case DIST_ZIPF:
+     fprintf(f, "zipf:%g", d->theta);
+     break;
+   case DIST_HOTSPOT:
+     fprintf(f, "hotspot:%g:%g", d->hot_frac, d->hot_prob);
+     break;
+   case DIST_SEQUENTIAL:
+     fprintf(f, "sequential");
+     break;
+   case DIST_LATEST:
+     fprintf(f, "latest:%g", d->theta);
+     break;
+   default:
+     fprintf(f, "uniform");
+     break;
+  }
+}
+
+int len_dist_parse(const char *s, len_dist_t *l)
+{
+  char *end;
+
+  memset(l, 0, sizeof(*l));
+  if (strncmp(s, "uniform:", 8) == 0) {
+    l->dist.kind = DIST_UNIFORM;
+    s += 8;
+  } else if (strncmp(s, "zipf:", 5) == 0) {
+    l->dist.kind = DIST_ZIPF;
+    l->dist.theta = DEFAULT_ZIPF_THETA;
+    s += 5;
+  } else {
+    l->fixed = 1;
+  }
+  l->max = (int)strtol(s, &end, 10);
+  if (end == s || l->max <= 0)
+    return -1;
+  if (l->dist.kind == DIST_ZIPF && *end == ':') {
+    l->dist.theta = atof(end + 1);
+    if (l->dist.theta <= 0.0 || l->dist.theta >= 1.0)
+      return -1;
+  } else if (*end != '\0') {
+    return -1;
+  }
+  dist_init(&l->dist, l->max);
+  return 0;
+}
+
+void len_dist_print(const len_dist_t *l, FILE *f)
+{
+  if (l->fixed) {
+    fprintf(f, "%d", l->max);
+  } else if (l->dist.kind == DIST_ZIPF) {
+    fprintf(f, "zipf:%d:%g", l->max, l->dist.theta);
+  } else {
+    fprintf(f, "uniform:%d", l->max);
+  }
+}
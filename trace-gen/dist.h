@@ -0,0 +1,131 @@
+/*
+ * File:
+ *   dist.h
+ * Description:
+ *   Key distributions: uniform, Zipfian, hotspot, sequential and latest.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _DIST_H_
+# define _DIST_H_
+
+# include <math.h>
+# include <stdio.h>
+
+# include "rng.h"
+
+# define DEFAULT_DIST                   uniform
+# define DEFAULT_SCAN_LENGTH            uniform:100
+
+typedef enum {
+  DIST_UNIFORM,
+  DIST_ZIPF,
+  DIST_HOTSPOT,
+  DIST_SEQUENTIAL,
+  DIST_LATEST
+} dist_kind_t;
+
+/* Read-only parameters, shared by all threads */
+typedef struct dist {
+  dist_kind_t kind;
+  int range;
+  /* Zipf (Gray et al., as in YCSB): rank 0 is the most popular */
+  double theta;
+  double zetan;
+  double zeta2;
+  double alpha;
+  double eta;
+  /* Hotspot: a fraction of the range gets a fraction of the accesses */
+  double hot_frac;
+  double hot_prob;
+  int hot_size;
+} dist_t;
+
+/* Per-thread state */
+typedef struct dist_state {
+  int next;                             /* Sequential: next key - 1 */
+  int latest;                           /* Latest: most recent insert */
+} dist_state_t;
+
+/* Scan lengths: fixed, or drawn from a key distribution over [1;max] */
+typedef struct len_dist {
+  int max;
+  int fixed;
+  dist_t dist;                          /* Uniform or zipf only */
+} len_dist_t;
+
+int dist_parse(const char *s, dist_t *d);
+void dist_init(dist_t *d, int range);
+void dist_state_init(const dist_t *d, dist_state_t *st, int tid, int nb_threads);
+void dist_print(const dist_t *d, FILE *f);
+/* "<n>", "uniform:<max>" or "zipf:<max>[:<theta>]"; also initializes */
+int len_dist_parse(const char *s, len_dist_t *l);
+void len_dist_print(const len_dist_t *l, FILE *f);
+
+static inline int dist_zipf(const dist_t *d, rng_t *r)
+{
+  double u = rand_double(r), uz = u * d->zetan;
+  int v;
+
+  if (uz < 1.0)
+    return 0;
+  if (uz < d->zeta2)
+    return 1;
+  v = (int)(d->range * pow(d->eta * u - d->eta + 1.0, d->alpha));
+  return v < d->range ? v : d->range - 1;
+}
+
+/* Return a key in [1;range] */
+static inline int dist_next(const dist_t *d, dist_state_t *st, rng_t *r)
+{
+  int v;
+
+  switch (d->kind) {
+   case DIST_ZIPF:
+     return dist_zipf(d, r) + 1;
+   case DIST_HOTSPOT:
+     if (d->hot_size == 0 || d->hot_size == d->range)
+       return rand_range(d->range, r) + 1;
+     if (rand_double(r) < d->hot_prob)
+       return rand_range(d->hot_size, r) + 1;
+     return d->hot_size + rand_range(d->range - d->hot_size, r) + 1;
+   case DIST_SEQUENTIAL:
+     v = st->next + 1;
+     st->next = (st->next + 1 == d->range) ? 0 : st->next + 1;
+     return v;
+   case DIST_LATEST:
+     /* Zipf over the distance to the most recently inserted key */
+     v = st->latest - dist_zipf(d, r);
+     return v >= 1 ? v : v + d->range;
+   default:
+     return rand_range(d->range, r) + 1;
+  }
+}
+
+static inline int len_dist_next(const len_dist_t *l, rng_t *r)
+{
+  /* Uniform and zipf draws have no per-thread state */
+  return l->fixed ? l->max : dist_next(&l->dist, NULL, r);
+}
+
+/* Latest: called after each successful insertion */
+static inline void dist_inserted(dist_state_t *st, int val)
+{
+  st->latest = val;
+}
+
+#endif /* _DIST_H_ */
@@ -0,0 +1,178 @@
+/*
+ * File:
+ *   ebr.c
+ * Description:
+ *   Epoch-based reclamation of the nodes unlinked by concurrent backends.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "alloc.h"
+#include "ebr.h"
+
+/*
+ * A thread in a section has announced the epoch it saw on entry.  The
+ * epoch only advances once every thread in a section has seen it, so a
+ * node unlinked and retired in epoch e cannot be reached by a section
+ * that is still running when the epoch reaches e + 2.  The retiring
+ * thread then hands the whole bag back to its node pool.
+ */
+
+volatile uint64_t ebr_epoch = EBR_BAGS;
+__thread ebr_thread_t *ebr_self;
+__thread ebr_stats_t ebr_stats;
+
+static ebr_thread_t *ebr_threads;
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+ebr_thread_t *ebr_register(void)
+{
+  ebr_thread_t *t;
+
+  t = (ebr_thread_t *)xmalloc_line(sizeof(*t));
+  memset(t, 0, sizeof(*t));
+  t->next = __atomic_load_n(&ebr_threads, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&ebr_threads, &t->next, t, 0,
+                                      __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    ;
+  ebr_self = t;
+
+  return t;
+}
+
+static void free_node(const ebr_node_t *n)
+{
+  if (n->fn != NULL)
+    n->fn(n->p);
+  else
+    node_free(n->p, n->size);
+}
+
+static void bag_free(ebr_thread_t *t, ebr_bag_t *b)
+{
+  int i;
+
+  for (i = 0; i < b->len; i++) {
+    free_node(&b->nodes[i]);
+    t->pending -= b->nodes[i].size;
+  }
+  ebr_stats.freed += b->len;
+  b->len = 0;
+}
+
+/* Free the bags retired at least two epochs before e */
+static void reclaim(ebr_thread_t *t, uint64_t e)
+{
+  int i;
+
+  for (i = 0; i < EBR_BAGS; i++) {
+    if (t->bags[i].len > 0 && t->bags[i].epoch + 2 <= e)
+      bag_free(t, &t->bags[i]);
+  }
+}
+
+/* Advance from e if no running section is still in an older epoch */
+static void try_advance(uint64_t e)
+{
+  ebr_thread_t *r;
+  uint64_t l;
+
+  for (r = __atomic_load_n(&ebr_threads, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+    l = __atomic_load_n(&r->local, __ATOMIC_ACQUIRE);
+    if ((l & 1) && (l >> 1) != e)
+      return;
+  }
+  if (__atomic_compare_exchange_n(&ebr_epoch, &e, e + 1, 0,
+                                  __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+    ebr_stats.advances++;
+}
+
+void ebr_retire(void *p, size_t size, ebr_free_t fn)
+{
+  ebr_thread_t *t = ebr_self;
+  uint64_t e = __atomic_load_n(&ebr_epoch, __ATOMIC_ACQUIRE), t0;
+  ebr_bag_t *b = &t->bags[e % EBR_BAGS];
+
+  /* The bag last held epoch e - 3 or older: it is safe */
+  if (b->len > 0 && b->epoch != e)
+    bag_free(t, b);
+  b->epoch = e;
+  if (b->len == b->size) {
+    b->size = (b->size == 0) ? EBR_BATCH : 2 * b->size;
+    if ((b->nodes = (ebr_node_t *)realloc(b->nodes, b->size * sizeof(ebr_node_t))) == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  b->nodes[b->len].p = p;
+  b->nodes[b->len].size = size;
+  b->nodes[b->len].fn = fn;
+  b->len++;
+  t->pending += size;
+  if (t->pending > ebr_stats.pending_max)
+    ebr_stats.pending_max = t->pending;
+  ebr_stats.retired++;
+
+  /* Batches amortize the scan of all threads */
+  if (++t->since >= EBR_BATCH) {
+    t->since = 0;
+    t0 = now_ns();
+    try_advance(e);
+    reclaim(t, __atomic_load_n(&ebr_epoch, __ATOMIC_ACQUIRE));
+    ebr_stats.reclaim_ns += now_ns() - t0;
+  }
+}
+
+void ebr_thread_fini(void)
+{
+  ebr_thread_t *t = ebr_self;
+
+  if (t == NULL)
+    return;
+  __atomic_store_n(&t->local, 0, __ATOMIC_RELEASE);
+  reclaim(t, __atomic_load_n(&ebr_epoch, __ATOMIC_ACQUIRE));
+  ebr_self = NULL;
+}
+
+void ebr_drain(void)
+{
+  ebr_thread_t *t, *next;
+  int i, j;
+
+  for (t = ebr_threads; t != NULL; t = next) {
+    next = t->next;
+    for (i = 0; i < EBR_BAGS; i++) {
+      for (j = 0; j < t->bags[i].len; j++)
+        free_node(&t->bags[i].nodes[j]);
+      free(t->bags[i].nodes);
+    }
+    free(t);
+  }
+  ebr_threads = NULL;
+  ebr_self = NULL;
+}
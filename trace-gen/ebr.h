@@ -0,0 +1,98 @@
+/*
+ * File:
+ *   ebr.h
+ * Description:
+ *   Epoch-based reclamation of the nodes unlinked by concurrent backends.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _EBR_H_
+# define _EBR_H_
+
+# include <stddef.h>
+# include <stdint.h>
+
+/* Retirements between attempts to advance the epoch */
+# define EBR_BATCH                      64
+/* A node retired in epoch e is freed once the epoch reaches e + 2 */
+# define EBR_BAGS                       3
+
+/* Called instead of node_free() for nodes that own more than memory */
+typedef void (*ebr_free_t)(void *p);
+
+typedef struct ebr_node {
+  void *p;
+  size_t size;
+  ebr_free_t fn;
+} ebr_node_t;
+
+/* Nodes retired by one thread during one epoch */
+typedef struct ebr_bag {
+  uint64_t epoch;
+  ebr_node_t *nodes;
+  int len, size;
+} ebr_bag_t;
+
+/* Per-thread record, linked in a global list and never unlinked */
+typedef struct ebr_thread {
+  volatile uint64_t local;              /* Epoch << 1 | 1 while in a section */
+  char pad[56];
+  ebr_bag_t bags[EBR_BAGS];
+  int since;                            /* Retired since the last attempt */
+  size_t pending;                       /* Bytes retired, not yet freed */
+  struct ebr_thread *next;
+} ebr_thread_t;
+
+/* Per-thread counters, read once the thread is done */
+typedef struct ebr_stats {
+  unsigned long retired;
+  unsigned long freed;
+  unsigned long advances;               /* Epochs advanced by this thread */
+  size_t pending_max;                   /* Peak bytes waiting for their epoch */
+  uint64_t reclaim_ns;                  /* Spent advancing and freeing */
+} ebr_stats_t;
+
+extern volatile uint64_t ebr_epoch;
+extern __thread ebr_thread_t *ebr_self;
+extern __thread ebr_stats_t ebr_stats;
+
+ebr_thread_t *ebr_register(void);
+/* Leave: what is still pending is freed by ebr_drain() */
+void ebr_thread_fini(void);
+void ebr_retire(void *p, size_t size, ebr_free_t fn);
+/* Frees every retired node; no thread may be in a section */
+void ebr_drain(void);
+
+/* Nodes reached between enter and exit are not freed under the caller */
+static inline void ebr_enter(void)
+{
+  ebr_thread_t *t = ebr_self;
+
+  if (t == NULL)
+    t = ebr_register();
+  __atomic_store_n(&t->local, (__atomic_load_n(&ebr_epoch, __ATOMIC_ACQUIRE) << 1) | 1,
+                   __ATOMIC_RELAXED);
+  /* Announce before the first shared load */
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void ebr_exit(void)
+{
+  __atomic_store_n(&ebr_self->local, 0, __ATOMIC_RELEASE);
+}
+
+#endif /* _EBR_H_ */
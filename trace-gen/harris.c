@@ -0,0 +1,302 @@
+/*
+ * File:
+ *   harris.c
+ * Description:
+ *   Lock-free sorted linked list set (Harris, "A Pragmatic Implementation
+ *   of Non-Blocking Linked-Lists"). Removal marks the low bit of the
+ *   victim's next pointer, then unlinks it with a CAS.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "alloc.h"
+#include "crash.h"
+#include "ebr.h"
+#include "intset.h"
+#include "memtrace.h"
+#include "pmem.h"
+
+/* Shared accesses are recorded in the memory trace */
+#define LOAD(p)                         (memtrace_load(p, sizeof(*(p))), \
+                                         __atomic_load_n(p, __ATOMIC_ACQUIRE))
+#define CAS(p, o, n)                    (memtrace_store(p, sizeof(*(p))), \
+                                         __sync_bool_compare_and_swap(p, o, n))
+
+#define IS_MARKED(p)                    (((uintptr_t)(p)) & 1)
+#define MARK(p)                         ((hrnode_t *)(((uintptr_t)(p)) | 1))
+#define UNMARK(p)                       ((hrnode_t *)(((uintptr_t)(p)) & ~(uintptr_t)1))
+
+/* ################################################################### *
+ * LOCK-FREE LIST
+ * ################################################################### */
+
+typedef struct hrnode {
+  val_t val;
+  struct hrnode *next;                  /* Low bit set: node is removed */
+} hrnode_t;
+
+typedef struct harris {
+  intset_t base;
+  hrnode_t *head;
+  hrnode_t *tail;
+} harris_t;
+
+static hrnode_t *new_hrnode(val_t val, hrnode_t *next)
+{
+  hrnode_t *node;
+
+  node = (hrnode_t *)node_alloc(sizeof(hrnode_t));
+  MT_ST(node->val, val);
+  MT_ST(node->next, next);
+
+  return node;
+}
+
+static intset_t *harris_new()
+{
+  harris_t *set;
+
+  if ((set = (harris_t *)malloc(sizeof(harris_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  set->tail = new_hrnode(VAL_MAX, NULL);
+  set->head = new_hrnode(VAL_MIN, set->tail);
+  pmem_flush(set->tail, sizeof(hrnode_t));
+  pmem_persist(set->head, sizeof(hrnode_t));
+  pmem_set_root(set->head);
+
+  return &set->base;
+}
+
+static void harris_delete(intset_t *s)
+{
+  harris_t *set = (harris_t *)s;
+  hrnode_t *node, *next;
+
+  ebr_drain();
+  for (node = set->head; node != NULL; node = next) {
+    next = UNMARK(node->next);
+    node_free(node, sizeof(hrnode_t));
+  }
+  free(set);
+}
+
+static int harris_size(intset_t *s)
+{
+  harris_t *set = (harris_t *)s;
+  int size = 0;
+  hrnode_t *node;
+
+  node = UNMARK(set->head->next);
+  while (node != set->tail) {
+    if (!IS_MARKED(node->next))
+      size++;
+    node = UNMARK(node->next);
+  }
+
+  return size;
+}
+
+static int harris_snapshot(intset_t *s, val_t *vals, int max)
+{
+  harris_t *set = (harris_t *)s;
+  int n = 0;
+  hrnode_t *node;
+
+  node = UNMARK(set->head->next);
+  while (node != set->tail && n < max) {
+    if (!IS_MARKED(node->next))
+      vals[n++] = node->val;
+    node = UNMARK(node->next);
+  }
+
+  return n;
+}
+
+/*
+ * Returns the first unmarked node with val >= val, and in *left its
+ * unmarked predecessor. Marked nodes found in between are unlinked and
+ * retired by whoever unlinks them. Callers are in an epoch section.
+ */
+static hrnode_t *harris_search(harris_t *set, val_t val, hrnode_t **left)
+{
+  hrnode_t *l = NULL, *l_next = NULL, *t, *t_next, *n;
+
+ again:
+  t = set->head;
+  t_next = LOAD(&t->next);
+  do {
+    if (!IS_MARKED(t_next)) {
+      l = t;
+      l_next = t_next;
+    }
+    t = UNMARK(t_next);
+    if (t == set->tail)
+      break;
+    t_next = LOAD(&t->next);
+  } while (IS_MARKED(t_next) || MT_LD(t->val) < val);
+  *left = l;
+
+  if (l_next == t) {
+    if (t != set->tail && IS_MARKED(LOAD(&t->next)))
+      goto again;
+    return t;
+  }
+  /* Snip the marked nodes between l and t */
+  if (!CAS(&l->next, l_next, t))
+    goto again;
+  pmem_persist(&l->next, sizeof(l->next));
+  for (n = l_next; n != t; n = t_next) {
+    t_next = UNMARK(LOAD(&n->next));
+    ebr_retire(n, sizeof(hrnode_t), NULL);
+  }
+  if (t != set->tail && IS_MARKED(LOAD(&t->next)))
+    goto again;
+
+  return t;
+}
+
+static int harris_contains(intset_t *s, val_t val)
+{
+  harris_t *set = (harris_t *)s;
+  hrnode_t *node;
+  int result;
+
+  ebr_enter();
+  node = UNMARK(LOAD(&set->head->next));
+  while (MT_LD(node->val) < val)
+    node = UNMARK(LOAD(&node->next));
+  result = (node->val == val && !IS_MARKED(LOAD(&node->next)));
+  ebr_exit();
+
+  return result;
+}
+
+static int harris_add(intset_t *s, val_t val)
+{
+  harris_t *set = (harris_t *)s;
+  hrnode_t *left, *right, *node = NULL;
+
+  ebr_enter();
+  while (1) {
+    right = harris_search(set, val, &left);
+    if (right != set->tail && right->val == val) {
+      /* Never published: nobody else can hold it */
+      if (node != NULL)
+        node_free(node, sizeof(hrnode_t));
+      ebr_exit();
+      return 0;
+    }
+    if (node == NULL)
+      node = new_hrnode(val, right);
+    node->next = right;
+    pmem_persist(node, sizeof(*node));
+    if (CAS(&left->next, right, node)) {
+      pmem_persist(&left->next, sizeof(left->next));
+      ebr_exit();
+      return 1;
+    }
+  }
+}
+
+static int harris_remove(intset_t *s, val_t val)
+{
+  harris_t *set = (harris_t *)s;
+  hrnode_t *left, *right, *right_next;
+
+  ebr_enter();
+  while (1) {
+    right = harris_search(set, val, &left);
+    if (right == set->tail || right->val != val) {
+      ebr_exit();
+      return 0;
+    }
+    right_next = LOAD(&right->next);
+    /* Logical removal: whoever marks the node owns the remove */
+    if (!IS_MARKED(right_next) && CAS(&right->next, right_next, MARK(right_next)))
+      break;
+  }
+  pmem_persist(&right->next, sizeof(right->next));
+  if (CAS(&left->next, right, right_next)) {
+    pmem_persist(&left->next, sizeof(left->next));
+    ebr_retire(right, sizeof(hrnode_t), NULL);
+  } else
+    harris_search(set, val, &left);
+  ebr_exit();
+
+  return 1;
+}
+
+/* Like contains, a scan does not help unlink marked nodes: it skips them */
+static int harris_scan(intset_t *s, val_t lo, int len)
+{
+  harris_t *set = (harris_t *)s;
+  hrnode_t *node, *next;
+  int n = 0;
+
+  ebr_enter();
+  node = UNMARK(LOAD(&set->head->next));
+  while (MT_LD(node->val) < lo)
+    node = UNMARK(LOAD(&node->next));
+  while (n < len && node != set->tail) {
+    next = LOAD(&node->next);
+    if (!IS_MARKED(next))
+      n++;
+    node = UNMARK(next);
+  }
+  ebr_exit();
+
+  return n;
+}
+
+/* Same as list_load(): one chain, published with a single store */
+static void harris_load(intset_t *s, const val_t *vals, int n)
+{
+  harris_t *set = (harris_t *)s;
+  hrnode_t *first, *last, *node;
+  int i;
+
+  if (n == 0)
+    return;
+  first = last = new_hrnode(vals[0], NULL);
+  for (i = 1; i < n; i++) {
+    node = new_hrnode(vals[i], NULL);
+    MT_ST(last->next, node);
+    pmem_flush(last, sizeof(*last));
+    last = node;
+  }
+  MT_ST(last->next, set->head->next);
+  pmem_persist(last, sizeof(*last));
+  MT_ST(set->head->next, first);
+  pmem_persist(&set->head->next, sizeof(set->head->next));
+}
+
+/* A marked node is removed, even if a crash left it linked in */
+static int harris_recover(const pmem_image_t *img, const char **why)
+{
+  return crash_check_list(img, sizeof(hrnode_t), 1, why);
+}
+
+const set_ops_t set_harris_ops = {
+  "harris", "Harris lock-free list (marked next pointers)", 1,
+  harris_new, harris_delete, harris_size, harris_contains, harris_add, harris_remove, 1,
+  0, NULL, NULL, NULL, harris_load, harris_scan, 0, NULL, harris_recover,
+  harris_snapshot
+};
@@ -0,0 +1,232 @@
+/*
+ * File:
+ *   hashset.c
+ * Description:
+ *   Open-addressing hash set with linear probing and backward-shift
+ *   deletion (no tombstones), O(1) expected per operation.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bulk.h"
+#include "intset.h"
+#include "memtrace.h"
+
+#define HASH_INITIAL_SIZE               1024
+/* How many values ahead batch operations prefetch */
+#define HASH_PREFETCH_DIST              8
+/* VAL_MIN is never a key (it is the list sentinel) */
+#define HASH_EMPTY                      ((val_t)VAL_MIN)
+
+/* ################################################################### *
+ * HASH SET
+ * ################################################################### */
+
+typedef struct hashset {
+  intset_t base;
+  val_t *table;
+  size_t mask;                          /* Table size - 1 (power of 2) */
+  size_t count;
+} hashset_t;
+
+static inline size_t hash(val_t val, size_t mask)
+{
+  /* Fibonacci hashing: keep the high bits of the product */
+  return (size_t)(((uint64_t)val * 0x9e3779b97f4a7c15ULL) >> 32) & mask;
+}
+
+static val_t *new_table(size_t size)
+{
+  val_t *table;
+  size_t i;
+
+  if ((table = (val_t *)malloc(size * sizeof(val_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  for (i = 0; i < size; i++)
+    table[i] = HASH_EMPTY;
+
+  return table;
+}
+
+static intset_t *hashset_new()
+{
+  hashset_t *set;
+
+  if ((set = (hashset_t *)malloc(sizeof(hashset_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  set->table = new_table(HASH_INITIAL_SIZE);
+  set->mask = HASH_INITIAL_SIZE - 1;
+  set->count = 0;
+
+  return &set->base;
+}
+
+static void hashset_delete(intset_t *s)
+{
+  hashset_t *set = (hashset_t *)s;
+
+  free(set->table);
+  free(set);
+}
+
+static int hashset_size(intset_t *s)
+{
+  return (int)((hashset_t *)s)->count;
+}
+
+/* The occupied buckets, sorted */
+static int hashset_snapshot(intset_t *s, val_t *vals, int max)
+{
+  hashset_t *set = (hashset_t *)s;
+  size_t i;
+  int n = 0;
+
+  for (i = 0; i <= set->mask && n < max; i++) {
+    if (set->table[i] != HASH_EMPTY)
+      vals[n++] = set->table[i];
+  }
+  bulk_sort(vals, n);
+
+  return n;
+}
+
+/* Index of val, or of the empty slot where it would go */
+static inline size_t hashset_probe(hashset_t *set, val_t val)
+{
+  size_t i = hash(val, set->mask);
+
+  while (MT_LD(set->table[i]) != val && set->table[i] != HASH_EMPTY)
+    i = (i + 1) & set->mask;
+
+  return i;
+}
+
+static void hashset_grow(hashset_t *set)
+{
+  val_t *old = set->table;
+  size_t i, size = set->mask + 1;
+
+  set->table = new_table(2 * size);
+  set->mask = 2 * size - 1;
+  for (i = 0; i < size; i++) {
+    if (old[i] != HASH_EMPTY)
+      set->table[hashset_probe(set, old[i])] = old[i];
+  }
+  free(old);
+}
+
+static int hashset_contains(intset_t *s, val_t val)
+{
+  hashset_t *set = (hashset_t *)s;
+
+  return set->table[hashset_probe(set, val)] == val;
+}
+
+static int hashset_add(intset_t *s, val_t val)
+{
+  hashset_t *set = (hashset_t *)s;
+  size_t i;
+
+  i = hashset_probe(set, val);
+  if (set->table[i] == val)
+    return 0;
+  MT_ST(set->table[i], val);
+  /* Keep the load factor below 1/2 */
+  if (++set->count * 2 > set->mask + 1)
+    hashset_grow(set);
+
+  return 1;
+}
+
+static int hashset_remove(intset_t *s, val_t val)
+{
+  hashset_t *set = (hashset_t *)s;
+  size_t i, j, k;
+
+  i = hashset_probe(set, val);
+  if (set->table[i] != val)
+    return 0;
+  /* Shift back following entries whose home slot is at or before i */
+  j = i;
+  while (1) {
+    j = (j + 1) & set->mask;
+    if (MT_LD(set->table[j]) == HASH_EMPTY)
+      break;
+    k = hash(set->table[j], set->mask);
+    if (((j - k) & set->mask) >= ((j - i) & set->mask)) {
+      MT_ST(set->table[i], set->table[j]);
+      i = j;
+    }
+  }
+  MT_ST(set->table[i], HASH_EMPTY);
+  set->count--;
+
+  return 1;
+}
+
+/*
+ * Batches are not sorted (hashing scatters them anyway); the home slot
+ * of each value is prefetched a few iterations before it is probed, so
+ * that the cache misses of successive values overlap.
+ */
+#define HASHSET_BATCH(name, op)                                          \
+static int name(intset_t *s, const set_batch_t *b, int n, int *res)     \
+{                                                                        \
+  hashset_t *set = (hashset_t *)s;                                       \
+  int i, count = 0;                                                      \
+                                                                         \
+  for (i = 0; i < n; i++) {                                              \
+    if (i + HASH_PREFETCH_DIST < n)                                      \
+      __builtin_prefetch(&set->table[hash(b[i + HASH_PREFETCH_DIST].val, \
+                                          set->mask)]);                  \
+    res[b[i].idx] = op(s, b[i].val);                                     \
+    count += res[b[i].idx];                                              \
+  }                                                                      \
+                                                                         \
+  return count;                                                          \
+}
+
+HASHSET_BATCH(hashset_contains_batch, hashset_contains)
+HASHSET_BATCH(hashset_add_batch, hashset_add)
+HASHSET_BATCH(hashset_remove_batch, hashset_remove)
+
+/* Size the table once, instead of growing it along the way */
+static void hashset_load(intset_t *s, const val_t *vals, int n)
+{
+  hashset_t *set = (hashset_t *)s;
+  int i;
+
+  while ((set->count + n) * 2 > set->mask + 1)
+    hashset_grow(set);
+  for (i = 0; i < n; i++)
+    MT_ST(set->table[hashset_probe(set, vals[i])], vals[i]);
+  set->count += n;
+}
+
+const set_ops_t set_hashset_ops = {
+  "hashset", "Open-addressing hash set, no synchronization (single thread only)", 0,
+  hashset_new, hashset_delete, hashset_size,
+  hashset_contains, hashset_add, hashset_remove, 0,
+  0, hashset_contains_batch, hashset_add_batch, hashset_remove_batch,
+  hashset_load, NULL, 0, NULL, NULL, hashset_snapshot
+};
@@ -0,0 +1,245 @@
+/*
+ * File:
+ *   hoh.c
+ * Description:
+ *   Sorted linked list set with hand-over-hand (lock coupling) locking.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "alloc.h"
+#include "crash.h"
+#include "intset.h"
+#include "memtrace.h"
+#include "pmem.h"
+
+/* ################################################################### *
+ * HAND-OVER-HAND LIST
+ * ################################################################### */
+
+typedef struct hnode {
+  val_t val;
+  struct hnode *next;
+  pthread_mutex_t lock;
+} hnode_t;
+
+typedef struct hoh {
+  intset_t base;
+  hnode_t *head;
+} hoh_t;
+
+static hnode_t *new_hnode(val_t val, hnode_t *next)
+{
+  hnode_t *node;
+
+  node = (hnode_t *)node_alloc(sizeof(hnode_t));
+  MT_ST(node->val, val);
+  MT_ST(node->next, next);
+  pthread_mutex_init(&node->lock, NULL);
+
+  return node;
+}
+
+static void free_hnode(hnode_t *node)
+{
+  pthread_mutex_destroy(&node->lock);
+  node_free(node, sizeof(hnode_t));
+}
+
+static intset_t *hoh_new()
+{
+  hoh_t *set;
+
+  if ((set = (hoh_t *)malloc(sizeof(hoh_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  set->head = new_hnode(VAL_MIN, new_hnode(VAL_MAX, NULL));
+  pmem_flush(set->head->next, sizeof(hnode_t));
+  pmem_persist(set->head, sizeof(hnode_t));
+  pmem_set_root(set->head);
+
+  return &set->base;
+}
+
+static void hoh_delete(intset_t *s)
+{
+  hoh_t *set = (hoh_t *)s;
+  hnode_t *node, *next;
+
+  node = set->head;
+  while (node != NULL) {
+    next = node->next;
+    free_hnode(node);
+    node = next;
+  }
+  free(set);
+}
+
+static int hoh_size(intset_t *s)
+{
+  hoh_t *set = (hoh_t *)s;
+  int size = 0;
+  hnode_t *node;
+
+  node = set->head->next;
+  while (node->next != NULL) {
+    size++;
+    node = node->next;
+  }
+
+  return size;
+}
+
+static int hoh_snapshot(intset_t *s, val_t *vals, int max)
+{
+  hoh_t *set = (hoh_t *)s;
+  int n = 0;
+  hnode_t *node;
+
+  for (node = set->head->next; node->next != NULL && n < max; node = node->next)
+    vals[n++] = node->val;
+
+  return n;
+}
+
+/* Returns with both *prev and the returned node locked */
+static hnode_t *hoh_walk(hoh_t *set, val_t val, hnode_t **prev)
+{
+  hnode_t *p, *n;
+
+  p = set->head;
+  pthread_mutex_lock(&p->lock);
+  n = MT_LD(p->next);
+  pthread_mutex_lock(&n->lock);
+  while (MT_LD(n->val) < val) {
+    pthread_mutex_unlock(&p->lock);
+    p = n;
+    n = MT_LD(p->next);
+    pthread_mutex_lock(&n->lock);
+  }
+  *prev = p;
+
+  return n;
+}
+
+static int hoh_contains(intset_t *s, val_t val)
+{
+  hnode_t *prev, *next;
+  int result;
+
+  next = hoh_walk((hoh_t *)s, val, &prev);
+  result = (next->val == val);
+  pthread_mutex_unlock(&next->lock);
+  pthread_mutex_unlock(&prev->lock);
+
+  return result;
+}
+
+static int hoh_add(intset_t *s, val_t val)
+{
+  hnode_t *prev, *next;
+  int result;
+
+  next = hoh_walk((hoh_t *)s, val, &prev);
+  result = (next->val != val);
+  if (result) {
+    hnode_t *node = new_hnode(val, next);
+    pmem_persist(node, sizeof(*node));
+    MT_ST(prev->next, node);
+    pmem_persist(&prev->next, sizeof(prev->next));
+  }
+  pthread_mutex_unlock(&next->lock);
+  pthread_mutex_unlock(&prev->lock);
+
+  return result;
+}
+
+static int hoh_remove(intset_t *s, val_t val)
+{
+  hnode_t *prev, *next;
+  int result;
+
+  next = hoh_walk((hoh_t *)s, val, &prev);
+  result = (next->val == val);
+  if (result) {
+    MT_ST(prev->next, MT_LD(next->next));
+    pmem_persist(&prev->next, sizeof(prev->next));
+  }
+  pthread_mutex_unlock(&next->lock);
+  pthread_mutex_unlock(&prev->lock);
+  /* Nobody can be waiting on next: they would have to hold prev first */
+  if (result)
+    free_hnode(next);
+
+  return result;
+}
+
+/* Locks are coupled along the whole scan, as along a walk */
+static int hoh_scan(intset_t *s, val_t lo, int len)
+{
+  hnode_t *prev, *node, *next;
+  int n;
+
+  node = hoh_walk((hoh_t *)s, lo, &prev);
+  pthread_mutex_unlock(&prev->lock);
+  for (n = 0; n < len && MT_LD(node->val) != VAL_MAX; n++) {
+    next = MT_LD(node->next);
+    pthread_mutex_lock(&next->lock);
+    pthread_mutex_unlock(&node->lock);
+    node = next;
+  }
+  pthread_mutex_unlock(&node->lock);
+
+  return n;
+}
+
+/* Same as list_load(): one chain, published with a single store */
+static void hoh_load(intset_t *s, const val_t *vals, int n)
+{
+  hoh_t *set = (hoh_t *)s;
+  hnode_t *first, *last, *node;
+  int i;
+
+  if (n == 0)
+    return;
+  first = last = new_hnode(vals[0], NULL);
+  for (i = 1; i < n; i++) {
+    node = new_hnode(vals[i], NULL);
+    MT_ST(last->next, node);
+    pmem_flush(last, sizeof(*last));
+    last = node;
+  }
+  MT_ST(last->next, set->head->next);
+  pmem_persist(last, sizeof(*last));
+  MT_ST(set->head->next, first);
+  pmem_persist(&set->head->next, sizeof(set->head->next));
+}
+
+static int hoh_recover(const pmem_image_t *img, const char **why)
+{
+  return crash_check_list(img, sizeof(hnode_t), 0, why);
+}
+
+const set_ops_t set_hoh_ops = {
+  "hoh", "Sorted linked list with hand-over-hand locking", 1,
+  hoh_new, hoh_delete, hoh_size, hoh_contains, hoh_add, hoh_remove, 1,
+  0, NULL, NULL, NULL, hoh_load, hoh_scan, 0, NULL, hoh_recover, hoh_snapshot
+};
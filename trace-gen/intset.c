@@ -0,0 +1,141 @@
+/*
+ * File:
+ *   intset.c
+ * Description:
+ *   Integer set backend registry.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "intset.h"
+
+static const set_ops_t *backends[] = {
+  &set_list_ops,
+  &set_coarse_ops,
+  &set_tx_ops,
+  &set_hoh_ops,
+  &set_lazy_ops,
+  &set_harris_ops,
+  &set_skiplist_ops,
+  &set_hashset_ops,
+  &set_unrolled_ops,
+  NULL
+};
+
+const set_ops_t *set_lookup(const char *name)
+{
+  int i;
+
+  for (i = 0; backends[i] != NULL; i++) {
+    if (strcmp(backends[i]->name, name) == 0)
+      return backends[i];
+  }
+  return NULL;
+}
+
+void set_print_backends(FILE *f)
+{
+  int i;
+
+  for (i = 0; backends[i] != NULL; i++)
+    fprintf(f, "          %-10s %s\n", backends[i]->name, backends[i]->desc);
+}
+
+/* ################################################################### *
+ * BATCH OPERATIONS
+ * ################################################################### */
+
+static int batch_cmp(const void *a, const void *b)
+{
+  const set_batch_t *x = (const set_batch_t *)a;
+  const set_batch_t *y = (const set_batch_t *)b;
+
+  if (x->val != y->val)
+    return (x->val < y->val) ? -1 : 1;
+  return x->idx - y->idx;
+}
+
+static int set_batch(intset_t *set, set_batch_fn_t batch,
+                     int (*op)(intset_t *, val_t),
+                     const val_t *vals, int n, int *res)
+{
+  set_batch_t *b;
+  int *r, i, count = 0;
+
+  if (batch == NULL || n < 2) {
+    for (i = 0; i < n; i++) {
+      int ok = op(set, vals[i]);
+      if (res != NULL)
+        res[i] = ok;
+      count += (ok != 0);
+    }
+    return count;
+  }
+
+  if ((b = (set_batch_t *)malloc(n * sizeof(set_batch_t))) == NULL ||
+      (r = (res != NULL) ? res : (int *)malloc(n * sizeof(int))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  for (i = 0; i < n; i++) {
+    b[i].val = vals[i];
+    b[i].idx = i;
+  }
+  if (set->ops->batch_sorted)
+    qsort(b, n, sizeof(set_batch_t), batch_cmp);
+  count = batch(set, b, n, r);
+  if (r != res)
+    free(r);
+  free(b);
+
+  return count;
+}
+
+int set_contains_batch(intset_t *set, const val_t *vals, int n, int *res)
+{
+  return set_batch(set, set->ops->contains_batch, set->ops->contains, vals, n, res);
+}
+
+int set_add_batch(intset_t *set, const val_t *vals, int n, int *res)
+{
+  return set_batch(set, set->ops->add_batch, set->ops->add, vals, n, res);
+}
+
+int set_remove_batch(intset_t *set, const val_t *vals, int n, int *res)
+{
+  return set_batch(set, set->ops->remove_batch, set->ops->remove, vals, n, res);
+}
+
+int set_contains_interleaved(intset_t *set, const val_t *vals, int n, int *res, int width)
+{
+  if (set->ops->contains_interleaved == NULL)
+    return set_contains_batch(set, vals, n, res);
+  if (width > SET_INTERLEAVE_MAX)
+    width = SET_INTERLEAVE_MAX;
+  return set->ops->contains_interleaved(set, vals, n, res, width < 1 ? 1 : width);
+}
+
+void set_load(intset_t *set, const val_t *vals, int n)
+{
+  if (set->ops->load != NULL)
+    set->ops->load(set, vals, n);
+  else
+    set_add_batch(set, vals, n, NULL);
+}
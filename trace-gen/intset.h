@@ -0,0 +1,170 @@
+/*
+ * File:
+ *   intset.h
+ * Description:
+ *   Integer set interface and backend registry.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _INTSET_H_
+# define _INTSET_H_
+
+# include <limits.h>
+# include <stdint.h>
+# include <stdio.h>
+
+# define DEFAULT_SET                    list
+
+/* Keys are machine words unless built with make KEY32=1 */
+# ifdef SET_KEY32
+typedef int32_t val_t;
+# else
+typedef intptr_t val_t;
+# endif
+# define VAL_MIN                        INT_MIN
+# define VAL_MAX                        INT_MAX
+/* Most lookups an interleaved walk keeps in flight */
+# define SET_INTERLEAVE_MAX             32
+
+struct intset;
+struct pmem_image;
+
+/* One value of a batch, tagged with its position in the caller's array */
+typedef struct set_batch {
+  val_t val;
+  int idx;
+} set_batch_t;
+
+/*
+ * Batch operations get their values (sorted by (val, idx) if the backend
+ * asks for it) and store the result of value b[i] in res[b[i].idx].
+ * Duplicates behave as if the values had been applied one by one in the
+ * caller's order.
+ */
+typedef int (*set_batch_fn_t)(struct intset *set, const set_batch_t *b, int n, int *res);
+
+/*
+ * Lookups of n values in the caller's order, up to width at once: each
+ * walk prefetches its next node and steps aside for the others, so that
+ * their misses overlap (AMAC).  Stores the result of vals[i] in res[i].
+ */
+typedef int (*set_interleave_fn_t)(struct intset *set, const val_t *vals, int n, int *res,
+                                   int width);
+
+/* A set backend; every operation returns non-zero on success */
+typedef struct set_ops {
+  const char *name;
+  const char *desc;
+  int concurrent;                       /* Safe to share between threads */
+  struct intset *(*new)(void);
+  void (*delete)(struct intset *set);
+  int (*size)(struct intset *set);
+  int (*contains)(struct intset *set, val_t val);
+  int (*add)(struct intset *set, val_t val);
+  int (*remove)(struct intset *set, val_t val);
+  int persistent;                       /* Flushes its stores with --pmem */
+  /* Optional single-pass batch operations (NULL: one call per value) */
+  int batch_sorted;
+  set_batch_fn_t contains_batch;
+  set_batch_fn_t add_batch;
+  set_batch_fn_t remove_batch;
+  /* Optional: build an empty set from sorted distinct values */
+  void (*load)(struct intset *set, const val_t *vals, int n);
+  /* Optional (ordered backends): visit up to len keys >= lo in order */
+  int (*scan)(struct intset *set, val_t lo, int len);
+  int transactional;                    /* Runs each operation as a transaction */
+  /* Optional: interleaved lookups (NULL: the batch or one call per value) */
+  set_interleave_fn_t contains_interleaved;
+  /* Optional (persistent backends): keys in a crash image, -1 and why if broken */
+  int (*recover)(const struct pmem_image *img, const char **why);
+  /* Up to max keys of a quiescent set, in increasing order (see ckpt.h) */
+  int (*snapshot)(struct intset *set, val_t *vals, int max);
+} set_ops_t;
+
+/* Backends embed this as their first member */
+typedef struct intset {
+  const set_ops_t *ops;
+} intset_t;
+
+extern const set_ops_t set_list_ops;
+extern const set_ops_t set_coarse_ops;
+extern const set_ops_t set_tx_ops;
+extern const set_ops_t set_hoh_ops;
+extern const set_ops_t set_lazy_ops;
+extern const set_ops_t set_harris_ops;
+extern const set_ops_t set_skiplist_ops;
+extern const set_ops_t set_hashset_ops;
+extern const set_ops_t set_unrolled_ops;
+
+const set_ops_t *set_lookup(const char *name);
+void set_print_backends(FILE *f);
+
+/* Apply one operation to n values; return the number of successes */
+int set_contains_batch(intset_t *set, const val_t *vals, int n, int *res);
+int set_add_batch(intset_t *set, const val_t *vals, int n, int *res);
+int set_remove_batch(intset_t *set, const val_t *vals, int n, int *res);
+/* Load sorted distinct values into an empty set */
+void set_load(intset_t *set, const val_t *vals, int n);
+/* Look up n values with up to width walks in flight */
+int set_contains_interleaved(intset_t *set, const val_t *vals, int n, int *res, int width);
+
+static inline intset_t *set_new(const set_ops_t *ops)
+{
+  intset_t *set = ops->new();
+
+  set->ops = ops;
+  return set;
+}
+
+static inline void set_delete(intset_t *set)
+{
+  set->ops->delete(set);
+}
+
+static inline int set_size(intset_t *set)
+{
+  return set->ops->size(set);
+}
+
+static inline int set_contains(intset_t *set, val_t val)
+{
+  return set->ops->contains(set, val);
+}
+
+static inline int set_add(intset_t *set, val_t val)
+{
+  return set->ops->add(set, val);
+}
+
+static inline int set_remove(intset_t *set, val_t val)
+{
+  return set->ops->remove(set, val);
+}
+
+/* Returns the number of keys visited */
+static inline int set_scan(intset_t *set, val_t lo, int len)
+{
+  return set->ops->scan(set, lo, len);
+}
+
+/* Returns the number of keys stored */
+static inline int set_snapshot(intset_t *set, val_t *vals, int max)
+{
+  return set->ops->snapshot(set, vals, max);
+}
+
+#endif /* _INTSET_H_ */
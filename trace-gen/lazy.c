@@ -0,0 +1,319 @@
+/*
+ * File:
+ *   lazy.c
+ * Description:
+ *   Lazy (optimistic) sorted linked list set: wait-free lookups, updates
+ *   lock the two affected nodes and validate them before linking
+ *   (Heller et al., "A Lazy Concurrent List-Based Set Algorithm").
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "alloc.h"
+#include "crash.h"
+#include "ebr.h"
+#include "intset.h"
+#include "memtrace.h"
+#include "pmem.h"
+
+/* Shared accesses are recorded in the memory trace */
+#define LOAD(p)                         (memtrace_load(p, sizeof(*(p))), \
+                                         __atomic_load_n(p, __ATOMIC_ACQUIRE))
+#define STORE(p, v)                     (memtrace_store(p, sizeof(*(p))), \
+                                         __atomic_store_n(p, v, __ATOMIC_RELEASE))
+
+/* ################################################################### *
+ * LAZY LIST
+ * ################################################################### */
+
+typedef struct lnode {
+  val_t val;
+  struct lnode *next;
+  int marked;                           /* Logically removed */
+  pthread_mutex_t lock;
+} lnode_t;
+
+typedef struct lazy {
+  intset_t base;
+  lnode_t *head;
+} lazy_t;
+
+static lnode_t *new_lnode(val_t val, lnode_t *next)
+{
+  lnode_t *node;
+
+  node = (lnode_t *)node_alloc(sizeof(lnode_t));
+  MT_ST(node->val, val);
+  MT_ST(node->next, next);
+  node->marked = 0;
+  pthread_mutex_init(&node->lock, NULL);
+
+  return node;
+}
+
+static void free_lnode(void *p)
+{
+  lnode_t *node = (lnode_t *)p;
+
+  pthread_mutex_destroy(&node->lock);
+  node_free(node, sizeof(lnode_t));
+}
+
+static intset_t *lazy_new()
+{
+  lazy_t *set;
+
+  if ((set = (lazy_t *)malloc(sizeof(lazy_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  set->head = new_lnode(VAL_MIN, new_lnode(VAL_MAX, NULL));
+  pmem_flush(set->head->next, sizeof(lnode_t));
+  pmem_persist(set->head, sizeof(lnode_t));
+  pmem_set_root(set->head);
+
+  return &set->base;
+}
+
+static void lazy_delete(intset_t *s)
+{
+  lazy_t *set = (lazy_t *)s;
+  lnode_t *node, *next;
+
+  ebr_drain();
+  for (node = set->head; node != NULL; node = next) {
+    next = node->next;
+    free_lnode(node);
+  }
+  free(set);
+}
+
+static int lazy_size(intset_t *s)
+{
+  lazy_t *set = (lazy_t *)s;
+  int size = 0;
+  lnode_t *node;
+
+  node = set->head->next;
+  while (node->next != NULL) {
+    size++;
+    node = node->next;
+  }
+
+  return size;
+}
+
+static int lazy_snapshot(intset_t *s, val_t *vals, int max)
+{
+  lazy_t *set = (lazy_t *)s;
+  int n = 0;
+  lnode_t *node;
+
+  for (node = set->head->next; node->next != NULL && n < max; node = node->next)
+    vals[n++] = node->val;
+
+  return n;
+}
+
+static lnode_t *lazy_walk(lazy_t *set, val_t val, lnode_t **prev)
+{
+  lnode_t *p, *n;
+
+  p = set->head;
+  n = LOAD(&p->next);
+  while (MT_LD(n->val) < val) {
+    p = n;
+    n = LOAD(&p->next);
+  }
+  *prev = p;
+
+  return n;
+}
+
+static inline int lazy_validate(lnode_t *prev, lnode_t *next)
+{
+  return !prev->marked && !next->marked && prev->next == next;
+}
+
+/* Every operation runs in an epoch section: unlinked nodes stay readable */
+static int lazy_contains(intset_t *s, val_t val)
+{
+  lnode_t *prev, *next;
+  int result;
+
+  ebr_enter();
+  next = lazy_walk((lazy_t *)s, val, &prev);
+  result = (next->val == val && !LOAD(&next->marked));
+  ebr_exit();
+
+  return result;
+}
+
+static int lazy_add(intset_t *s, val_t val)
+{
+  lazy_t *set = (lazy_t *)s;
+  lnode_t *prev, *next;
+  int result;
+
+  ebr_enter();
+  while (1) {
+    next = lazy_walk(set, val, &prev);
+    pthread_mutex_lock(&prev->lock);
+    pthread_mutex_lock(&next->lock);
+    if (lazy_validate(prev, next)) {
+      result = (next->val != val);
+      if (result) {
+        lnode_t *node = new_lnode(val, next);
+        pmem_persist(node, sizeof(*node));
+        STORE(&prev->next, node);
+        pmem_persist(&prev->next, sizeof(prev->next));
+      }
+      pthread_mutex_unlock(&next->lock);
+      pthread_mutex_unlock(&prev->lock);
+      ebr_exit();
+      return result;
+    }
+    pthread_mutex_unlock(&next->lock);
+    pthread_mutex_unlock(&prev->lock);
+  }
+}
+
+static int lazy_remove(intset_t *s, val_t val)
+{
+  lazy_t *set = (lazy_t *)s;
+  lnode_t *prev, *next;
+  int result;
+
+  ebr_enter();
+  while (1) {
+    next = lazy_walk(set, val, &prev);
+    pthread_mutex_lock(&prev->lock);
+    pthread_mutex_lock(&next->lock);
+    if (lazy_validate(prev, next)) {
+      result = (next->val == val);
+      if (result) {
+        /* Logical removal first, so lookups never see a half-removed node */
+        STORE(&next->marked, 1);
+        STORE(&prev->next, next->next);
+        pmem_persist(&prev->next, sizeof(prev->next));
+      }
+      pthread_mutex_unlock(&next->lock);
+      pthread_mutex_unlock(&prev->lock);
+      if (result)
+        ebr_retire(next, sizeof(lnode_t), free_lnode);
+      ebr_exit();
+      return result;
+    }
+    pthread_mutex_unlock(&next->lock);
+    pthread_mutex_unlock(&prev->lock);
+  }
+}
+
+/* Wait-free like contains: marked nodes are skipped, not counted */
+static int lazy_scan(intset_t *s, val_t lo, int len)
+{
+  lnode_t *prev, *node;
+  int n = 0;
+
+  ebr_enter();
+  node = lazy_walk((lazy_t *)s, lo, &prev);
+  while (n < len && MT_LD(node->val) != VAL_MAX) {
+    if (!LOAD(&node->marked))
+      n++;
+    node = LOAD(&node->next);
+  }
+  ebr_exit();
+
+  return n;
+}
+
+/* As list_contains_interleaved(), all walks in one epoch section */
+static int lazy_contains_interleaved(intset_t *s, const val_t *vals, int n, int *res,
+                                     int width)
+{
+  lazy_t *set = (lazy_t *)s;
+  lnode_t *next[SET_INTERLEAVE_MAX];
+  int idx[SET_INTERLEAVE_MAX];
+  int k, active, issued, count = 0;
+
+  ebr_enter();
+  for (active = 0; active < width && active < n; active++) {
+    idx[active] = active;
+    next[active] = LOAD(&set->head->next);
+    __builtin_prefetch(next[active]);
+  }
+  issued = active;
+  for (k = 0; active > 0; k = (k + 1 < active) ? k + 1 : 0) {
+    if (MT_LD(next[k]->val) < vals[idx[k]]) {
+      next[k] = LOAD(&next[k]->next);
+      __builtin_prefetch(next[k]);
+      continue;
+    }
+    res[idx[k]] = (next[k]->val == vals[idx[k]] && !LOAD(&next[k]->marked));
+    count += res[idx[k]];
+    if (issued < n) {
+      idx[k] = issued++;
+      next[k] = LOAD(&set->head->next);
+    } else {
+      active--;
+      idx[k] = idx[active];
+      next[k] = next[active];
+      k--;
+    }
+  }
+  ebr_exit();
+
+  return count;
+}
+
+/* Same as list_load(): one chain, published with a single store */
+static void lazy_load(intset_t *s, const val_t *vals, int n)
+{
+  lazy_t *set = (lazy_t *)s;
+  lnode_t *first, *last, *node;
+  int i;
+
+  if (n == 0)
+    return;
+  first = last = new_lnode(vals[0], NULL);
+  for (i = 1; i < n; i++) {
+    node = new_lnode(vals[i], NULL);
+    MT_ST(last->next, node);
+    pmem_flush(last, sizeof(*last));
+    last = node;
+  }
+  MT_ST(last->next, set->head->next);
+  pmem_persist(last, sizeof(*last));
+  MT_ST(set->head->next, first);
+  pmem_persist(&set->head->next, sizeof(set->head->next));
+}
+
+/* Marked nodes still linked in are counted: removal is not done yet */
+static int lazy_recover(const pmem_image_t *img, const char **why)
+{
+  return crash_check_list(img, sizeof(lnode_t), 0, why);
+}
+
+const set_ops_t set_lazy_ops = {
+  "lazy", "Lazy list: optimistic traversal, lock and validate on update", 1,
+  lazy_new, lazy_delete, lazy_size, lazy_contains, lazy_add, lazy_remove, 1,
+  0, NULL, NULL, NULL, lazy_load, lazy_scan, 0, lazy_contains_interleaved, lazy_recover,
+  lazy_snapshot
+};
@@ -0,0 +1,590 @@
+/*
+ * File:
+ *   list.c
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Sorted linked list set: sequential and coarse-grained lock versions.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "alloc.h"
+#include "crash.h"
+#include "intset.h"
+#include "memtrace.h"
+#include "pmem.h"
+#include "tm.h"
+
+/* ################################################################### *
+ * LINKED LIST
+ * ################################################################### */
+
+typedef struct node {
+  val_t val;
+  struct node *next;
+} node_t;
+
+/* TM_LD reads a key as the whole word it is padded to */
+_Static_assert(offsetof(node_t, next) == sizeof(uintptr_t), "keys must be word-padded");
+
+typedef struct list {
+  intset_t base;
+  node_t *head;
+  pthread_mutex_t lock;                 /* Only used by the coarse version */
+} list_t;
+
+static node_t *new_node(val_t val, node_t *next, int transactional)
+{
+  node_t *node;
+
+  if (transactional)
+    node = (node_t *)tm_alloc(sizeof(node_t));
+  else
+    node = (node_t *)node_alloc(sizeof(node_t));
+  MT_ST(node->val, val);
+  MT_ST(node->next, next);
+
+  return node;
+}
+
+static intset_t *list_new()
+{
+  list_t *set;
+  node_t *min, *max;
+
+  if ((set = (list_t *)malloc(sizeof(list_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  max = new_node(VAL_MAX, NULL, 0);
+  min = new_node(VAL_MIN, max, 0);
+  pmem_flush(max, sizeof(*max));
+  pmem_persist(min, sizeof(*min));
+  pmem_set_root(min);
+  set->head = min;
+  pthread_mutex_init(&set->lock, NULL);
+
+  return &set->base;
+}
+
+static void list_delete(intset_t *s)
+{
+  list_t *set = (list_t *)s;
+  node_t *node, *next;
+
+  node = set->head;
+  while (node != NULL) {
+    next = node->next;
+    node_free(node, sizeof(node_t));
+    node = next;
+  }
+  pthread_mutex_destroy(&set->lock);
+  free(set);
+}
+
+static int list_size(intset_t *s)
+{
+  list_t *set = (list_t *)s;
+  int size = 0;
+  node_t *node;
+
+  /* We have at least 2 elements */
+  node = set->head->next;
+  while (node->next != NULL) {
+    size++;
+    node = node->next;
+  }
+
+  return size;
+}
+
+static int list_snapshot(intset_t *s, val_t *vals, int max)
+{
+  list_t *set = (list_t *)s;
+  int n = 0;
+  node_t *node;
+
+  for (node = set->head->next; node->next != NULL && n < max; node = node->next)
+    vals[n++] = node->val;
+
+  return n;
+}
+
+static int list_contains(intset_t *s, val_t val)
+{
+  list_t *set = (list_t *)s;
+  int result;
+  node_t *prev, *next;
+
+# ifdef DEBUG
+  printf("++> set_contains(%d)\n", (int)val);
+  fflush(stdout);
+# endif
+
+  prev = set->head;
+  next = MT_LD(prev->next);
+  while (MT_LD(next->val) < val) {
+    prev = next;
+    next = MT_LD(prev->next);
+  }
+  result = (next->val == val);
+
+  return result;
+}
+
+static int list_add(intset_t *s, val_t val)
+{
+  list_t *set = (list_t *)s;
+  int result;
+  node_t *prev, *next;
+
+# ifdef DEBUG
+  printf("++> set_add(%d)\n", (int)val);
+  fflush(stdout);
+# endif
+
+  prev = set->head;
+  next = MT_LD(prev->next);
+  while (MT_LD(next->val) < val) {
+    prev = next;
+    next = MT_LD(prev->next);
+  }
+  result = (next->val != val);
+  if (result) {
+    node_t *node = new_node(val, next, 0);
+    /* The node must be durable before it becomes reachable */
+    pmem_persist(node, sizeof(*node));
+    MT_ST(prev->next, node);
+    pmem_persist(&prev->next, sizeof(prev->next));
+  }
+
+  return result;
+}
+
+static int list_remove(intset_t *s, val_t val)
+{
+  list_t *set = (list_t *)s;
+  int result;
+  node_t *prev, *next;
+
+# ifdef DEBUG
+  printf("++> set_remove(%d)\n", (int)val);
+  fflush(stdout);
+# endif
+
+  prev = set->head;
+  next = MT_LD(prev->next);
+  while (MT_LD(next->val) < val) {
+    prev = next;
+    next = MT_LD(prev->next);
+  }
+  result = (next->val == val);
+  if (result) {
+    MT_ST(prev->next, MT_LD(next->next));
+    pmem_persist(&prev->next, sizeof(prev->next));
+    node_free(next, sizeof(node_t));
+  }
+  return result;
+}
+
+/*
+ * Batches are sorted, so one merged pass serves them all: each walk
+ * resumes from the last node below the previous value.
+ */
+static int list_contains_batch(intset_t *s, const set_batch_t *b, int n, int *res)
+{
+  list_t *set = (list_t *)s;
+  int i, count = 0;
+  node_t *prev, *next;
+
+  prev = set->head;
+  for (i = 0; i < n; i++) {
+    next = MT_LD(prev->next);
+    while (MT_LD(next->val) < b[i].val) {
+      prev = next;
+      next = MT_LD(prev->next);
+    }
+    res[b[i].idx] = (next->val == b[i].val);
+    count += res[b[i].idx];
+  }
+
+  return count;
+}
+
+static int list_add_batch(intset_t *s, const set_batch_t *b, int n, int *res)
+{
+  list_t *set = (list_t *)s;
+  int i, count = 0;
+  node_t *prev, *next;
+
+  prev = set->head;
+  for (i = 0; i < n; i++) {
+    next = MT_LD(prev->next);
+    while (MT_LD(next->val) < b[i].val) {
+      prev = next;
+      next = MT_LD(prev->next);
+    }
+    res[b[i].idx] = (next->val != b[i].val);
+    if (res[b[i].idx]) {
+      node_t *node = new_node(b[i].val, next, 0);
+      pmem_persist(node, sizeof(*node));
+      MT_ST(prev->next, node);
+      pmem_persist(&prev->next, sizeof(prev->next));
+      count++;
+    }
+  }
+
+  return count;
+}
+
+static int list_remove_batch(intset_t *s, const set_batch_t *b, int n, int *res)
+{
+  list_t *set = (list_t *)s;
+  int i, count = 0;
+  node_t *prev, *next;
+
+  prev = set->head;
+  for (i = 0; i < n; i++) {
+    next = MT_LD(prev->next);
+    while (MT_LD(next->val) < b[i].val) {
+      prev = next;
+      next = MT_LD(prev->next);
+    }
+    res[b[i].idx] = (next->val == b[i].val);
+    if (res[b[i].idx]) {
+      MT_ST(prev->next, MT_LD(next->next));
+      pmem_persist(&prev->next, sizeof(prev->next));
+      node_free(next, sizeof(node_t));
+      count++;
+    }
+  }
+
+  return count;
+}
+
+/*
+ * No address is known beyond the next pointer, so there is nothing to
+ * prefetch: the walk is one dependent load per key.
+ */
+static int list_scan(intset_t *s, val_t lo, int len)
+{
+  list_t *set = (list_t *)s;
+  node_t *node;
+  int n;
+
+  node = MT_LD(set->head->next);
+  while (MT_LD(node->val) < lo)
+    node = MT_LD(node->next);
+  for (n = 0; n < len && MT_LD(node->val) != VAL_MAX; n++)
+    node = MT_LD(node->next);
+
+  return n;
+}
+
+/*
+ * Up to width walks in flight, one hop each in turn: a walk prefetches
+ * the node it moves to and yields, so that the misses of all walks
+ * overlap.  A finished walk's slot starts the next value.
+ */
+static int list_contains_interleaved(intset_t *s, const val_t *vals, int n, int *res,
+                                     int width)
+{
+  list_t *set = (list_t *)s;
+  node_t *next[SET_INTERLEAVE_MAX];
+  int idx[SET_INTERLEAVE_MAX];
+  int k, active, issued, count = 0;
+
+  for (active = 0; active < width && active < n; active++) {
+    idx[active] = active;
+    next[active] = MT_LD(set->head->next);
+    __builtin_prefetch(next[active]);
+  }
+  issued = active;
+  for (k = 0; active > 0; k = (k + 1 < active) ? k + 1 : 0) {
+    if (MT_LD(next[k]->val) < vals[idx[k]]) {
+      next[k] = MT_LD(next[k]->next);
+      __builtin_prefetch(next[k]);
+      continue;
+    }
+    res[idx[k]] = (next[k]->val == vals[idx[k]]);
+    count += res[idx[k]];
+    if (issued < n) {
+      idx[k] = issued++;
+      next[k] = MT_LD(set->head->next);
+    } else {
+      /* The last walk moves into the slot, which runs next round */
+      active--;
+      idx[k] = idx[active];
+      next[k] = next[active];
+      k--;
+    }
+  }
+
+  return count;
+}
+
+/*
+ * Nodes are allocated in key order, so that they are laid out along the
+ * chain; the chain is flushed as a whole and published with one store.
+ */
+static void list_load(intset_t *s, const val_t *vals, int n)
+{
+  list_t *set = (list_t *)s;
+  node_t *first, *last, *node;
+  int i;
+
+  if (n == 0)
+    return;
+  first = last = new_node(vals[0], NULL, 0);
+  for (i = 1; i < n; i++) {
+    node = new_node(vals[i], NULL, 0);
+    MT_ST(last->next, node);
+    pmem_flush(last, sizeof(*last));
+    last = node;
+  }
+  MT_ST(last->next, set->head->next);
+  pmem_persist(last, sizeof(*last));
+  MT_ST(set->head->next, first);
+  pmem_persist(&set->head->next, sizeof(set->head->next));
+}
+
+static int list_recover(const pmem_image_t *img, const char **why)
+{
+  return crash_check_list(img, sizeof(node_t), 0, why);
+}
+
+const set_ops_t set_list_ops = {
+  "list", "Sorted linked list, no synchronization (single thread only)", 0,
+  list_new, list_delete, list_size, list_contains, list_add, list_remove, 1,
+  1, list_contains_batch, list_add_batch, list_remove_batch, list_load,
+  list_scan, 0, list_contains_interleaved, list_recover, list_snapshot
+};
+
+/* ################################################################### *
+ * COARSE-GRAINED LOCK
+ * ################################################################### */
+
+static int coarse_contains(intset_t *s, val_t val)
+{
+  list_t *set = (list_t *)s;
+  int result;
+
+  pthread_mutex_lock(&set->lock);
+  result = list_contains(s, val);
+  pthread_mutex_unlock(&set->lock);
+
+  return result;
+}
+
+static int coarse_add(intset_t *s, val_t val)
+{
+  list_t *set = (list_t *)s;
+  int result;
+
+  pthread_mutex_lock(&set->lock);
+  result = list_add(s, val);
+  pthread_mutex_unlock(&set->lock);
+
+  return result;
+}
+
+static int coarse_remove(intset_t *s, val_t val)
+{
+  list_t *set = (list_t *)s;
+  int result;
+
+  pthread_mutex_lock(&set->lock);
+  result = list_remove(s, val);
+  pthread_mutex_unlock(&set->lock);
+
+  return result;
+}
+
+/* A batch takes the lock once */
+static int coarse_contains_batch(intset_t *s, const set_batch_t *b, int n, int *res)
+{
+  list_t *set = (list_t *)s;
+  int result;
+
+  pthread_mutex_lock(&set->lock);
+  result = list_contains_batch(s, b, n, res);
+  pthread_mutex_unlock(&set->lock);
+
+  return result;
+}
+
+static int coarse_add_batch(intset_t *s, const set_batch_t *b, int n, int *res)
+{
+  list_t *set = (list_t *)s;
+  int result;
+
+  pthread_mutex_lock(&set->lock);
+  result = list_add_batch(s, b, n, res);
+  pthread_mutex_unlock(&set->lock);
+
+  return result;
+}
+
+static int coarse_remove_batch(intset_t *s, const set_batch_t *b, int n, int *res)
+{
+  list_t *set = (list_t *)s;
+  int result;
+
+  pthread_mutex_lock(&set->lock);
+  result = list_remove_batch(s, b, n, res);
+  pthread_mutex_unlock(&set->lock);
+
+  return result;
+}
+
+static int coarse_contains_interleaved(intset_t *s, const val_t *vals, int n, int *res,
+                                       int width)
+{
+  list_t *set = (list_t *)s;
+  int result;
+
+  pthread_mutex_lock(&set->lock);
+  result = list_contains_interleaved(s, vals, n, res, width);
+  pthread_mutex_unlock(&set->lock);
+
+  return result;
+}
+
+static int coarse_scan(intset_t *s, val_t lo, int len)
+{
+  list_t *set = (list_t *)s;
+  int result;
+
+  pthread_mutex_lock(&set->lock);
+  result = list_scan(s, lo, len);
+  pthread_mutex_unlock(&set->lock);
+
+  return result;
+}
+
+const set_ops_t set_coarse_ops = {
+  "coarse", "Sorted linked list protected by a single lock", 1,
+  list_new, list_delete, list_size, coarse_contains, coarse_add, coarse_remove, 1,
+  1, coarse_contains_batch, coarse_add_batch, coarse_remove_batch, list_load,
+  coarse_scan, 0, coarse_contains_interleaved, list_recover, list_snapshot
+};
+
+/* ################################################################### *
+ * TRANSACTIONAL
+ * ################################################################### */
+
+/*
+ * The sequential algorithm, with every shared access instrumented and
+ * each operation one transaction (STM or HTM, see tm.h).
+ */
+
+static int tx_contains(intset_t *s, val_t val)
+{
+  list_t *set = (list_t *)s;
+  int result;
+  node_t *prev, *next;
+  val_t v;
+
+  TM_START();
+  prev = set->head;
+  next = TM_LD(prev->next);
+  while ((v = TM_LD(next->val)) < val) {
+    prev = next;
+    next = TM_LD(prev->next);
+  }
+  result = (v == val);
+  TM_COMMIT();
+
+  return result;
+}
+
+static int tx_add(intset_t *s, val_t val)
+{
+  list_t *set = (list_t *)s;
+  int result;
+  node_t *prev, *next;
+  val_t v;
+
+  TM_START();
+  prev = set->head;
+  next = TM_LD(prev->next);
+  while ((v = TM_LD(next->val)) < val) {
+    prev = next;
+    next = TM_LD(prev->next);
+  }
+  result = (v != val);
+  if (result)
+    TM_ST(prev->next, new_node(val, next, 1));
+  TM_COMMIT();
+
+  return result;
+}
+
+static int tx_remove(intset_t *s, val_t val)
+{
+  list_t *set = (list_t *)s;
+  int result;
+  node_t *prev, *next;
+  val_t v;
+
+  TM_START();
+  prev = set->head;
+  next = TM_LD(prev->next);
+  while ((v = TM_LD(next->val)) < val) {
+    prev = next;
+    next = TM_LD(prev->next);
+  }
+  result = (v == val);
+  if (result) {
+    TM_ST(prev->next, TM_LD(next->next));
+    tm_free(next, sizeof(node_t));
+  }
+  TM_COMMIT();
+
+  return result;
+}
+
+/* One read-only transaction: its read set grows with the scan */
+static int tx_scan(intset_t *s, val_t lo, int len)
+{
+  list_t *set = (list_t *)s;
+  node_t *node;
+  int n;
+
+  TM_START();
+  node = TM_LD(set->head->next);
+  while (TM_LD(node->val) < lo)
+    node = TM_LD(node->next);
+  for (n = 0; n < len && TM_LD(node->val) != VAL_MAX; n++)
+    node = TM_LD(node->next);
+  TM_COMMIT();
+
+  return n;
+}
+
+const set_ops_t set_tx_ops = {
+  "tx", "Sorted linked list, one transaction per operation (see --tm)", 1,
+  list_new, list_delete, list_size, tx_contains, tx_add, tx_remove, 0,
+  0, NULL, NULL, NULL, list_load,
+  tx_scan, 1, NULL, NULL, list_snapshot
+};
@@ -0,0 +1,80 @@
+/*
+ * File:
+ *   memdump.c
+ * Description:
+ *   Decode a memory access trace written by tracegen -T.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "memtrace.h"
+
+static int get_varint(FILE *f, uint64_t *v)
+{
+  int c, shift = 0;
+
+  *v = 0;
+  do {
+    if ((c = getc(f)) == EOF)
+      return 0;
+    *v |= (uint64_t)(c & 0x7f) << shift;
+    shift += 7;
+  } while (c & 0x80);
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  memtrace_header_t h;
+  uint64_t seq = UINT64_MAX, v;
+  uintptr_t addr = 0;
+  FILE *f;
+  int c;
+
+  if (argc != 2) {
+    fprintf(stderr, "Usage: memdump <file.mem>\n"
+                    "Prints one \"<op seq> <R|W> <address> <size>\" line per access\n");
+    exit(1);
+  }
+  if ((f = fopen(argv[1], "rb")) == NULL) {
+    perror(argv[1]);
+    exit(1);
+  }
+  if (fread(&h, sizeof(h), 1, f) != 1 || h.magic != MEMTRACE_MAGIC ||
+      h.version != MEMTRACE_VERSION) {
+    fprintf(stderr, "%s: not a version %d memory trace\n", argv[1], MEMTRACE_VERSION);
+    exit(1);
+  }
+  while ((c = getc(f)) != EOF) {
+    if (c & MEMTRACE_NEW_OP) {
+      if (!get_varint(f, &v))
+        break;
+      seq += v + 1;
+    }
+    if (!get_varint(f, &v))
+      break;
+    addr += (uintptr_t)((v >> 1) ^ -(v & 1));
+    printf("%llu %c 0x%llx %d\n", (unsigned long long)seq,
+           (c & MEMTRACE_STORE) ? 'W' : 'R', (unsigned long long)addr,
+           1 << ((c >> MEMTRACE_SIZE_SHIFT) & 3));
+  }
+  fclose(f);
+
+  return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * File:
+ *   memtrace.c
+ * Description:
+ *   Memory access traces: the loads and stores each set operation makes,
+ *   delta and varint encoded into one stream per thread.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "memtrace.h"
+#include "trace.h"
+
+__thread memtrace_t *memtrace_tls;
+
+static inline unsigned char *put_varint(unsigned char *p, uint64_t v)
+{
+  while (v >= 0x80) {
+    *p++ = (unsigned char)(v | 0x80);
+    v >>= 7;
+  }
+  *p++ = (unsigned char)v;
+  return p;
+}
+
+void memtrace_init(memtrace_t *mt, const char *prefix, uint32_t tid,
+                   const uint64_t *seq)
+{
+  char name[PATH_MAX];
+  memtrace_header_t h;
+
+  snprintf(name, sizeof(name), "%s.%u.mem", prefix, tid);
+  mt->fd = trace_create(name);
+  memset(&h, 0, sizeof(h));
+  h.magic = MEMTRACE_MAGIC;
+  h.version = MEMTRACE_VERSION;
+  h.tid = tid;
+  trace_write_all(mt->fd, &h, sizeof(h));
+
+  if ((mt->data = (unsigned char *)malloc(MEMTRACE_BUFSIZE)) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  mt->len = 0;
+  mt->seq = seq;
+  /* Forces a new-op marker on the first access */
+  mt->last_seq = UINT64_MAX;
+  mt->last_addr = 0;
+  mt->nb_access = 0;
+}
+
+void memtrace_record(memtrace_t *mt, const void *addr, size_t size, int store)
+{
+  unsigned char *p, flags;
+  int64_t delta;
+
+  if (mt->len + MEMTRACE_REC_MAX > MEMTRACE_BUFSIZE)
+    memtrace_flush(mt);
+  p = mt->data + mt->len;
+
+  flags = store ? MEMTRACE_STORE : 0;
+  flags |= (unsigned char)((size >= 8 ? 3 : size >= 4 ? 2 : size >= 2 ? 1 : 0)
+                           << MEMTRACE_SIZE_SHIFT);
+  if (*mt->seq != mt->last_seq)
+    flags |= MEMTRACE_NEW_OP;
+  *p++ = flags;
+  if (flags & MEMTRACE_NEW_OP) {
+    p = put_varint(p, *mt->seq - (mt->last_seq + 1));
+    mt->last_seq = *mt->seq;
+  }
+  delta = (int64_t)((uintptr_t)addr - mt->last_addr);
+  p = put_varint(p, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+  mt->last_addr = (uintptr_t)addr;
+
+  mt->len = p - mt->data;
+  mt->nb_access++;
+}
+
+void memtrace_flush(memtrace_t *mt)
+{
+  trace_write_all(mt->fd, mt->data, mt->len);
+  mt->len = 0;
+}
+
+void memtrace_destroy(memtrace_t *mt)
+{
+  memtrace_flush(mt);
+  close(mt->fd);
+  free(mt->data);
+  mt->data = NULL;
+}
@@ -0,0 +1,104 @@
+/*
+ * File:
+ *   memtrace.h
+ * Description:
+ *   Memory access traces: the loads and stores each set operation makes,
+ *   delta and varint encoded into one stream per thread.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _MEMTRACE_H_
+# define _MEMTRACE_H_
+
+# include <stddef.h>
+# include <stdint.h>
+
+# define MEMTRACE_MAGIC                 0x544d4d50      /* "PMMT" */
+# define MEMTRACE_VERSION               1
+# define MEMTRACE_BUFSIZE               (1 << 20)
+/* Longest encoded access: flags, op delta and address delta varints */
+# define MEMTRACE_REC_MAX               (1 + 10 + 10)
+
+/*
+ * Each access starts with a flags byte:
+ *   bit 0     store (otherwise load)
+ *   bits 1-2  log2 of the access size
+ *   bit 3     first access of a new operation: a varint with the
+ *             increment of the op sequence number follows
+ * then the zigzag varint of the address minus the previous address.
+ */
+# define MEMTRACE_STORE                 0x01
+# define MEMTRACE_SIZE_SHIFT            1
+# define MEMTRACE_NEW_OP                0x08
+
+typedef struct memtrace_header {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t pad;
+  uint32_t tid;
+  uint32_t pad2;
+} memtrace_header_t;
+
+typedef struct memtrace {
+  int fd;
+  unsigned char *data;
+  size_t len;
+  const uint64_t *seq;                  /* Sequence number of the current op */
+  uint64_t last_seq;
+  uintptr_t last_addr;
+  unsigned long nb_access;
+} memtrace_t;
+
+/* Set in threads that record accesses, NULL elsewhere */
+extern __thread memtrace_t *memtrace_tls;
+
+void memtrace_init(memtrace_t *mt, const char *prefix, uint32_t tid,
+                   const uint64_t *seq);
+void memtrace_record(memtrace_t *mt, const void *addr, size_t size, int store);
+void memtrace_flush(memtrace_t *mt);
+void memtrace_destroy(memtrace_t *mt);
+
+/* Built with make MEMTRACE=0, the sets have no hook left */
+# ifdef SET_NO_MEMTRACE
+#  define MEMTRACE_BUILT                0
+# else
+#  define MEMTRACE_BUILT                1
+# endif
+
+static inline void memtrace_access(const void *addr, size_t size, int store)
+{
+  if (MEMTRACE_BUILT && memtrace_tls != NULL)
+    memtrace_record(memtrace_tls, addr, size, store);
+}
+
+static inline void memtrace_load(const void *addr, size_t size)
+{
+  memtrace_access(addr, size, 0);
+}
+
+static inline void memtrace_store(const void *addr, size_t size)
+{
+  memtrace_access(addr, size, 1);
+}
+
+/* Read or write an lvalue, recording the access (v is evaluated first) */
+# define MT_LD(x)                       (memtrace_load(&(x), sizeof(x)), (x))
+# define MT_ST(x, v)                    ({ __typeof__(x) _mt_v = (v);          \
+                                           memtrace_store(&(x), sizeof(x));    \
+                                           (x) = _mt_v; })
+
+#endif /* _MEMTRACE_H_ */
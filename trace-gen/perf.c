@@ -0,0 +1,336 @@
+/*
+ * File:
+ *   perf.c
+ * Description:
+ *   Hardware performance counters (perf_event_open) around the worker loop.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "perf.h"
+
+#define PERF_SYSFS                      "/sys/bus/event_source/devices"
+#define PERF_CACHE(id, result)          ((id) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+                                         ((result) << 16))
+
+static const struct {
+  const char *name;
+  uint32_t type;
+  uint64_t config;
+} perf_names[] = {
+  { "cycles",        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+  { "instructions",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+  { "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+  { "llc-loads",     PERF_TYPE_HW_CACHE,
+    PERF_CACHE(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_RESULT_ACCESS) },
+  { "llc-misses",    PERF_TYPE_HW_CACHE,
+    PERF_CACHE(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+  { "dtlb-misses",   PERF_TYPE_HW_CACHE,
+    PERF_CACHE(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+  { "node-misses",   PERF_TYPE_HW_CACHE,
+    PERF_CACHE(PERF_COUNT_HW_CACHE_NODE, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+  { NULL, 0, 0 }
+};
+
+/* ################################################################### *
+ * PARSING
+ * ################################################################### */
+
+/* First line of a sysfs file of the PMU, or -1 */
+static int read_pmu(const char *pmu, const char *file, char *buf, int len)
+{
+  char path[256];
+  FILE *f;
+  int ok;
+
+  snprintf(path, sizeof(path), "%s/%s/%s", PERF_SYSFS, pmu, file);
+  if ((f = fopen(path, "r")) == NULL)
+    return -1;
+  ok = (fgets(buf, len, f) != NULL);
+  fclose(f);
+
+  return ok ? 0 : -1;
+}
+
+/* <pmu>/<hex>: the PMU type, and the CPU of its cpumask if it is uncore */
+static int parse_pmu(const char *s, perf_event_t *e)
+{
+  char pmu[64], buf[256], *end;
+  const char *slash = strchr(s, '/');
+  size_t len = slash - s;
+
+  if (len == 0 || len >= sizeof(pmu))
+    return -1;
+  memcpy(pmu, s, len);
+  pmu[len] = '\0';
+  e->config = strtoull(slash + 1, &end, 16);
+  if (end == slash + 1 || *end != '\0')
+    return -1;
+  if (read_pmu(pmu, "type", buf, sizeof(buf)) != 0)
+    return -1;
+  e->type = (uint32_t)strtoul(buf, NULL, 10);
+  /* Uncore PMUs count for a whole socket, on one CPU of their mask */
+  e->cpu = -1;
+  if (read_pmu(pmu, "cpumask", buf, sizeof(buf)) == 0)
+    e->cpu = atoi(buf);
+
+  return 0;
+}
+
+static int parse_event(const char *s, perf_event_t *e)
+{
+  char *end;
+  int i;
+
+  if (strlen(s) >= sizeof(e->name))
+    return -1;
+  strcpy(e->name, s);
+  e->cpu = -1;
+  for (i = 0; perf_names[i].name != NULL; i++) {
+    if (strcmp(s, perf_names[i].name) == 0) {
+      e->type = perf_names[i].type;
+      e->config = perf_names[i].config;
+      return 0;
+    }
+  }
+  if (strncmp(s, "raw:", 4) == 0) {
+    e->type = PERF_TYPE_RAW;
+    e->config = strtoull(s + 4, &end, 16);
+    return (end == s + 4 || *end != '\0') ? -1 : 0;
+  }
+  if (strchr(s, '/') != NULL)
+    return parse_pmu(s, e);
+
+  return -1;
+}
+
+int perf_parse(const char *s, perf_spec_t *spec)
+{
+  char buf[256], *tok, *save;
+
+  if (strcmp(s, "default") == 0)
+    s = PERF_DEFAULT;
+  if (strlen(s) >= sizeof(buf))
+    return -1;
+  strcpy(buf, s);
+  spec->nb = 0;
+  for (tok = strtok_r(buf, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+    if (spec->nb == PERF_MAX_EVENTS || parse_event(tok, &spec->ev[spec->nb]) != 0)
+      return -1;
+    spec->nb++;
+  }
+
+  return spec->nb > 0 ? 0 : -1;
+}
+
+void perf_print(const perf_spec_t *spec, FILE *f)
+{
+  int i;
+
+  for (i = 0; i < spec->nb; i++)
+    fprintf(f, "%s%s%s", i > 0 ? "," : "", spec->ev[i].name,
+            perf_is_uncore(&spec->ev[i]) ? " (uncore)" : "");
+  if (spec->nb == 0)
+    fprintf(f, "none available");
+}
+
+/* ################################################################### *
+ * COUNTERS
+ * ################################################################### */
+
+static int perf_event_open(const perf_event_t *e, int leader)
+{
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = e->type;
+  attr.config = e->config;
+  attr.disabled = (leader < 0);
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  if (perf_is_uncore(e))
+    return (int)syscall(SYS_perf_event_open, &attr, -1, e->cpu, -1, 0);
+  /* The thread's own work: reading the counters costs no user cycles */
+  attr.read_format |= PERF_FORMAT_GROUP;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+void perf_init(perf_spec_t *spec)
+{
+  int i, j, fd;
+
+  for (i = j = 0; i < spec->nb; i++) {
+    if ((fd = perf_event_open(&spec->ev[i], -1)) < 0) {
+      printf("WARNING: cannot count %s: %s\n", spec->ev[i].name, strerror(errno));
+      continue;
+    }
+    close(fd);
+    spec->ev[j++] = spec->ev[i];
+  }
+  spec->nb = j;
+}
+
+int perf_open(perf_group_t *g, const perf_spec_t *spec, int uncore)
+{
+  int i, fd;
+
+  g->nb = 0;
+  /* Uncore PMUs cannot share a group with the core or with each other */
+  g->grouped = !uncore;
+  for (i = 0; i < spec->nb; i++) {
+    if (perf_is_uncore(&spec->ev[i]) != uncore)
+      continue;
+    fd = perf_event_open(&spec->ev[i], (g->grouped && g->nb > 0) ? g->fd[0] : -1);
+    if (fd < 0)
+      continue;
+    g->ev[g->nb] = i;
+    g->fd[g->nb++] = fd;
+  }
+
+  return g->nb;
+}
+
+void perf_enable(perf_group_t *g)
+{
+  int i;
+
+  for (i = 0; i < g->nb; i++) {
+    ioctl(g->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    if (g->grouped)
+      break;
+  }
+}
+
+void perf_disable(perf_group_t *g)
+{
+  int i;
+
+  for (i = 0; i < g->nb; i++) {
+    ioctl(g->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+    if (g->grouped)
+      break;
+  }
+}
+
+void perf_read(const perf_group_t *g, perf_counts_t *c)
+{
+  /* Group: nr, enabled, running, then the values; else value, enabled, running */
+  uint64_t buf[3 + PERF_MAX_EVENTS];
+  int i;
+
+  memset(c, 0, sizeof(*c));
+  if (g->nb == 0)
+    return;
+  if (g->grouped) {
+    if (read(g->fd[0], buf, sizeof(buf)) < (ssize_t)(3 * sizeof(uint64_t)))
+      return;
+    c->enabled = buf[1];
+    c->running = buf[2];
+    for (i = 0; i < g->nb && i < (int)buf[0]; i++)
+      c->val[g->ev[i]] = buf[3 + i];
+    return;
+  }
+  for (i = 0; i < g->nb; i++) {
+    if (read(g->fd[i], buf, 3 * sizeof(uint64_t)) != 3 * sizeof(uint64_t))
+      continue;
+    c->val[g->ev[i]] = buf[0];
+    c->enabled = buf[1];
+    c->running = buf[2];
+  }
+}
+
+void perf_close(perf_group_t *g)
+{
+  int i;
+
+  /* Members last: closing the leader first would orphan them */
+  for (i = g->nb - 1; i >= 0; i--)
+    close(g->fd[i]);
+  g->nb = 0;
+}
+
+/* ################################################################### *
+ * REPORTING
+ * ################################################################### */
+
+void perf_accumulate(perf_counts_t *acc, const perf_counts_t *from, const perf_counts_t *to)
+{
+  int i;
+
+  for (i = 0; i < PERF_MAX_EVENTS; i++)
+    acc->val[i] += to->val[i] - from->val[i];
+  acc->enabled += to->enabled - from->enabled;
+  acc->running += to->running - from->running;
+}
+
+void perf_merge(perf_counts_t *acc, const perf_counts_t *c)
+{
+  int i;
+
+  for (i = 0; i < PERF_MAX_EVENTS; i++)
+    acc->val[i] += c->val[i];
+  acc->enabled += c->enabled;
+  acc->running += c->running;
+  acc->ops += c->ops;
+}
+
+/* Estimated count had the event been on the PMU all the time */
+static double perf_scaled(const perf_counts_t *c, int i)
+{
+  if (c->running == 0 || c->running >= c->enabled)
+    return (double)c->val[i];
+  return (double)c->val[i] * c->enabled / c->running;
+}
+
+void perf_counts_print(const perf_spec_t *spec, int uncore, const perf_counts_t *c,
+                       const char *indent, int width, FILE *f)
+{
+  int i;
+
+  for (i = 0; i < spec->nb; i++) {
+    if (perf_is_uncore(&spec->ev[i]) != uncore)
+      continue;
+    fprintf(f, "%s%-*s: %.0f (%.2f / op)\n", indent, width, spec->ev[i].name,
+            perf_scaled(c, i), c->ops > 0 ? perf_scaled(c, i) / c->ops : 0.0);
+  }
+  if (c->running < c->enabled)
+    fprintf(f, "%s%-*s: %.1f%% of the time, counts scaled\n", indent, width, "multiplexed",
+            c->enabled > 0 ? 100.0 * c->running / c->enabled : 0.0);
+}
+
+void perf_ops_print(const perf_spec_t *spec, const perf_counts_t *c, const char *name, FILE *f)
+{
+  int i;
+
+  fprintf(f, "  %-11s : n=%lu", name, c->ops);
+  for (i = 0; i < spec->nb; i++) {
+    if (!perf_is_uncore(&spec->ev[i]))
+      fprintf(f, " %s=%.1f", spec->ev[i].name,
+              c->ops > 0 ? perf_scaled(c, i) / c->ops : 0.0);
+  }
+  fprintf(f, "\n");
+}
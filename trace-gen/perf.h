@@ -0,0 +1,91 @@
+/*
+ * File:
+ *   perf.h
+ * Description:
+ *   Hardware performance counters (perf_event_open) around the worker loop.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _PERF_H_
+# define _PERF_H_
+
+# include <stdint.h>
+# include <stdio.h>
+
+/* The events of --perf=default */
+# define PERF_DEFAULT                   "cycles,instructions,llc-misses,dtlb-misses"
+
+# define PERF_MAX_EVENTS                8
+/* Ops between two that are counted on their own, by op type */
+# define PERF_OP_PERIOD                 64
+
+typedef struct perf_event {
+  char name[32];
+  uint32_t type;                        /* PERF_TYPE_* or a PMU from sysfs */
+  uint64_t config;
+  int cpu;                              /* Uncore: counted on this CPU, else -1 */
+} perf_event_t;
+
+/* Events asked for: core ones are counted per thread, in one group */
+typedef struct perf_spec {
+  perf_event_t ev[PERF_MAX_EVENTS];
+  int nb;
+} perf_spec_t;
+
+/* Open counters: the core events of a thread, or the uncore ones */
+typedef struct perf_group {
+  int fd[PERF_MAX_EVENTS];
+  int ev[PERF_MAX_EVENTS];              /* Index in the spec, by member */
+  int nb;
+  int grouped;                          /* Read through fd[0] at once */
+} perf_group_t;
+
+typedef struct perf_counts {
+  uint64_t val[PERF_MAX_EVENTS];        /* By event of the spec */
+  uint64_t enabled;                     /* ns; running < enabled if multiplexed */
+  uint64_t running;
+  unsigned long ops;                    /* Ops the counts cover */
+} perf_counts_t;
+
+/*
+ * Comma-separated events: cycles, instructions, llc-loads, llc-misses,
+ * dtlb-misses, node-misses (remote NUMA), branch-misses, raw:<hex> (core PMU), or <pmu>/<hex> for a
+ * PMU from /sys/bus/event_source/devices, e.g. uncore_imc_0/0x304
+ */
+int perf_parse(const char *s, perf_spec_t *spec);
+void perf_print(const perf_spec_t *spec, FILE *f);
+/* Drops, with a warning, the events this system cannot count */
+void perf_init(perf_spec_t *spec);
+static inline int perf_is_uncore(const perf_event_t *e) { return e->cpu >= 0; }
+
+/* Counters start disabled; returns the number opened */
+int perf_open(perf_group_t *g, const perf_spec_t *spec, int uncore);
+void perf_enable(perf_group_t *g);
+void perf_disable(perf_group_t *g);
+void perf_read(const perf_group_t *g, perf_counts_t *c);
+void perf_close(perf_group_t *g);
+
+/* acc += to - from, ops left to the caller */
+void perf_accumulate(perf_counts_t *acc, const perf_counts_t *from, const perf_counts_t *to);
+void perf_merge(perf_counts_t *acc, const perf_counts_t *c);
+/* One "<event> : <count> (<per op> / op)" line per core or uncore event */
+void perf_counts_print(const perf_spec_t *spec, int uncore, const perf_counts_t *c,
+                       const char *indent, int width, FILE *f);
+/* "<name> : n=<ops> <event>=<per op> ..." for the core events */
+void perf_ops_print(const perf_spec_t *spec, const perf_counts_t *c, const char *name, FILE *f);
+
+#endif /* _PERF_H_ */
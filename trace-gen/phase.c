@@ -0,0 +1,152 @@
+/*
+ * File:
+ *   phase.c
+ * Description:
+ *   Multi-phase workload descriptions.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "phase.h"
+
+static void phase_error(const char *path, int line, const char *msg, const char *arg)
+{
+  fprintf(stderr, "%s:%d: %s: %s\n", path, line, msg, arg);
+  exit(1);
+}
+
+static int parse_int(const char *s, int *v)
+{
+  char *end;
+  long l = strtol(s, &end, 10);
+
+  if (end == s || *end != '\0' || l < 0 || l > 0x7fffffff)
+    return -1;
+  *v = (int)l;
+  return 0;
+}
+
+/* "<ops/s>[:poisson]", as for --rate */
+static int parse_rate(const char *s, phase_t *ph)
+{
+  char *end;
+
+  ph->rate = strtod(s, &end);
+  ph->poisson = 0;
+  if (end == s || ph->rate < 0)
+    return -1;
+  if (strcmp(end, ":poisson") == 0)
+    ph->poisson = 1;
+  else if (*end != '\0')
+    return -1;
+  return 0;
+}
+
+static void parse_setting(const char *path, int line, char *tok, phase_t *ph)
+{
+  char *val = strchr(tok, '=');
+  int r;
+
+  if (val == NULL)
+    phase_error(path, line, "expected key=value", tok);
+  *val++ = '\0';
+  if (strcmp(tok, "ops") == 0)
+    r = parse_int(val, &ph->ops);
+  else if (strcmp(tok, "duration") == 0)
+    r = parse_int(val, &ph->duration);
+  else if (strcmp(tok, "update") == 0)
+    r = (parse_int(val, &ph->update) != 0 || ph->update > 100) ? -1 : 0;
+  else if (strcmp(tok, "scan") == 0)
+    r = (parse_int(val, &ph->scan) != 0 || ph->scan > 100) ? -1 : 0;
+  else if (strcmp(tok, "scanlen") == 0)
+    r = len_dist_parse(val, &ph->scan_len);
+  else if (strcmp(tok, "alternate") == 0)
+    r = (parse_int(val, &ph->alternate) != 0 || ph->alternate > 1) ? -1 : 0;
+  else if (strcmp(tok, "range") == 0)
+    r = (parse_int(val, &ph->range) != 0 || ph->range == 0) ? -1 : 0;
+  else if (strcmp(tok, "dist") == 0)
+    r = dist_parse(val, &ph->dist);
+  else if (strcmp(tok, "rate") == 0)
+    r = parse_rate(val, ph);
+  else if (strcmp(tok, "warmup") == 0)
+    r = (parse_int(val, &ph->warmup) != 0 || ph->warmup > 1) ? -1 : 0;
+  else
+    phase_error(path, line, "unknown setting", tok);
+  if (r != 0)
+    phase_error(path, line, "invalid value", val);
+}
+
+int phase_load(const char *path, const phase_t *def, phase_t *phases)
+{
+  char buf[1024], *tok, *save;
+  int line = 0, n = 0;
+  phase_t *ph;
+  FILE *f;
+
+  if ((f = fopen(path, "r")) == NULL) {
+    perror(path);
+    exit(1);
+  }
+  while (fgets(buf, sizeof(buf), f) != NULL) {
+    line++;
+    if ((tok = strchr(buf, '#')) != NULL)
+      *tok = '\0';
+    if ((tok = strtok_r(buf, " \t\r\n", &save)) == NULL)
+      continue;
+    if (n == PHASE_MAX)
+      phase_error(path, line, "too many phases", tok);
+    ph = &phases[n++];
+    *ph = *def;
+    snprintf(ph->name, sizeof(ph->name), "%s", tok);
+    while ((tok = strtok_r(NULL, " \t\r\n", &save)) != NULL)
+      parse_setting(path, line, tok, ph);
+    if (ph->update + ph->scan > 100)
+      phase_error(path, line, "update + scan exceeds 100%", ph->name);
+    /* Zipf constants depend on the range */
+    dist_init(&ph->dist, ph->range);
+  }
+  fclose(f);
+  if (n == 0) {
+    fprintf(stderr, "%s: no phases\n", path);
+    exit(1);
+  }
+
+  return n;
+}
+
+void phase_print(const phase_t *ph, FILE *f)
+{
+  fprintf(f, "%s: ", ph->name);
+  if (ph->duration > 0)
+    fprintf(f, "%d ms", ph->duration);
+  else
+    fprintf(f, "%d ops", ph->ops);
+  fprintf(f, ", update %d%%%s, range %d, ", ph->update,
+          ph->alternate ? " (alternate)" : "", ph->range);
+  dist_print(&ph->dist, f);
+  if (ph->scan > 0) {
+    fprintf(f, ", scan %d%% of ", ph->scan);
+    len_dist_print(&ph->scan_len, f);
+  }
+  if (ph->rate > 0)
+    fprintf(f, ", %g ops/s (%s)", ph->rate, ph->poisson ? "poisson" : "paced");
+  if (ph->warmup)
+    fprintf(f, ", warmup");
+}
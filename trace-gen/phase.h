@@ -0,0 +1,57 @@
+/*
+ * File:
+ *   phase.h
+ * Description:
+ *   Multi-phase workload descriptions.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _PHASE_H_
+# define _PHASE_H_
+
+# include <stdio.h>
+
+# include "dist.h"
+
+# define PHASE_NAME_MAX                 32
+# define PHASE_MAX                      64
+
+/* One phase of a workload: its op mix, keys and length */
+typedef struct phase {
+  char name[PHASE_NAME_MAX];
+  int ops;
+  int duration;                         /* ms; if > 0, ops is ignored */
+  int update;
+  int scan;                             /* Percentage of range scans */
+  len_dist_t scan_len;
+  int alternate;
+  int range;
+  dist_t dist;
+  double rate;                          /* ops/s, 0=closed loop */
+  int poisson;
+  int warmup;                           /* Left out of the histograms */
+} phase_t;
+
+/*
+ * Read a workload file: one phase per line, a name followed by
+ * key=value settings (ops, duration, update, scan, scanlen, alternate,
+ * range, dist, rate, warmup); unset values are taken from def.  Returns the number of phases.
+ */
+int phase_load(const char *path, const phase_t *def, phase_t *phases);
+void phase_print(const phase_t *ph, FILE *f);
+
+#endif /* _PHASE_H_ */
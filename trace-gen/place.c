@@ -0,0 +1,272 @@
+/*
+ * File:
+ *   place.c
+ * Description:
+ *   NUMA-aware thread pinning and memory placement.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "place.h"
+
+/* From <numaif.h>, without linking libnuma */
+#define PLACE_MPOL_BIND                 2
+#define PLACE_MPOL_INTERLEAVE           3
+
+static const char *pin_names[] = { "none", "compact", "scatter", "list" };
+static const char *mem_names[] = { "first-touch", "bind", "interleave" };
+
+/* ################################################################### *
+ * PARSING
+ * ################################################################### */
+
+/* "0-3,8,10-11": returns the number of CPUs, or -1 */
+static int parse_cpulist(const char *s, int *cpus, int max)
+{
+  char *end;
+  long lo, hi;
+  int n = 0;
+
+  while (*s != '\0' && *s != '\n') {
+    lo = hi = strtol(s, &end, 10);
+    if (end == s || lo < 0)
+      return -1;
+    s = end;
+    if (*s == '-') {
+      hi = strtol(s + 1, &end, 10);
+      if (end == s + 1 || hi < lo)
+        return -1;
+      s = end;
+    }
+    for (; lo <= hi; lo++) {
+      if (n == max || lo >= PLACE_MAX_CPUS)
+        return -1;
+      cpus[n++] = (int)lo;
+    }
+    if (*s == ',')
+      s++;
+  }
+
+  return n;
+}
+
+int place_parse_pin(const char *s, place_t *p)
+{
+  int i;
+
+  if (strncmp(s, "list:", 5) == 0) {
+    p->pin = PIN_LIST;
+    p->nb_cpus = parse_cpulist(s + 5, p->cpus, PLACE_MAX_CPUS);
+    return p->nb_cpus > 0 ? 0 : -1;
+  }
+  for (i = 0; i < PIN_LIST; i++) {
+    if (strcmp(s, pin_names[i]) == 0) {
+      p->pin = (pin_kind_t)i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+int place_parse_mem(const char *s, place_t *p)
+{
+  int i;
+
+  for (i = 0; i <= MEM_INTERLEAVE; i++) {
+    if (strcmp(s, mem_names[i]) == 0) {
+      p->mem = (mem_kind_t)i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+const char *place_pin_name(pin_kind_t pin)
+{
+  return pin_names[pin];
+}
+
+const char *place_mem_name(mem_kind_t mem)
+{
+  return mem_names[mem];
+}
+
+/* ################################################################### *
+ * TOPOLOGY
+ * ################################################################### */
+
+/* Fills node_of[] from sysfs; machines without it are a single node */
+static void read_topology(place_t *p)
+{
+  char path[64], line[4096];
+  int cpus[PLACE_MAX_CPUS];
+  int node, i, n;
+  FILE *f;
+
+  for (i = 0; i < PLACE_MAX_CPUS; i++)
+    p->node_of[i] = 0;
+  p->nb_nodes = 1;
+  for (node = 0; node < PLACE_MAX_NODES; node++) {
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    if ((f = fopen(path, "r")) == NULL)
+      continue;
+    if (fgets(line, sizeof(line), f) != NULL &&
+        (n = parse_cpulist(line, cpus, PLACE_MAX_CPUS)) > 0) {
+      for (i = 0; i < n; i++)
+        p->node_of[cpus[i]] = node;
+    }
+    fclose(f);
+    if (node + 1 > p->nb_nodes)
+      p->nb_nodes = node + 1;
+  }
+}
+
+void place_init(place_t *p)
+{
+  cpu_set_t set;
+  int allowed[PLACE_MAX_CPUS];
+  int i, j, k, node, n = 0;
+
+  read_topology(p);
+  if (p->pin == PIN_NONE)
+    return;
+
+  /* CPUs this process may run on, in id order */
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+    perror("sched_getaffinity");
+    exit(1);
+  }
+  if (p->pin == PIN_LIST) {
+    for (i = 0; i < p->nb_cpus; i++) {
+      if (p->cpus[i] >= CPU_SETSIZE || !CPU_ISSET(p->cpus[i], &set)) {
+        fprintf(stderr, "CPU %d is not available\n", p->cpus[i]);
+        exit(1);
+      }
+    }
+    return;
+  }
+  for (i = 0; i < PLACE_MAX_CPUS && i < CPU_SETSIZE; i++) {
+    if (CPU_ISSET(i, &set))
+      allowed[n++] = i;
+  }
+
+  p->nb_cpus = 0;
+  if (p->pin == PIN_COMPACT) {
+    /* Node by node */
+    for (node = 0; node < p->nb_nodes; node++) {
+      for (i = 0; i < n; i++) {
+        if (p->node_of[allowed[i]] == node)
+          p->cpus[p->nb_cpus++] = allowed[i];
+      }
+    }
+  } else {
+    /* The k-th CPU of every node, then the (k+1)-th */
+    for (k = 0; p->nb_cpus < n; k++) {
+      for (node = 0; node < p->nb_nodes; node++) {
+        for (i = 0, j = 0; i < n; i++) {
+          if (p->node_of[allowed[i]] == node && j++ == k) {
+            p->cpus[p->nb_cpus++] = allowed[i];
+            break;
+          }
+        }
+      }
+    }
+  }
+}
+
+void place_print(const place_t *p, FILE *f)
+{
+  int i;
+
+  fprintf(f, "%s", pin_names[p->pin]);
+  if (p->pin != PIN_NONE) {
+    fprintf(f, " (cpus");
+    for (i = 0; i < p->nb_cpus && i < 16; i++)
+      fprintf(f, "%s%d", i == 0 ? " " : ",", p->cpus[i]);
+    fprintf(f, "%s)", p->nb_cpus > 16 ? ",..." : "");
+  }
+  fprintf(f, ", memory %s, %d node%s", mem_names[p->mem], p->nb_nodes,
+          p->nb_nodes > 1 ? "s" : "");
+}
+
+/* ################################################################### *
+ * PLACEMENT
+ * ################################################################### */
+
+int place_cpu(const place_t *p, int tid)
+{
+  if (p->pin == PIN_NONE || p->nb_cpus == 0)
+    return -1;
+  return p->cpus[tid % p->nb_cpus];
+}
+
+int place_node(const place_t *p, int cpu)
+{
+  if (cpu < 0)
+    return -1;
+  return p->node_of[cpu];
+}
+
+void place_attr(const place_t *p, pthread_attr_t *attr, int tid)
+{
+  cpu_set_t set;
+  int cpu = place_cpu(p, tid);
+
+  if (cpu < 0)
+    return;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (pthread_attr_setaffinity_np(attr, sizeof(set), &set) != 0) {
+    fprintf(stderr, "Cannot pin thread %d to cpu %d\n", tid, cpu);
+    exit(1);
+  }
+}
+
+static void place_mbind(void *addr, size_t len, int mode, const unsigned long *mask)
+{
+  if (syscall(SYS_mbind, addr, len, mode, mask, PLACE_MAX_NODES + 1, 0) != 0) {
+    perror("mbind");
+    exit(1);
+  }
+}
+
+void place_bind(void *addr, size_t len, int node)
+{
+  unsigned long mask[PLACE_MAX_NODES / (8 * sizeof(unsigned long))];
+
+  memset(mask, 0, sizeof(mask));
+  mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+  place_mbind(addr, len, PLACE_MPOL_BIND, mask);
+}
+
+void place_interleave(void *addr, size_t len, int nb_nodes)
+{
+  unsigned long mask[PLACE_MAX_NODES / (8 * sizeof(unsigned long))];
+  int node;
+
+  memset(mask, 0, sizeof(mask));
+  for (node = 0; node < nb_nodes; node++)
+    mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+  place_mbind(addr, len, PLACE_MPOL_INTERLEAVE, mask);
+}
@@ -0,0 +1,74 @@
+/*
+ * File:
+ *   place.h
+ * Description:
+ *   NUMA-aware thread pinning and memory placement.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _PLACE_H_
+# define _PLACE_H_
+
+# include <pthread.h>
+# include <stddef.h>
+# include <stdio.h>
+
+# define DEFAULT_PIN                    none
+# define DEFAULT_NUMA_MEM               first-touch
+# define PLACE_MAX_CPUS                 1024
+# define PLACE_MAX_NODES                64
+
+/* Values are stored in binary trace headers: only append */
+typedef enum {
+  PIN_NONE,                             /* Let the scheduler decide */
+  PIN_COMPACT,                          /* Fill one node before the next */
+  PIN_SCATTER,                          /* Round-robin across nodes */
+  PIN_LIST                              /* Explicit CPU list */
+} pin_kind_t;
+
+typedef enum {
+  MEM_FIRST_TOUCH,                      /* Pages go where they are first written */
+  MEM_BIND,                             /* Slabs bound to the allocating thread's node */
+  MEM_INTERLEAVE                        /* Node memory interleaved across all nodes */
+} mem_kind_t;
+
+typedef struct place {
+  pin_kind_t pin;
+  mem_kind_t mem;
+  int nb_cpus;                          /* CPUs threads are placed on, in order */
+  int cpus[PLACE_MAX_CPUS];
+  int nb_nodes;
+  int node_of[PLACE_MAX_CPUS];          /* NUMA node of each CPU */
+} place_t;
+
+int place_parse_pin(const char *s, place_t *p);
+int place_parse_mem(const char *s, place_t *p);
+const char *place_pin_name(pin_kind_t pin);
+const char *place_mem_name(mem_kind_t mem);
+void place_init(place_t *p);
+void place_print(const place_t *p, FILE *f);
+
+/* CPU of thread tid and its node, or -1 if threads are not pinned */
+int place_cpu(const place_t *p, int tid);
+int place_node(const place_t *p, int cpu);
+void place_attr(const place_t *p, pthread_attr_t *attr, int tid);
+
+/* Memory policies for [addr, addr + len), page aligned */
+void place_bind(void *addr, size_t len, int node);
+void place_interleave(void *addr, size_t len, int nb_nodes);
+
+#endif /* _PLACE_H_ */
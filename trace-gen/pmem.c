@@ -0,0 +1,144 @@
+/*
+ * File:
+ *   pmem.c
+ * Description:
+ *   Persistent memory pool on a memory-mapped (DAX) file, with cache line
+ *   write-back and fence instrumentation.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+# include <cpuid.h>
+#endif
+
+#include "alloc.h"
+#include "pmem.h"
+
+#ifndef MAP_SHARED_VALIDATE
+# define MAP_SHARED_VALIDATE            0x03
+#endif
+#ifndef MAP_SYNC
+# define MAP_SYNC                       0x80000
+#endif
+
+int pmem_enabled;
+pmem_flush_t pmem_flush_kind = PMEM_CLFLUSH;
+pmem_root_t *pmem_root;
+__thread pmem_stats_t pmem_stats;
+int pmem_logging;
+pmem_log_t pmem_log;
+
+static int pmem_fd = -1;
+static size_t pmem_size;
+
+static pmem_flush_t detect_flush(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int a, b, c, d;
+
+  if (__get_cpuid_count(7, 0, &a, &b, &c, &d)) {
+    if (b & (1 << 24))
+      return PMEM_CLWB;
+    if (b & (1 << 23))
+      return PMEM_CLFLUSHOPT;
+  }
+#endif
+  return PMEM_CLFLUSH;
+}
+
+const char *pmem_flush_name(void)
+{
+  static const char *names[] = { "clflush", "clflushopt", "clwb" };
+
+  return names[pmem_flush_kind];
+}
+
+void pmem_init(const char *path, size_t size_mb)
+{
+  void *base;
+
+  pmem_size = size_mb << 20;
+  if ((pmem_fd = open(path, O_RDWR | O_CREAT, 0644)) < 0) {
+    perror(path);
+    exit(1);
+  }
+  /* A crash image starts from the same zeroed pool */
+  if ((pmem_logging && ftruncate(pmem_fd, 0) != 0) || ftruncate(pmem_fd, pmem_size) != 0) {
+    perror("ftruncate");
+    exit(1);
+  }
+  /* MAP_SYNC only works on DAX file systems, fall back to a shared mapping */
+  base = mmap(NULL, pmem_size, PROT_READ | PROT_WRITE,
+              MAP_SHARED_VALIDATE | MAP_SYNC, pmem_fd, 0);
+  if (base == MAP_FAILED) {
+    printf("WARNING: %s is not on a DAX file system, stores are not durable\n", path);
+    base = mmap(NULL, pmem_size, PROT_READ | PROT_WRITE, MAP_SHARED, pmem_fd, 0);
+    if (base == MAP_FAILED) {
+      perror("mmap");
+      exit(1);
+    }
+  }
+
+  pmem_flush_kind = detect_flush();
+  pmem_enabled = 1;
+  /* The set is rebuilt on every run: the pool starts empty */
+  pmem_root = (pmem_root_t *)base;
+  pmem_root->magic = PMEM_MAGIC;
+  pmem_root->size = pmem_size;
+  pmem_root->set = NULL;
+  pmem_persist(pmem_root, sizeof(*pmem_root));
+
+  alloc_init_region((char *)base + PMEM_ROOT_SIZE, pmem_size - PMEM_ROOT_SIZE);
+}
+
+/* Single writer: crash checking runs one thread at a time */
+void pmem_log_line(uintptr_t line)
+{
+  pmem_log_rec_t *r;
+
+  if (pmem_log.nb == pmem_log.max) {
+    pmem_log.max = (pmem_log.max == 0) ? 4096 : 2 * pmem_log.max;
+    if ((pmem_log.recs = (pmem_log_rec_t *)realloc(pmem_log.recs,
+                                                   pmem_log.max * sizeof(*r))) == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  r = &pmem_log.recs[pmem_log.nb++];
+  r->off = line - (uintptr_t)pmem_root;
+  r->op = (pmem_log.seq != NULL) ? (int64_t)*pmem_log.seq : -1;
+  r->fence = pmem_log.fences;
+  memcpy(r->line, (const void *)line, PMEM_CACHE_LINE);
+}
+
+void pmem_fini(void)
+{
+  if (!pmem_enabled)
+    return;
+  free(pmem_log.recs);
+  memset(&pmem_log, 0, sizeof(pmem_log));
+  munmap(pmem_root, pmem_size);
+  close(pmem_fd);
+  pmem_root = NULL;
+  pmem_enabled = 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * File:
+ *   pmem.h
+ * Description:
+ *   Persistent memory pool on a memory-mapped (DAX) file, with cache line
+ *   write-back and fence instrumentation.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _PMEM_H_
+# define _PMEM_H_
+
+# include <stddef.h>
+# include <stdint.h>
+
+# define PMEM_MAGIC                     0x4d454d50      /* "PMEM" */
+# define PMEM_CACHE_LINE                64
+/* The root area at the start of the pool; nodes are allocated after it */
+# define PMEM_ROOT_SIZE                 4096
+
+typedef enum {
+  PMEM_CLFLUSH,
+  PMEM_CLFLUSHOPT,
+  PMEM_CLWB
+} pmem_flush_t;
+
+typedef struct pmem_root {
+  uint32_t magic;
+  uint32_t pad;
+  uint64_t size;
+  void *set;                            /* Backend specific root (list head) */
+} pmem_root_t;
+
+typedef struct pmem_stats {
+  unsigned long flushes;                /* Cache lines written back */
+  unsigned long fences;
+} pmem_stats_t;
+
+/* A cache line as written back, in program order (see crash.h) */
+typedef struct pmem_log_rec {
+  uint64_t off;                         /* In the pool */
+  int64_t op;                           /* Sequence number of the op, -1 before any */
+  uint64_t fence;                       /* Fences issued before it */
+  char line[PMEM_CACHE_LINE];
+} pmem_log_rec_t;
+
+typedef struct pmem_log {
+  pmem_log_rec_t *recs;
+  size_t nb;
+  size_t max;
+  uint64_t fences;
+  const uint64_t *seq;                  /* Of the op being run, or NULL */
+} pmem_log_t;
+
+/* Pool contents after a simulated crash, in a copy of the pool */
+typedef struct pmem_image {
+  char *base;
+  uintptr_t addr;                       /* Where the pool itself is mapped */
+  size_t size;
+} pmem_image_t;
+
+extern int pmem_enabled;
+/* Built with make PMEM=0, the flushes and fences of the sets compile away */
+# ifdef SET_NO_PMEM
+#  define PMEM_BUILT                    0
+# else
+#  define PMEM_BUILT                    1
+# endif
+# define pmem_on()                      (PMEM_BUILT && pmem_enabled)
+extern pmem_flush_t pmem_flush_kind;
+extern pmem_root_t *pmem_root;
+extern __thread pmem_stats_t pmem_stats;
+/* Set before pmem_init(): the pool starts zeroed and write-backs are logged */
+extern int pmem_logging;
+extern pmem_log_t pmem_log;
+
+void pmem_init(const char *path, size_t size_mb);
+void pmem_fini(void);
+const char *pmem_flush_name(void);
+void pmem_log_line(uintptr_t line);
+
+/* The backend's root in the image, or 0 if the set was not created yet */
+static inline uintptr_t pmem_image_root(const pmem_image_t *img)
+{
+  const pmem_root_t *root = (const pmem_root_t *)img->base;
+
+  return root->magic == PMEM_MAGIC ? (uintptr_t)root->set : 0;
+}
+
+/* The image's copy of len bytes at pool address p, or NULL if outside the nodes */
+static inline const void *pmem_image_at(const pmem_image_t *img, uintptr_t p, size_t len)
+{
+  if (p < img->addr + PMEM_ROOT_SIZE || p - img->addr > img->size - len)
+    return NULL;
+  return img->base + (p - img->addr);
+}
+
+static inline void pmem_flush(const void *addr, size_t len)
+{
+  uintptr_t p, end;
+
+  if (!pmem_on())
+    return;
+  p = (uintptr_t)addr & ~(uintptr_t)(PMEM_CACHE_LINE - 1);
+  end = (uintptr_t)addr + len;
+  for (; p < end; p += PMEM_CACHE_LINE) {
+# if defined(__x86_64__) || defined(__i386__)
+    switch (pmem_flush_kind) {
+     case PMEM_CLWB:
+       __asm__ __volatile__("clwb %0" : "+m" (*(volatile char *)p));
+       break;
+     case PMEM_CLFLUSHOPT:
+       __asm__ __volatile__("clflushopt %0" : "+m" (*(volatile char *)p));
+       break;
+     default:
+       __asm__ __volatile__("clflush %0" : "+m" (*(volatile char *)p));
+       break;
+    }
+# endif
+    if (pmem_logging)
+      pmem_log_line(p);
+    pmem_stats.flushes++;
+  }
+}
+
+static inline void pmem_fence(void)
+{
+  if (!pmem_on())
+    return;
+# if defined(__x86_64__) || defined(__i386__)
+  __asm__ __volatile__("sfence" ::: "memory");
+# else
+  __sync_synchronize();
+# endif
+  if (pmem_logging)
+    pmem_log.fences++;
+  pmem_stats.fences++;
+}
+
+/* Write back [addr, addr + len) and order it before later stores */
+static inline void pmem_persist(const void *addr, size_t len)
+{
+  pmem_flush(addr, len);
+  pmem_fence();
+}
+
+static inline void pmem_set_root(void *set)
+{
+  if (!pmem_on())
+    return;
+  pmem_root->set = set;
+  pmem_persist(&pmem_root->set, sizeof(pmem_root->set));
+}
+
+#endif /* _PMEM_H_ */
@@ -0,0 +1,116 @@
+/*
+ * File:
+ *   rng.c
+ * Description:
+ *   Pseudo-random generators: erand48 (historical), a 4-lane SIMD
+ *   xoshiro256** filling blocks of values, and PCG32.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <string.h>
+
+#include "rng.h"
+
+/* GCC vector extension: AVX2 when enabled, pairs of SSE2 ops otherwise */
+typedef uint64_t v4u64 __attribute__((vector_size(RNG_LANES * sizeof(uint64_t))));
+
+static const char *names[] = { "erand48", "xoshiro", "pcg" };
+
+int rng_parse(const char *s, rng_kind_t *kind)
+{
+  int i;
+
+  for (i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+    if (strcmp(s, names[i]) == 0) {
+      *kind = (rng_kind_t)i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+const char *rng_name(rng_kind_t kind)
+{
+  return names[kind];
+}
+
+static uint64_t splitmix64(uint64_t *x)
+{
+  uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+/*
+ * All generators are seeded from rand(), so a given --seed always gives
+ * the same streams (erand48 keeps its historical three draws).
+ */
+void rng_init(rng_t *r, rng_kind_t kind)
+{
+  uint64_t sm;
+  int i, j;
+
+  r->kind = kind;
+  r->seed[0] = (unsigned short)rand();
+  r->seed[1] = (unsigned short)rand();
+  r->seed[2] = (unsigned short)rand();
+  if (kind == RNG_ERAND48)
+    return;
+
+  sm = ((uint64_t)r->seed[0] << 32) | ((uint64_t)r->seed[1] << 16) | r->seed[2];
+  sm ^= (uint64_t)rand() << 48;
+  r->pcg_state = 0;
+  r->pcg_inc = (splitmix64(&sm) << 1) | 1;
+  r->pcg_state = splitmix64(&sm) + r->pcg_inc;
+  for (j = 0; j < RNG_LANES; j++) {
+    for (i = 0; i < 4; i++)
+      r->xs[i][j] = splitmix64(&sm);
+  }
+  r->pos = RNG_BATCH;
+}
+
+#define ROTL(x, k)                      (((x) << (k)) | ((x) >> (64 - (k))))
+
+/* One xoshiro256** step on each lane yields 2 x 4 32-bit values */
+void rng_refill(rng_t *r)
+{
+  v4u64 s0, s1, s2, s3, out, t;
+  int i;
+
+  memcpy(&s0, r->xs[0], sizeof(s0));
+  memcpy(&s1, r->xs[1], sizeof(s1));
+  memcpy(&s2, r->xs[2], sizeof(s2));
+  memcpy(&s3, r->xs[3], sizeof(s3));
+  for (i = 0; i < RNG_BATCH; i += 2 * RNG_LANES) {
+    out = ROTL(s1 * 5, 7) * 9;
+    t = s1 << 17;
+    s2 ^= s0;
+    s3 ^= s1;
+    s1 ^= s2;
+    s0 ^= s3;
+    s2 ^= t;
+    s3 = ROTL(s3, 45);
+    memcpy(&r->buf[i], &out, sizeof(out));
+  }
+  memcpy(r->xs[0], &s0, sizeof(s0));
+  memcpy(r->xs[1], &s1, sizeof(s1));
+  memcpy(r->xs[2], &s2, sizeof(s2));
+  memcpy(r->xs[3], &s3, sizeof(s3));
+  r->pos = 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * File:
+ *   rng.h
+ * Description:
+ *   Pseudo-random generators: erand48 (historical), a 4-lane SIMD
+ *   xoshiro256** filling blocks of values, and PCG32.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _RNG_H_
+# define _RNG_H_
+
+# include <assert.h>
+# include <stdint.h>
+# include <stdlib.h>
+
+# define DEFAULT_RNG                    erand48
+
+# define RNG_LANES                      4
+/* 32-bit values produced per xoshiro block */
+# define RNG_BATCH                      256
+
+typedef enum {
+  RNG_ERAND48,
+  RNG_XOSHIRO,
+  RNG_PCG
+} rng_kind_t;
+
+typedef struct rng {
+  rng_kind_t kind;
+  unsigned short seed[3];               /* erand48 */
+  uint64_t pcg_state;                   /* pcg32 */
+  uint64_t pcg_inc;
+  uint64_t xs[4][RNG_LANES];            /* xoshiro256**, word-major */
+  int pos;                              /* Next unused value in buf */
+  uint32_t buf[RNG_BATCH];
+} rng_t;
+
+int rng_parse(const char *s, rng_kind_t *kind);
+const char *rng_name(rng_kind_t kind);
+void rng_init(rng_t *r, rng_kind_t kind);
+void rng_refill(rng_t *r);
+
+static inline uint32_t rng_next32(rng_t *r)
+{
+  uint64_t old;
+  uint32_t x, rot;
+
+  if (r->kind == RNG_XOSHIRO) {
+    if (r->pos == RNG_BATCH)
+      rng_refill(r);
+    return r->buf[r->pos++];
+  }
+  /* pcg32 (XSH RR) */
+  old = r->pcg_state;
+  r->pcg_state = old * 6364136223846793005ULL + r->pcg_inc;
+  x = (uint32_t)(((old >> 18) ^ old) >> 27);
+  rot = (uint32_t)(old >> 59);
+  return (x >> rot) | (x << ((-rot) & 31));
+}
+
+/* Return a random number in [0;1) */
+static inline double rand_double(rng_t *r)
+{
+  if (r->kind == RNG_ERAND48)
+    return erand48(r->seed);
+  return rng_next32(r) * (1.0 / 4294967296.0);
+}
+
+static inline int rand_range(int n, rng_t *r)
+{
+  uint64_t m;
+  uint32_t l, t;
+  int v;
+
+  /* Return a random number in range [0;n) */
+  if (r->kind == RNG_ERAND48) {
+    v = (int)(erand48(r->seed) * n);
+  } else {
+    /* Lemire's nearly divisionless unbiased reduction */
+    m = (uint64_t)rng_next32(r) * (uint32_t)n;
+    l = (uint32_t)m;
+    if (l < (uint32_t)n) {
+      t = -(uint32_t)n % (uint32_t)n;
+      while (l < t) {
+        m = (uint64_t)rng_next32(r) * (uint32_t)n;
+        l = (uint32_t)m;
+      }
+    }
+    v = (int)(m >> 32);
+  }
+  assert (v >= 0 && v < n);
+  return v;
+}
+
+#endif /* _RNG_H_ */
@@ -0,0 +1,464 @@
+/*
+ * File:
+ *   shard.c
+ * Description:
+ *   Sharded integer set: the key range partitioned into per-thread or
+ *   per-node sub-sets, reached directly or by delegation to their owner.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "bulk.h"
+#include "shard.h"
+#include "trace.h"
+
+#define SHARD_IDLE                      0
+#define SHARD_POSTED                    1
+#define SHARD_DONE                      2
+
+_Static_assert(sizeof(shard_req_t) == ALLOC_LINE, "a mailbox slot must fill a cache line");
+
+static const char *part_names[] = { "none", "range", "hash" };
+static const char *unit_names[] = { "thread", "node" };
+static const char *route_names[] = { "direct", "delegate" };
+
+__thread shard_stats_t shard_stats;
+
+/* ################################################################### *
+ * PARSING
+ * ################################################################### */
+
+static int parse_name(const char *s, size_t len, const char **names, int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++) {
+    if (strlen(names[i]) == len && strncmp(s, names[i], len) == 0)
+      return i;
+  }
+  return -1;
+}
+
+int shard_parse(const char *s, shard_cfg_t *cfg)
+{
+  const char *end;
+  size_t len;
+  int i;
+
+  cfg->unit = SHARD_THREAD;
+  cfg->route = SHARD_DIRECT;
+  len = strcspn(s, ":");
+  if ((i = parse_name(s, len, part_names, 3)) < 0)
+    return -1;
+  cfg->part = (shard_part_t)i;
+  /* Unit and route, in any order */
+  for (s += len; *s == ':'; s = end) {
+    s++;
+    end = s + strcspn(s, ":");
+    if ((i = parse_name(s, end - s, unit_names, 2)) >= 0)
+      cfg->unit = (shard_unit_t)i;
+    else if ((i = parse_name(s, end - s, route_names, 2)) >= 0)
+      cfg->route = (shard_route_t)i;
+    else
+      return -1;
+  }
+
+  return 0;
+}
+
+void shard_print(const shard_cfg_t *cfg, FILE *f)
+{
+  fprintf(f, "%s", part_names[cfg->part]);
+  if (cfg->part != SHARD_NONE)
+    fprintf(f, ", per %s, %s", unit_names[cfg->unit], route_names[cfg->route]);
+}
+
+/* ################################################################### *
+ * ROUTING
+ * ################################################################### */
+
+/* Smallest key of a range shard */
+static val_t shard_lo(const shard_set_t *s, int k)
+{
+  return 1 + (val_t)(((uint64_t)k * s->range + s->nb - 1) / s->nb);
+}
+
+static int shard_apply(intset_t *set, uint32_t op, val_t val, int len)
+{
+  switch (op) {
+   case TRACE_OP_ADD:
+     return set_add(set, val);
+   case TRACE_OP_REMOVE:
+     return set_remove(set, val);
+   case TRACE_OP_CONTAINS:
+     return set_contains(set, val);
+   case TRACE_OP_SCAN:
+     return set_scan(set, val, len);
+  }
+  return 0;
+}
+
+void shard_serve_posted(shard_set_t *s, int tid)
+{
+  shard_mbox_t *m = &s->mbox[tid];
+  shard_req_t *r;
+  int i;
+
+  for (i = 0; i < s->nb_threads; i++) {
+    r = &m->reqs[i];
+    if (__atomic_load_n(&r->state, __ATOMIC_ACQUIRE) != SHARD_POSTED)
+      continue;
+    r->res = shard_apply(s->sets[r->shard], r->op, r->val, r->len);
+    __atomic_store_n(&r->state, SHARD_DONE, __ATOMIC_RELEASE);
+    __atomic_sub_fetch(&m->pending, 1, __ATOMIC_RELAXED);
+    shard_stats.served++;
+  }
+}
+
+static void shard_wait(int *spins)
+{
+  if (++*spins % SHARD_SPIN == 0)
+    sched_yield();
+  else
+    __builtin_ia32_pause();
+}
+
+/* Post the op to the owner of shard k and serve ours until it is done */
+static int shard_delegate(shard_set_t *s, int tid, int k, uint32_t op, val_t val, int len)
+{
+  shard_mbox_t *m = &s->mbox[s->owner[k]];
+  shard_req_t *r = &m->reqs[tid];
+  int spins = 0, res;
+
+  r->op = op;
+  r->shard = k;
+  r->val = val;
+  r->len = len;
+  __atomic_store_n(&r->state, SHARD_POSTED, __ATOMIC_RELEASE);
+  __atomic_add_fetch(&m->pending, 1, __ATOMIC_RELEASE);
+  /* Two owners may be waiting on each other */
+  while (__atomic_load_n(&r->state, __ATOMIC_ACQUIRE) != SHARD_DONE) {
+    shard_serve(s, tid);
+    shard_wait(&spins);
+  }
+  res = r->res;
+  r->state = SHARD_IDLE;
+
+  return res;
+}
+
+static int shard_run(shard_set_t *s, int tid, int k, uint32_t op, val_t val, int len)
+{
+  if (s->home[tid] == k) {
+    shard_stats.local++;
+  } else if (s->cfg.route == SHARD_DELEGATE) {
+    shard_stats.delegated++;
+    return shard_delegate(s, tid, k, op, val, len);
+  } else {
+    shard_stats.remote++;
+  }
+  return shard_apply(s->sets[k], op, val, len);
+}
+
+int shard_exec(shard_set_t *s, int tid, uint32_t op, val_t val, int len, int *shard)
+{
+  int k = shard_of(s, val);
+  int n;
+
+  *shard = k;
+  n = shard_run(s, tid, k, op, val, len);
+  /* Range shards are ordered: a scan goes on into the next ones */
+  if (op == TRACE_OP_SCAN) {
+    while (n < len && ++k < s->nb)
+      n += shard_run(s, tid, k, op, shard_lo(s, k), len - n);
+  }
+
+  return n;
+}
+
+void shard_quiesce(shard_set_t *s, int tid, int phase)
+{
+  long target = (long)s->nb_threads * (phase + 1);
+  int spins = 0;
+
+  if (s->cfg.route != SHARD_DELEGATE)
+    return;
+  /* Threads still running may delegate to us until they are done too */
+  __atomic_add_fetch(&s->done, 1, __ATOMIC_SEQ_CST);
+  while (__atomic_load_n(&s->done, __ATOMIC_ACQUIRE) < target) {
+    shard_serve(s, tid);
+    shard_wait(&spins);
+  }
+}
+
+int shard_exclusive(const shard_set_t *s)
+{
+  int i;
+
+  if (s->cfg.route == SHARD_DIRECT)
+    return s->nb_threads == 1;
+  for (i = 0; i < s->nb_threads; i++) {
+    if (s->owner[s->home[i]] != i)
+      return 0;
+  }
+  return 1;
+}
+
+/* ################################################################### *
+ * SET INTERFACE
+ * ################################################################### */
+
+/* The calling thread allocates the nodes of shard k on its node */
+static void shard_bind(const shard_set_t *s, int k)
+{
+  if (s->bind)
+    alloc_thread_node(s->node[k]);
+}
+
+static void shard_delete(intset_t *set)
+{
+  shard_set_t *s = (shard_set_t *)set;
+  int i;
+
+  for (i = 0; i < s->nb; i++)
+    set_delete(s->sets[i]);
+  for (i = 0; i < s->nb_threads; i++)
+    free(s->mbox[i].reqs);
+  free(s->mbox);
+  free(s->home);
+  free(s->node);
+  free(s->owner);
+  free(s->sets);
+  free(s);
+}
+
+static int shard_size(intset_t *set)
+{
+  shard_set_t *s = (shard_set_t *)set;
+  int i, n = 0;
+
+  for (i = 0; i < s->nb; i++)
+    n += set_size(s->sets[i]);
+  return n;
+}
+
+/* Range shards follow each other in key order, hashed ones are sorted */
+static int shard_snapshot(intset_t *set, val_t *vals, int max)
+{
+  shard_set_t *s = (shard_set_t *)set;
+  int i, n = 0;
+
+  for (i = 0; i < s->nb; i++)
+    n += set_snapshot(s->sets[i], vals + n, max - n);
+  if (s->cfg.part == SHARD_HASH)
+    bulk_sort(vals, n);
+  return n;
+}
+
+static int shard_contains(intset_t *set, val_t val)
+{
+  shard_set_t *s = (shard_set_t *)set;
+
+  return set_contains(s->sets[shard_of(s, val)], val);
+}
+
+static int shard_add(intset_t *set, val_t val)
+{
+  shard_set_t *s = (shard_set_t *)set;
+  int k = shard_of(s, val);
+
+  shard_bind(s, k);
+  return set_add(s->sets[k], val);
+}
+
+static int shard_remove(intset_t *set, val_t val)
+{
+  shard_set_t *s = (shard_set_t *)set;
+
+  return set_remove(s->sets[shard_of(s, val)], val);
+}
+
+static int shard_scan(intset_t *set, val_t lo, int len)
+{
+  shard_set_t *s = (shard_set_t *)set;
+  int k = shard_of(s, lo);
+  int n = set_scan(s->sets[k], lo, len);
+
+  while (n < len && ++k < s->nb)
+    n += set_scan(s->sets[k], shard_lo(s, k), len - n);
+  return n;
+}
+
+/* Split the batch by shard, keeping its order, for each shard's own batch */
+static int shard_batch(shard_set_t *s, const set_batch_t *b, int n, int *res,
+                       set_batch_fn_t batch, int (*op)(intset_t *, val_t))
+{
+  set_batch_t *sb;
+  int *start, *pos, i, k, count = 0;
+
+  if ((sb = (set_batch_t *)malloc(n * sizeof(set_batch_t))) == NULL ||
+      (start = (int *)calloc(s->nb + 1, sizeof(int))) == NULL ||
+      (pos = (int *)malloc(s->nb * sizeof(int))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  for (i = 0; i < n; i++)
+    start[shard_of(s, b[i].val) + 1]++;
+  for (k = 0; k < s->nb; k++) {
+    start[k + 1] += start[k];
+    pos[k] = start[k];
+  }
+  for (i = 0; i < n; i++)
+    sb[pos[shard_of(s, b[i].val)]++] = b[i];
+
+  for (k = 0; k < s->nb; k++) {
+    shard_bind(s, k);
+    if (batch != NULL && start[k + 1] - start[k] > 1) {
+      count += batch(s->sets[k], &sb[start[k]], start[k + 1] - start[k], res);
+      continue;
+    }
+    for (i = start[k]; i < start[k + 1]; i++) {
+      res[sb[i].idx] = op(s->sets[k], sb[i].val);
+      count += (res[sb[i].idx] != 0);
+    }
+  }
+  free(pos);
+  free(start);
+  free(sb);
+
+  return count;
+}
+
+static int shard_contains_batch(intset_t *set, const set_batch_t *b, int n, int *res)
+{
+  shard_set_t *s = (shard_set_t *)set;
+
+  return shard_batch(s, b, n, res, s->sub_ops->contains_batch, set_contains);
+}
+
+static int shard_add_batch(intset_t *set, const set_batch_t *b, int n, int *res)
+{
+  shard_set_t *s = (shard_set_t *)set;
+
+  return shard_batch(s, b, n, res, s->sub_ops->add_batch, set_add);
+}
+
+static int shard_remove_batch(intset_t *set, const set_batch_t *b, int n, int *res)
+{
+  shard_set_t *s = (shard_set_t *)set;
+
+  return shard_batch(s, b, n, res, s->sub_ops->remove_batch, set_remove);
+}
+
+/* Sorted values stay sorted within each shard */
+static void shard_load(intset_t *set, const val_t *vals, int n)
+{
+  shard_set_t *s = (shard_set_t *)set;
+  val_t *sv;
+  int i, k, m;
+
+  if ((sv = (val_t *)malloc(n * sizeof(val_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  for (k = 0; k < s->nb; k++) {
+    for (i = m = 0; i < n; i++) {
+      if (shard_of(s, vals[i]) == k)
+        sv[m++] = vals[i];
+    }
+    shard_bind(s, k);
+    set_load(s->sets[k], sv, m);
+  }
+  free(sv);
+}
+
+intset_t *shard_new(const shard_cfg_t *cfg, const set_ops_t *ops, int range,
+                    int nb_threads, const place_t *place)
+{
+  shard_set_t *s;
+  int i, k, node;
+
+  if ((s = (shard_set_t *)calloc(1, sizeof(shard_set_t))) == NULL ||
+      (s->owner = (int *)malloc(nb_threads * sizeof(int))) == NULL ||
+      (s->node = (int *)malloc(nb_threads * sizeof(int))) == NULL ||
+      (s->home = (int *)malloc(nb_threads * sizeof(int))) == NULL ||
+      (s->mbox = (shard_mbox_t *)calloc(nb_threads, sizeof(shard_mbox_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  s->cfg = *cfg;
+  s->sub_ops = ops;
+  s->range = range;
+  s->nb_threads = nb_threads;
+  s->bind = (place->mem == MEM_BIND);
+
+  /* Shards in the order of their first thread, which owns them */
+  for (i = 0; i < nb_threads; i++) {
+    node = place_node(place, place_cpu(place, i));
+    for (k = 0; cfg->unit == SHARD_NODE && k < s->nb && s->node[k] != node; k++)
+      ;
+    if (cfg->unit == SHARD_THREAD || k == s->nb) {
+      k = s->nb++;
+      s->owner[k] = i;
+      s->node[k] = node;
+    }
+    s->home[i] = k;
+  }
+  if (s->nb > TRACE_SHARD_MAX) {
+    fprintf(stderr, "At most %d shards\n", TRACE_SHARD_MAX);
+    exit(1);
+  }
+
+  if ((s->sets = (intset_t **)malloc(s->nb * sizeof(intset_t *))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  for (k = 0; k < s->nb; k++) {
+    shard_bind(s, k);
+    s->sets[k] = set_new(ops);
+  }
+  for (i = 0; i < nb_threads; i++) {
+    if ((s->mbox[i].reqs = (shard_req_t *)calloc(nb_threads, sizeof(shard_req_t))) == NULL) {
+      perror("calloc");
+      exit(1);
+    }
+  }
+
+  /* The sub-sets' properties, with every operation routed */
+  s->ops = *ops;
+  s->ops.new = NULL;
+  s->ops.delete = shard_delete;
+  s->ops.size = shard_size;
+  s->ops.contains = shard_contains;
+  s->ops.add = shard_add;
+  s->ops.remove = shard_remove;
+  s->ops.contains_batch = shard_contains_batch;
+  s->ops.add_batch = shard_add_batch;
+  s->ops.remove_batch = shard_remove_batch;
+  s->ops.load = shard_load;
+  s->ops.scan = (ops->scan != NULL && cfg->part == SHARD_RANGE) ? shard_scan : NULL;
+  /* Lookups are routed one by one (tracegen does not interleave them) */
+  s->ops.contains_interleaved = NULL;
+  s->ops.snapshot = shard_snapshot;
+  s->set.ops = &s->ops;
+
+  return &s->set;
+}
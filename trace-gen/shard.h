@@ -0,0 +1,144 @@
+/*
+ * File:
+ *   shard.h
+ * Description:
+ *   Sharded integer set: the key range partitioned into per-thread or
+ *   per-node sub-sets, reached directly or by delegation to their owner.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _SHARD_H_
+# define _SHARD_H_
+
+# include <stdint.h>
+# include <stdio.h>
+
+# include "intset.h"
+# include "place.h"
+
+# define DEFAULT_SHARD                  none
+/* Polls of a delegated op's slot between two yields */
+# define SHARD_SPIN                     64
+
+typedef enum {
+  SHARD_NONE,                           /* One set shared by all threads */
+  SHARD_RANGE,                          /* Contiguous key ranges */
+  SHARD_HASH                            /* Keys spread by a hash */
+} shard_part_t;
+
+typedef enum {
+  SHARD_THREAD,                         /* One shard per thread */
+  SHARD_NODE                            /* One per NUMA node of the threads */
+} shard_unit_t;
+
+typedef enum {
+  SHARD_DIRECT,                         /* Threads reach every shard themselves */
+  SHARD_DELEGATE                        /* Other shards' ops run on their owner */
+} shard_route_t;
+
+typedef struct shard_cfg {
+  shard_part_t part;
+  shard_unit_t unit;
+  shard_route_t route;
+} shard_cfg_t;
+
+/* Slot of one sender in an owner's mailbox */
+typedef struct shard_req {
+  volatile int state;                   /* Idle, posted, then done */
+  uint32_t op;                          /* TRACE_OP_* */
+  int shard;
+  int len;
+  val_t val;
+  int res;
+  char pad[44 - sizeof(val_t)];
+} shard_req_t;
+
+typedef struct shard_mbox {
+  shard_req_t *reqs;                    /* By sender thread */
+  char pad1[56];
+  volatile int pending;                 /* Posted, not yet served */
+  char pad2[60];
+} shard_mbox_t;
+
+typedef struct shard_set {
+  intset_t set;                         /* ops points to the copy below */
+  set_ops_t ops;                        /* The sub-sets' ops, routed */
+  const set_ops_t *sub_ops;
+  shard_cfg_t cfg;
+  int nb;
+  int range;
+  intset_t **sets;
+  int *owner;                           /* Thread serving each shard */
+  int *node;                            /* NUMA node of each shard, or -1 */
+  int bind;                             /* Sub-sets allocate on their node */
+  int nb_threads;
+  int *home;                            /* Shard of each thread */
+  shard_mbox_t *mbox;                   /* By owner thread */
+  volatile long done;                   /* Threads past each phase, cumulated */
+} shard_set_t;
+
+/* Per-thread counters, read once the thread is done */
+typedef struct shard_stats {
+  unsigned long local;                  /* Ops on the thread's own shard */
+  unsigned long remote;                 /* Ops run directly on another shard */
+  unsigned long delegated;              /* Ops sent to another shard's owner */
+  unsigned long served;                 /* Ops run for another thread */
+} shard_stats_t;
+
+extern __thread shard_stats_t shard_stats;
+
+/* "<range|hash>[:thread|node][:direct|delegate]", or "none" */
+int shard_parse(const char *s, shard_cfg_t *cfg);
+void shard_print(const shard_cfg_t *cfg, FILE *f);
+
+/* Keys in [1, range]; returns the set, an intset_t for populating */
+intset_t *shard_new(const shard_cfg_t *cfg, const set_ops_t *ops, int range,
+                    int nb_threads, const place_t *place);
+/* Every shard is only ever reached by one thread */
+int shard_exclusive(const shard_set_t *s);
+
+/* One TRACE_OP_* op of thread tid; *shard is the shard that served it */
+int shard_exec(shard_set_t *s, int tid, uint32_t op, val_t val, int len, int *shard);
+void shard_serve_posted(shard_set_t *s, int tid);
+/* Serve until every thread is done with the phase */
+void shard_quiesce(shard_set_t *s, int tid, int phase);
+
+static inline int shard_of(const shard_set_t *s, val_t val)
+{
+  uint32_t h;
+
+  if (s->cfg.part == SHARD_RANGE) {
+    if (val <= 1)
+      return 0;
+    if (val >= s->range)
+      return s->nb - 1;
+    return (int)((uint64_t)(val - 1) * s->nb / s->range);
+  }
+  /* Fibonacci hashing, then scaled to [0, nb) */
+  h = (uint32_t)val * 2654435761U;
+  return (int)(((uint64_t)h * s->nb) >> 32);
+}
+
+/* Cheap enough to call once per op */
+static inline void shard_serve(shard_set_t *s, int tid)
+{
+  if (s->cfg.route == SHARD_DELEGATE &&
+      __atomic_load_n(&s->mbox[tid].pending, __ATOMIC_ACQUIRE) > 0)
+    shard_serve_posted(s, tid);
+}
+
+#endif /* _SHARD_H_ */
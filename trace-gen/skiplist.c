@@ -0,0 +1,401 @@
+/*
+ * File:
+ *   skiplist.c
+ * Description:
+ *   Skip list set (Pugh), O(log n) expected per operation.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "alloc.h"
+#include "intset.h"
+#include "memtrace.h"
+
+#define SKIP_MAX_LEVEL                  32
+#define SNODE_SIZE(level)               (sizeof(snode_t) + (level) * sizeof(snode_t *))
+
+/* ################################################################### *
+ * SKIP LIST
+ * ################################################################### */
+
+typedef struct snode {
+  val_t val;
+  int level;
+  struct snode *next[];
+} snode_t;
+
+typedef struct skiplist {
+  intset_t base;
+  snode_t *head;
+  int level;                            /* Highest level in use */
+  uint64_t rng;                         /* xorshift state for node levels */
+} skiplist_t;
+
+static snode_t *new_snode(val_t val, int level)
+{
+  snode_t *node;
+
+  node = (snode_t *)node_alloc(SNODE_SIZE(level));
+  MT_ST(node->val, val);
+  node->level = level;
+
+  return node;
+}
+
+/* Geometric level distribution with p = 1/4 */
+static int random_level(skiplist_t *set)
+{
+  uint64_t x = set->rng;
+  int level = 1;
+
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  set->rng = x;
+  while (level < SKIP_MAX_LEVEL && (x & 3) == 0) {
+    level++;
+    x >>= 2;
+  }
+
+  return level;
+}
+
+static intset_t *skiplist_new()
+{
+  skiplist_t *set;
+  snode_t *max;
+  int i;
+
+  if ((set = (skiplist_t *)malloc(sizeof(skiplist_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  max = new_snode(VAL_MAX, SKIP_MAX_LEVEL);
+  set->head = new_snode(VAL_MIN, SKIP_MAX_LEVEL);
+  for (i = 0; i < SKIP_MAX_LEVEL; i++) {
+    max->next[i] = NULL;
+    set->head->next[i] = max;
+  }
+  set->level = 1;
+  set->rng = 0x9e3779b97f4a7c15ULL;
+
+  return &set->base;
+}
+
+static void skiplist_delete(intset_t *s)
+{
+  skiplist_t *set = (skiplist_t *)s;
+  snode_t *node, *next;
+
+  for (node = set->head; node != NULL; node = next) {
+    next = node->next[0];
+    node_free(node, SNODE_SIZE(node->level));
+  }
+  free(set);
+}
+
+static int skiplist_size(intset_t *s)
+{
+  skiplist_t *set = (skiplist_t *)s;
+  int size = 0;
+  snode_t *node;
+
+  node = set->head->next[0];
+  while (node->next[0] != NULL) {
+    size++;
+    node = node->next[0];
+  }
+
+  return size;
+}
+
+static int skiplist_snapshot(intset_t *s, val_t *vals, int max)
+{
+  skiplist_t *set = (skiplist_t *)s;
+  int n = 0;
+  snode_t *node;
+
+  for (node = set->head->next[0]; node->next[0] != NULL && n < max; node = node->next[0])
+    vals[n++] = node->val;
+
+  return n;
+}
+
+/* Fills prev[] with the last node < val at every level in use */
+static snode_t *skiplist_walk(skiplist_t *set, val_t val, snode_t **prev)
+{
+  snode_t *p, *n = NULL;
+  int i;
+
+  p = set->head;
+  for (i = set->level - 1; i >= 0; i--) {
+    n = MT_LD(p->next[i]);
+    while (MT_LD(n->val) < val) {
+      p = n;
+      n = MT_LD(p->next[i]);
+    }
+    prev[i] = p;
+  }
+
+  return n;
+}
+
+static int skiplist_contains(intset_t *s, val_t val)
+{
+  snode_t *prev[SKIP_MAX_LEVEL];
+
+  return skiplist_walk((skiplist_t *)s, val, prev)->val == val;
+}
+
+static int skiplist_add(intset_t *s, val_t val)
+{
+  skiplist_t *set = (skiplist_t *)s;
+  snode_t *prev[SKIP_MAX_LEVEL], *next, *node;
+  int i, level;
+
+  next = skiplist_walk(set, val, prev);
+  if (next->val == val)
+    return 0;
+  level = random_level(set);
+  for (i = set->level; i < level; i++)
+    prev[i] = set->head;
+  if (level > set->level)
+    set->level = level;
+  node = new_snode(val, level);
+  for (i = 0; i < level; i++) {
+    MT_ST(node->next[i], prev[i]->next[i]);
+    MT_ST(prev[i]->next[i], node);
+  }
+
+  return 1;
+}
+
+static int skiplist_remove(intset_t *s, val_t val)
+{
+  skiplist_t *set = (skiplist_t *)s;
+  snode_t *prev[SKIP_MAX_LEVEL], *next;
+  int i;
+
+  next = skiplist_walk(set, val, prev);
+  if (next->val != val)
+    return 0;
+  for (i = 0; i < next->level; i++)
+    MT_ST(prev[i]->next[i], MT_LD(next->next[i]));
+  node_free(next, SNODE_SIZE(next->level));
+
+  return 1;
+}
+
+/*
+ * Finger search for sorted batches: prev[] still holds nodes below the
+ * next value, so each level resumes from the later of prev[i] and the
+ * node reached on the level above.
+ */
+static snode_t *skiplist_walk_from(skiplist_t *set, val_t val, snode_t **prev)
+{
+  snode_t *p, *n = NULL;
+  int i;
+
+  p = set->head;
+  for (i = set->level - 1; i >= 0; i--) {
+    if (prev[i]->val > p->val)
+      p = prev[i];
+    n = MT_LD(p->next[i]);
+    while (MT_LD(n->val) < val) {
+      p = n;
+      n = MT_LD(p->next[i]);
+    }
+    prev[i] = p;
+  }
+
+  return n;
+}
+
+static void skiplist_batch_init(skiplist_t *set, snode_t **prev)
+{
+  int i;
+
+  for (i = 0; i < SKIP_MAX_LEVEL; i++)
+    prev[i] = set->head;
+}
+
+static int skiplist_contains_batch(intset_t *s, const set_batch_t *b, int n, int *res)
+{
+  skiplist_t *set = (skiplist_t *)s;
+  snode_t *prev[SKIP_MAX_LEVEL];
+  int i, count = 0;
+
+  skiplist_batch_init(set, prev);
+  for (i = 0; i < n; i++) {
+    res[b[i].idx] = (skiplist_walk_from(set, b[i].val, prev)->val == b[i].val);
+    count += res[b[i].idx];
+  }
+
+  return count;
+}
+
+static int skiplist_add_batch(intset_t *s, const set_batch_t *b, int n, int *res)
+{
+  skiplist_t *set = (skiplist_t *)s;
+  snode_t *prev[SKIP_MAX_LEVEL], *next, *node;
+  int i, j, level, count = 0;
+
+  skiplist_batch_init(set, prev);
+  for (i = 0; i < n; i++) {
+    next = skiplist_walk_from(set, b[i].val, prev);
+    res[b[i].idx] = (next->val != b[i].val);
+    if (!res[b[i].idx])
+      continue;
+    /* Levels above set->level still point at the head */
+    level = random_level(set);
+    if (level > set->level)
+      set->level = level;
+    node = new_snode(b[i].val, level);
+    for (j = 0; j < level; j++) {
+      MT_ST(node->next[j], prev[j]->next[j]);
+      MT_ST(prev[j]->next[j], node);
+    }
+    count++;
+  }
+
+  return count;
+}
+
+static int skiplist_remove_batch(intset_t *s, const set_batch_t *b, int n, int *res)
+{
+  skiplist_t *set = (skiplist_t *)s;
+  snode_t *prev[SKIP_MAX_LEVEL], *next;
+  int i, j, count = 0;
+
+  skiplist_batch_init(set, prev);
+  for (i = 0; i < n; i++) {
+    next = skiplist_walk_from(set, b[i].val, prev);
+    res[b[i].idx] = (next->val == b[i].val);
+    if (!res[b[i].idx])
+      continue;
+    for (j = 0; j < next->level; j++)
+      MT_ST(prev[j]->next[j], MT_LD(next->next[j]));
+    node_free(next, SNODE_SIZE(next->level));
+    count++;
+  }
+
+  return count;
+}
+
+/* Links sorted nodes level by level, keeping the last node of each */
+static void skiplist_load(intset_t *s, const val_t *vals, int n)
+{
+  skiplist_t *set = (skiplist_t *)s;
+  snode_t *last[SKIP_MAX_LEVEL], *max, *node;
+  int i, j, level;
+
+  max = set->head->next[0];
+  for (j = 0; j < SKIP_MAX_LEVEL; j++)
+    last[j] = set->head;
+  for (i = 0; i < n; i++) {
+    level = random_level(set);
+    if (level > set->level)
+      set->level = level;
+    node = new_snode(vals[i], level);
+    for (j = 0; j < level; j++) {
+      MT_ST(last[j]->next[j], node);
+      last[j] = node;
+    }
+  }
+  for (j = 0; j < set->level; j++)
+    MT_ST(last[j]->next[j], max);
+}
+
+/*
+ * Level-1 links are jump pointers: from each node that has one, the node
+ * about four keys ahead is prefetched while the keys in between are
+ * visited.
+ */
+static int skiplist_scan(intset_t *s, val_t lo, int len)
+{
+  snode_t *prev[SKIP_MAX_LEVEL], *node;
+  int n;
+
+  node = skiplist_walk((skiplist_t *)s, lo, prev);
+  for (n = 0; n < len && MT_LD(node->val) != VAL_MAX; n++) {
+    if (node->level > 1)
+      __builtin_prefetch(node->next[1]);
+    node = MT_LD(node->next[0]);
+  }
+
+  return n;
+}
+
+/*
+ * Interleaved walks, as in the list: a walk's state is the node it is at,
+ * its level and the prefetched node it compares with next.
+ */
+static int skiplist_contains_interleaved(intset_t *s, const val_t *vals, int n, int *res,
+                                         int width)
+{
+  skiplist_t *set = (skiplist_t *)s;
+  snode_t *at[SET_INTERLEAVE_MAX], *next[SET_INTERLEAVE_MAX];
+  int idx[SET_INTERLEAVE_MAX], level[SET_INTERLEAVE_MAX];
+  int k, active, issued, count = 0;
+
+  for (active = 0; active < width && active < n; active++) {
+    idx[active] = active;
+    at[active] = set->head;
+    level[active] = set->level - 1;
+    next[active] = MT_LD(set->head->next[level[active]]);
+    __builtin_prefetch(next[active]);
+  }
+  issued = active;
+  for (k = 0; active > 0; k = (k + 1 < active) ? k + 1 : 0) {
+    if (MT_LD(next[k]->val) < vals[idx[k]]) {
+      at[k] = next[k];
+    } else if (level[k] > 0) {
+      level[k]--;
+    } else {
+      res[idx[k]] = (next[k]->val == vals[idx[k]]);
+      count += res[idx[k]];
+      if (issued < n) {
+        idx[k] = issued++;
+        at[k] = set->head;
+        level[k] = set->level - 1;
+      } else {
+        active--;
+        idx[k] = idx[active];
+        at[k] = at[active];
+        level[k] = level[active];
+        next[k] = next[active];
+        k--;
+        continue;
+      }
+    }
+    next[k] = MT_LD(at[k]->next[level[k]]);
+    __builtin_prefetch(next[k]);
+  }
+
+  return count;
+}
+
+const set_ops_t set_skiplist_ops = {
+  "skiplist", "Skip list, no synchronization (single thread only)", 0,
+  skiplist_new, skiplist_delete, skiplist_size,
+  skiplist_contains, skiplist_add, skiplist_remove, 0,
+  1, skiplist_contains_batch, skiplist_add_batch, skiplist_remove_batch,
+  skiplist_load, skiplist_scan, 0, skiplist_contains_interleaved, NULL,
+  skiplist_snapshot
+};
@@ -0,0 +1,100 @@
+/*
+ * File:
+ *   stats.c
+ * Description:
+ *   Cheap timestamps and log-linear (HDR-style) latency histograms.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include "stats.h"
+
+#define CALIBRATION_NS                  20000000
+
+double stats_ns_per_tick = 1.0;
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Calibrate the TSC against CLOCK_MONOTONIC */
+void stats_init(void)
+{
+  struct timespec ts = { 0, CALIBRATION_NS };
+  uint64_t t0, t1, c0, c1;
+
+  t0 = now_ns();
+  c0 = stats_ticks();
+  nanosleep(&ts, NULL);
+  t1 = now_ns();
+  c1 = stats_ticks();
+  if (c1 > c0)
+    stats_ns_per_tick = (double)(t1 - t0) / (c1 - c0);
+}
+
+void hist_merge(hist_t *dst, const hist_t *src)
+{
+  int i;
+
+  for (i = 0; i < HIST_BUCKETS; i++)
+    dst->buckets[i] += src->buckets[i];
+  dst->count += src->count;
+  dst->sum += src->sum;
+  if (src->max > dst->max)
+    dst->max = src->max;
+}
+
+/* Upper bound of the bucket holding the p-th percentile */
+uint64_t hist_percentile(const hist_t *h, double p)
+{
+  uint64_t rank, seen = 0;
+  int i, e;
+
+  if (h->count == 0)
+    return 0;
+  rank = (uint64_t)(p / 100.0 * h->count);
+  if (rank >= h->count)
+    rank = h->count - 1;
+  for (i = 0; i < HIST_BUCKETS; i++) {
+    seen += h->buckets[i];
+    if (seen > rank)
+      break;
+  }
+  if (i < HIST_SUB)
+    return i;
+  e = (i >> HIST_SUB_BITS) - 1;
+  return (((uint64_t)(HIST_SUB | (i & (HIST_SUB - 1))) + 1) << e) - 1;
+}
+
+void hist_print(const hist_t *h, const char *name, FILE *f)
+{
+  hist_print_unit(h, name, "ns", f);
+}
+
+void hist_print_unit(const hist_t *h, const char *name, const char *unit, FILE *f)
+{
+  fprintf(f, "  %-11s : n=%llu mean=%.0f p50=%llu p99=%llu p99.9=%llu max=%llu (%s)\n",
+          name, (unsigned long long)h->count,
+          h->count > 0 ? (double)h->sum / h->count : 0.0,
+          (unsigned long long)hist_percentile(h, 50.0),
+          (unsigned long long)hist_percentile(h, 99.0),
+          (unsigned long long)hist_percentile(h, 99.9),
+          (unsigned long long)h->max, unit);
+}
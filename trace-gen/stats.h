@@ -0,0 +1,87 @@
+/*
+ * File:
+ *   stats.h
+ * Description:
+ *   Cheap timestamps and log-linear (HDR-style) latency histograms.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _STATS_H_
+# define _STATS_H_
+
+# include <stdint.h>
+# include <stdio.h>
+# include <time.h>
+
+/*
+ * Values below 2^HIST_SUB_BITS get one bucket each; above, every power
+ * of two is split into 2^HIST_SUB_BITS buckets (relative error < 3%).
+ */
+# define HIST_SUB_BITS                  5
+# define HIST_SUB                       (1 << HIST_SUB_BITS)
+# define HIST_BUCKETS                   ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+/* Owned by one thread while running, merged once it is done */
+typedef struct hist {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  uint64_t buckets[HIST_BUCKETS];
+} hist_t;
+
+extern double stats_ns_per_tick;
+
+void stats_init(void);
+void hist_merge(hist_t *dst, const hist_t *src);
+uint64_t hist_percentile(const hist_t *h, double p);
+void hist_print(const hist_t *h, const char *name, FILE *f);
+void hist_print_unit(const hist_t *h, const char *name, const char *unit, FILE *f);
+
+/* Raw timestamp: TSC where available, convert with stats_ns_per_tick */
+static inline uint64_t stats_ticks(void)
+{
+# if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+# else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+# endif
+}
+
+static inline int hist_index(uint64_t v)
+{
+  int msb;
+
+  if (v < HIST_SUB)
+    return (int)v;
+  msb = 63 - __builtin_clzll(v);
+  return ((msb - HIST_SUB_BITS + 1) << HIST_SUB_BITS) |
+         (int)((v >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+static inline void hist_record(hist_t *h, uint64_t ns)
+{
+  h->buckets[hist_index(ns)]++;
+  h->count++;
+  h->sum += ns;
+  if (ns > h->max)
+    h->max = ns;
+}
+
+#endif /* _STATS_H_ */
@@ -0,0 +1,404 @@
+/*
+ * File:
+ *   tm.c
+ * Description:
+ *   Transactional execution of set operations: a word-based STM, or
+ *   Intel RTM with a global lock fallback.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+# include <cpuid.h>
+#endif
+
+#include "tm.h"
+
+#define TM_LOCKS                        (1 << TM_LOCK_BITS)
+#define TM_LOCK_OF(a)                   (&tm_locks[((uintptr_t)(a) >> TM_STRIPE_BITS) & (TM_LOCKS - 1)])
+/* A lock word is a version << 1, or the owner's descriptor | 1 */
+#define TM_LOCKED(l)                    ((l) & 1)
+#define TM_VERSION(l)                   ((l) >> 1)
+#define TM_OWNER(tx)                    ((uintptr_t)(tx) | 1)
+
+tm_kind_t tm_kind = TM_STM;
+__thread tm_tx_t tm_tx;
+__thread tm_stats_t tm_stats;
+
+static volatile uintptr_t tm_locks[TM_LOCKS];
+static volatile uintptr_t tm_clock;
+static volatile int tm_fallback_lock;
+
+int tm_parse(const char *s, tm_kind_t *kind)
+{
+  if (strcmp(s, "stm") == 0)
+    *kind = TM_STM;
+  else if (strcmp(s, "htm") == 0)
+    *kind = TM_HTM;
+  else
+    return -1;
+  return 0;
+}
+
+const char *tm_name(tm_kind_t kind)
+{
+  return kind == TM_HTM ? "htm (rtm, lock fallback)" : "stm (word-based, lazy)";
+}
+
+static int rtm_supported(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int a, b, c, d;
+
+  if (__get_cpuid_count(7, 0, &a, &b, &c, &d))
+    return (b & (1 << 11)) != 0;
+#endif
+  return 0;
+}
+
+void tm_init(tm_kind_t kind)
+{
+  if (kind == TM_HTM && !rtm_supported()) {
+    fprintf(stderr, "RTM is not supported by this CPU\n");
+    exit(1);
+  }
+  tm_kind = kind;
+}
+
+void tm_thread_fini(void)
+{
+  free(tm_tx.r);
+  free(tm_tx.w);
+  free(tm_tx.alloc);
+  free(tm_tx.free);
+  memset(&tm_tx, 0, sizeof(tm_tx));
+}
+
+/* Make room for one more element in a per-thread log */
+static void *log_grow(void *log, int len, int *size, size_t elem)
+{
+  if (len < *size)
+    return log;
+  *size = (*size == 0) ? 64 : 2 * *size;
+  if ((log = realloc(log, *size * elem)) == NULL) {
+    perror("realloc");
+    exit(1);
+  }
+  return log;
+}
+
+static void backoff(tm_tx_t *tx)
+{
+  unsigned long spins, max;
+
+  max = (tx->retries < 10) ? (2UL << tx->retries) : TM_BACKOFF_MAX;
+  if (max > TM_BACKOFF_MAX)
+    max = TM_BACKOFF_MAX;
+  /* xorshift */
+  tx->seed ^= tx->seed << 13;
+  tx->seed ^= tx->seed >> 7;
+  tx->seed ^= tx->seed << 17;
+  for (spins = tx->seed % max; spins > 0; spins--)
+    __builtin_ia32_pause();
+  if (tx->retries > 16)
+    sched_yield();
+}
+
+/* ################################################################### *
+ * STM
+ * ################################################################### */
+
+/*
+ * Writes are buffered in a redo log and their locks acquired at commit.
+ * Reads are checked against a global version clock; a read newer than
+ * the snapshot extends it when every earlier read is still valid, so
+ * read-only transactions never abort on unrelated commits.
+ */
+
+static void stm_abort(tm_tx_t *tx)
+{
+  int i;
+
+  for (i = 0; i < tx->w_len; i++) {
+    if (tx->w[i].acquired)
+      __atomic_store_n(tx->w[i].lock, tx->w[i].version, __ATOMIC_RELEASE);
+  }
+  for (i = 0; i < tx->alloc_len; i++)
+    node_free(tx->alloc[i].p, tx->alloc[i].size);
+  tm_stats.aborts++;
+  tx->retries++;
+  backoff(tx);
+  longjmp(tx->env, 1);
+}
+
+/* Version of a lock we own, as it was before we acquired it */
+static uintptr_t owned_version(tm_tx_t *tx, volatile uintptr_t *lock)
+{
+  int i;
+
+  for (i = 0; i < tx->w_len; i++) {
+    if (tx->w[i].lock == lock && tx->w[i].acquired)
+      return tx->w[i].version;
+  }
+  return 0;
+}
+
+/* Every word read so far is unchanged since the snapshot */
+static int stm_validate(tm_tx_t *tx)
+{
+  uintptr_t l;
+  int i;
+
+  for (i = 0; i < tx->r_len; i++) {
+    l = __atomic_load_n(tx->r[i], __ATOMIC_ACQUIRE);
+    if (TM_LOCKED(l)) {
+      if (l != TM_OWNER(tx) || TM_VERSION(owned_version(tx, tx->r[i])) > tx->rv)
+        return 0;
+    } else if (TM_VERSION(l) > tx->rv) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int stm_extend(tm_tx_t *tx)
+{
+  uintptr_t now = __atomic_load_n(&tm_clock, __ATOMIC_ACQUIRE);
+
+  if (!stm_validate(tx))
+    return 0;
+  tx->rv = now;
+  return 1;
+}
+
+void tm_stm_begin(tm_tx_t *tx)
+{
+  if (tx->seed == 0)
+    tx->seed = (unsigned long)(uintptr_t)tx | 1;
+  tx->r_len = tx->w_len = 0;
+  tx->alloc_len = tx->free_len = 0;
+  tx->rv = __atomic_load_n(&tm_clock, __ATOMIC_ACQUIRE);
+}
+
+uintptr_t tm_stm_load(tm_tx_t *tx, volatile uintptr_t *addr)
+{
+  volatile uintptr_t *lock = TM_LOCK_OF(addr);
+  uintptr_t l1, l2, val;
+  int i;
+
+  /* Read after write: the redo log has the value */
+  for (i = tx->w_len - 1; i >= 0; i--) {
+    if (tx->w[i].addr == addr)
+      return tx->w[i].val;
+  }
+  while (1) {
+    l1 = __atomic_load_n(lock, __ATOMIC_ACQUIRE);
+    if (TM_LOCKED(l1))
+      stm_abort(tx);
+    val = __atomic_load_n(addr, __ATOMIC_ACQUIRE);
+    l2 = __atomic_load_n(lock, __ATOMIC_ACQUIRE);
+    if (l1 == l2)
+      break;
+  }
+  if (TM_VERSION(l1) > tx->rv && !stm_extend(tx))
+    stm_abort(tx);
+  tx->r = log_grow(tx->r, tx->r_len, &tx->r_size, sizeof(*tx->r));
+  tx->r[tx->r_len++] = lock;
+
+  return val;
+}
+
+void tm_stm_store(tm_tx_t *tx, volatile uintptr_t *addr, uintptr_t val)
+{
+  tm_w_entry_t *e;
+  int i;
+
+  for (i = tx->w_len - 1; i >= 0; i--) {
+    if (tx->w[i].addr == addr) {
+      tx->w[i].val = val;
+      return;
+    }
+  }
+  tx->w = log_grow(tx->w, tx->w_len, &tx->w_size, sizeof(*tx->w));
+  e = &tx->w[tx->w_len++];
+  e->addr = addr;
+  e->val = val;
+  e->lock = TM_LOCK_OF(addr);
+  e->version = 0;
+  e->acquired = 0;
+}
+
+void *tm_stm_alloc(tm_tx_t *tx, size_t size)
+{
+  void *p = node_alloc(size);
+
+  tx->alloc = log_grow(tx->alloc, tx->alloc_len, &tx->alloc_size, sizeof(*tx->alloc));
+  tx->alloc[tx->alloc_len].p = p;
+  tx->alloc[tx->alloc_len].size = size;
+  tx->alloc_len++;
+  return p;
+}
+
+/*
+ * The words of the block are rewritten with their own values, so that
+ * the commit bumps their versions: a concurrent transaction that still
+ * reaches the block aborts instead of reading it once it is reused.
+ */
+void tm_stm_free(tm_tx_t *tx, void *p, size_t size)
+{
+  volatile uintptr_t *w = (volatile uintptr_t *)p;
+  size_t i;
+
+  for (i = 0; i < size / sizeof(uintptr_t); i++)
+    tm_stm_store(tx, &w[i], tm_stm_load(tx, &w[i]));
+  tx->free = log_grow(tx->free, tx->free_len, &tx->free_size, sizeof(*tx->free));
+  tx->free[tx->free_len].p = p;
+  tx->free[tx->free_len].size = size;
+  tx->free_len++;
+}
+
+void tm_stm_commit(tm_tx_t *tx)
+{
+  tm_w_entry_t *e;
+  uintptr_t l, wv;
+  int i;
+
+  if (tx->w_len > 0) {
+    for (i = 0; i < tx->w_len; i++) {
+      e = &tx->w[i];
+      l = __atomic_load_n(e->lock, __ATOMIC_ACQUIRE);
+      if (l == TM_OWNER(tx))
+        continue;
+      if (TM_LOCKED(l) ||
+          !__atomic_compare_exchange_n(e->lock, &l, TM_OWNER(tx), 0,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        stm_abort(tx);
+      e->version = l;
+      e->acquired = 1;
+    }
+    wv = __atomic_add_fetch(&tm_clock, 1, __ATOMIC_ACQ_REL);
+    /* Nobody committed since the snapshot: the reads are still valid */
+    if (wv != tx->rv + 1 && !stm_validate(tx))
+      stm_abort(tx);
+    for (i = 0; i < tx->w_len; i++)
+      __atomic_store_n(tx->w[i].addr, tx->w[i].val, __ATOMIC_RELAXED);
+    for (i = 0; i < tx->w_len; i++) {
+      if (tx->w[i].acquired)
+        __atomic_store_n(tx->w[i].lock, wv << 1, __ATOMIC_RELEASE);
+    }
+    for (i = 0; i < tx->free_len; i++)
+      node_free(tx->free[i].p, tx->free[i].size);
+  }
+  tm_stats.commits++;
+  tm_stats.reads = tx->r_len;
+  tm_stats.writes = tx->w_len;
+  tx->retries = 0;
+}
+
+/* ################################################################### *
+ * HTM
+ * ################################################################### */
+
+/* RTM encoded by hand, so that no -mrtm is needed */
+#define XBEGIN_STARTED                  (~0u)
+#define XABORT_EXPLICIT                 (1 << 0)
+#define XABORT_RETRY                    (1 << 1)
+#define XABORT_CONFLICT                 (1 << 2)
+#define XABORT_CAPACITY                 (1 << 3)
+#define XABORT_CODE(s)                  (((s) >> 24) & 0xff)
+#define XABORT_LOCKED                   0xff
+
+#if defined(__x86_64__) || defined(__i386__)
+static inline __attribute__((always_inline)) unsigned int xbegin(void)
+{
+  unsigned int status = XBEGIN_STARTED;
+
+  /* Falls through with the abort status in eax */
+  __asm__ __volatile__(".byte 0xc7,0xf8 ; .long 0" : "+a" (status) :: "memory");
+  return status;
+}
+
+static inline __attribute__((always_inline)) void xend(void)
+{
+  __asm__ __volatile__(".byte 0x0f,0x01,0xd5" ::: "memory");
+}
+
+# define xabort(code)                   __asm__ __volatile__(".byte 0xc6,0xf8,%P0" :: "i" (code) : "memory")
+#else
+static inline unsigned int xbegin(void)
+{
+  return 0;
+}
+
+static inline void xend(void)
+{
+}
+
+# define xabort(code)                   do { } while (0)
+#endif
+
+void tm_htm_begin(tm_tx_t *tx)
+{
+  unsigned int status;
+
+  tx->retries = 0;
+  tx->fallback = 0;
+  while (tx->retries < TM_HTM_RETRIES) {
+    /* Do not start while the lock holder would abort us anyway */
+    while (__atomic_load_n(&tm_fallback_lock, __ATOMIC_ACQUIRE))
+      __builtin_ia32_pause();
+    status = xbegin();
+    if (status == XBEGIN_STARTED) {
+      /* The lock is in the read set: taking it aborts us */
+      if (tm_fallback_lock)
+        xabort(XABORT_LOCKED);
+      tx->nb_reads = tx->nb_writes = 0;
+      return;
+    }
+    tm_stats.aborts++;
+    if (status & XABORT_CONFLICT)
+      tm_stats.conflicts++;
+    if (status & XABORT_CAPACITY)
+      tm_stats.capacity++;
+    tx->retries++;
+    if (!(status & XABORT_RETRY) &&
+        !((status & XABORT_EXPLICIT) && XABORT_CODE(status) == XABORT_LOCKED))
+      break;
+  }
+  while (__atomic_exchange_n(&tm_fallback_lock, 1, __ATOMIC_ACQUIRE))
+    while (tm_fallback_lock)
+      __builtin_ia32_pause();
+  tx->fallback = 1;
+  tx->nb_reads = tx->nb_writes = 0;
+  tm_stats.fallbacks++;
+}
+
+void tm_htm_commit(tm_tx_t *tx)
+{
+  if (tx->fallback) {
+    __atomic_store_n(&tm_fallback_lock, 0, __ATOMIC_RELEASE);
+    tx->fallback = 0;
+  } else {
+    xend();
+  }
+  tm_stats.commits++;
+  tm_stats.reads = tx->nb_reads;
+  tm_stats.writes = tx->nb_writes;
+}
@@ -0,0 +1,177 @@
+/*
+ * File:
+ *   tm.h
+ * Description:
+ *   Transactional execution of set operations: a word-based STM, or
+ *   Intel RTM with a global lock fallback.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _TM_H_
+# define _TM_H_
+
+# include <setjmp.h>
+# include <stddef.h>
+# include <stdint.h>
+
+# include "alloc.h"
+# include "memtrace.h"
+
+# define DEFAULT_TM                     stm
+
+/* Versioned locks, one per stripe of 2^TM_STRIPE_BITS bytes */
+# define TM_LOCK_BITS                   20
+# define TM_STRIPE_BITS                 3
+/* Hardware attempts before taking the fallback lock */
+# define TM_HTM_RETRIES                 8
+/* Upper bound of the randomized back-off after an abort, in spins */
+# define TM_BACKOFF_MAX                 1024
+
+typedef enum {
+  TM_STM,                               /* Lazy versioning, commit-time locks */
+  TM_HTM                                /* RTM, serialized on a lock if it fails */
+} tm_kind_t;
+
+/* Per-thread counters, read once the thread is done */
+typedef struct tm_stats {
+  unsigned long commits;
+  unsigned long aborts;
+  unsigned long fallbacks;              /* HTM: ran under the fallback lock */
+  unsigned long conflicts;              /* HTM abort causes */
+  unsigned long capacity;
+  /* Words read and written by the last committed transaction */
+  unsigned long reads;
+  unsigned long writes;
+} tm_stats_t;
+
+typedef struct tm_w_entry {
+  volatile uintptr_t *addr;
+  uintptr_t val;
+  volatile uintptr_t *lock;
+  uintptr_t version;                    /* Lock value before we acquired it */
+  int acquired;                         /* Another entry may hold the same lock */
+} tm_w_entry_t;
+
+typedef struct tm_block {
+  void *p;
+  size_t size;
+} tm_block_t;
+
+/* Transaction descriptor, one per thread */
+typedef struct tm_tx {
+  jmp_buf env;                          /* STM restart point (TM_START) */
+  uintptr_t rv;                         /* Snapshot time */
+  volatile uintptr_t **r;               /* Read set: locks of the words read */
+  int r_len, r_size;
+  tm_w_entry_t *w;                      /* Write set (redo log) */
+  int w_len, w_size;
+  tm_block_t *alloc;                    /* Freed on abort */
+  int alloc_len, alloc_size;
+  tm_block_t *free;                     /* Freed on commit */
+  int free_len, free_size;
+  int retries;
+  int fallback;                         /* HTM: holds the fallback lock */
+  unsigned long nb_reads;               /* HTM: words accessed by this attempt */
+  unsigned long nb_writes;
+  unsigned long seed;
+} tm_tx_t;
+
+extern tm_kind_t tm_kind;
+extern __thread tm_tx_t tm_tx;
+extern __thread tm_stats_t tm_stats;
+
+int tm_parse(const char *s, tm_kind_t *kind);
+const char *tm_name(tm_kind_t kind);
+/* Exits if the CPU has no RTM */
+void tm_init(tm_kind_t kind);
+void tm_thread_fini(void);
+
+void tm_stm_begin(tm_tx_t *tx);
+void tm_stm_commit(tm_tx_t *tx);
+uintptr_t tm_stm_load(tm_tx_t *tx, volatile uintptr_t *addr);
+void tm_stm_store(tm_tx_t *tx, volatile uintptr_t *addr, uintptr_t val);
+void *tm_stm_alloc(tm_tx_t *tx, size_t size);
+void tm_stm_free(tm_tx_t *tx, void *p, size_t size);
+void tm_htm_begin(tm_tx_t *tx);
+void tm_htm_commit(tm_tx_t *tx);
+
+/*
+ * Runs the rest of the enclosing function, up to TM_COMMIT(), as one
+ * transaction.  An STM abort jumps back here, so the code in between
+ * must not depend on local variables set before it.
+ */
+# define TM_START()                                                         \
+  do {                                                                      \
+    if (tm_kind == TM_STM) {                                                \
+      setjmp(tm_tx.env);                                                    \
+      tm_stm_begin(&tm_tx);                                                 \
+    } else {                                                                \
+      tm_htm_begin(&tm_tx);                                                 \
+    }                                                                       \
+  } while (0)
+
+# define TM_COMMIT()                                                        \
+  do {                                                                      \
+    if (tm_kind == TM_STM)                                                  \
+      tm_stm_commit(&tm_tx);                                                \
+    else                                                                    \
+      tm_htm_commit(&tm_tx);                                                \
+  } while (0)
+
+static inline uintptr_t tm_load(volatile uintptr_t *addr)
+{
+  if (tm_kind == TM_STM)
+    return tm_stm_load(&tm_tx, addr);
+  tm_tx.nb_reads++;
+  return *addr;
+}
+
+static inline void tm_store(volatile uintptr_t *addr, uintptr_t val)
+{
+  if (tm_kind == TM_STM) {
+    tm_stm_store(&tm_tx, addr, val);
+    return;
+  }
+  tm_tx.nb_writes++;
+  *addr = val;
+}
+
+/* A node allocated by a transaction that aborts is freed */
+static inline void *tm_alloc(size_t size)
+{
+  if (tm_kind == TM_STM)
+    return tm_stm_alloc(&tm_tx, size);
+  return node_alloc(size);
+}
+
+/* The node is freed if the transaction commits */
+static inline void tm_free(void *p, size_t size)
+{
+  if (tm_kind == TM_STM)
+    tm_stm_free(&tm_tx, p, size);
+  else
+    node_free(p, size);
+}
+
+/* Transactional access to a word-sized lvalue, recorded like MT_LD/MT_ST */
+# define TM_LD(x)                       (memtrace_load(&(x), sizeof(x)),        \
+                                         (__typeof__(x))tm_load((volatile uintptr_t *)&(x)))
+# define TM_ST(x, v)                    ({ uintptr_t _tm_v = (uintptr_t)(v);   \
+                                           memtrace_store(&(x), sizeof(x));    \
+                                           tm_store((volatile uintptr_t *)&(x), _tm_v); })
+
+#endif /* _TM_H_ */
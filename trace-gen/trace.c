@@ -0,0 +1,455 @@
+/*
+ * File:
+ *   trace.c
+ * Description:
+ *   Buffered trace output for the integer set stress test.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+void trace_write_all(int fd, const void *data, size_t len)
+{
+  const char *buf = (const char *)data;
+  ssize_t n;
+
+  while (len > 0) {
+    n = write(fd, buf, len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("write");
+      exit(1);
+    }
+    buf += n;
+    len -= n;
+  }
+}
+
+int trace_parse_format(const char *s, trace_format_t *format)
+{
+  if (strcmp(s, "text") == 0)
+    *format = TRACE_TEXT;
+  else if (strcmp(s, "binary") == 0)
+    *format = TRACE_BINARY;
+  else
+    return -1;
+  return 0;
+}
+
+int trace_create(const char *path)
+{
+  int fd;
+
+  if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+    perror(path);
+    exit(1);
+  }
+  return fd;
+}
+
+/* An existing stream, written at the offset of its checkpoint */
+static int trace_reopen(const char *path)
+{
+  int fd;
+
+  if ((fd = open(path, O_WRONLY | O_CREAT, 0644)) < 0) {
+    perror(path);
+    exit(1);
+  }
+  return fd;
+}
+
+static void write_header(codec_out_t *out, const trace_t *t, uint64_t nb_initial,
+                         int cpu, int node)
+{
+  trace_header_t h;
+
+  memset(&h, 0, sizeof(h));
+  h.magic = TRACE_MAGIC;
+  h.version = TRACE_VERSION;
+  h.rec_size = sizeof(trace_rec_t);
+  h.nb_initial = nb_initial;
+  h.pin = t->pin;
+  h.mem = t->mem;
+  h.nb_nodes = t->nb_nodes;
+  h.nb_shards = t->nb_shards;
+  h.cpu = cpu;
+  h.node = node;
+  codec_out_write(out, (const char *)&h, sizeof(h));
+}
+
+/* ################################################################### *
+ * COMPRESSOR THREAD
+ * ################################################################### */
+
+/* Compressor side: returns 1 if there was anything to compress */
+static int ring_drain(trace_t *t, trace_ring_t *r)
+{
+  uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+  uint64_t tail = r->tail;
+  size_t off, n;
+
+  if (head == tail)
+    return 0;
+  off = tail % TRACE_RING_SIZE;
+  n = head - tail;
+  if (n > TRACE_RING_SIZE - off)
+    n = TRACE_RING_SIZE - off;
+  if (r->shared)
+    pthread_mutex_lock(&t->lock);
+  codec_out_write(r->out, r->data + off, n);
+  if (n < head - tail)
+    codec_out_write(r->out, r->data, head - tail - n);
+  if (r->shared)
+    pthread_mutex_unlock(&t->lock);
+  __atomic_store_n(&r->tail, head, __ATOMIC_RELEASE);
+
+  return 1;
+}
+
+/* Producer side: only a memcpy, unless the compressor is behind */
+static void ring_push(trace_ring_t *r, const char *data, size_t len)
+{
+  uint64_t head = r->head;
+  size_t off, n;
+
+  while (TRACE_RING_SIZE - (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)) < len)
+    sched_yield();
+  off = head % TRACE_RING_SIZE;
+  n = len < TRACE_RING_SIZE - off ? len : TRACE_RING_SIZE - off;
+  memcpy(r->data + off, data, n);
+  memcpy(r->data, data + n, len - n);
+  __atomic_store_n(&r->head, head + len, __ATOMIC_RELEASE);
+}
+
+static void *compressor(void *arg)
+{
+  trace_t *t = (trace_t *)arg;
+  struct timespec idle = { 0, TRACE_IDLE_NS };
+  trace_ring_t *r;
+  int busy, live, closed;
+
+  while (1) {
+    busy = live = 0;
+    for (r = __atomic_load_n(&t->rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+      if (r->done)
+        continue;
+      /* Read before draining: a closed ring has published everything */
+      closed = __atomic_load_n(&r->closed, __ATOMIC_ACQUIRE);
+      busy |= ring_drain(t, r);
+      if (!closed || r->tail != r->head) {
+        live = 1;
+        continue;
+      }
+      if (!r->shared) {
+        codec_out_close(r->out);
+        __atomic_add_fetch(&t->nb_raw, r->out->nb_in, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&t->nb_packed, r->out->nb_out, __ATOMIC_RELAXED);
+      }
+      __atomic_store_n(&r->done, 1, __ATOMIC_RELEASE);
+    }
+    if (!busy) {
+      if (!live && __atomic_load_n(&t->stop, __ATOMIC_ACQUIRE))
+        break;
+      nanosleep(&idle, NULL);
+    }
+  }
+
+  return NULL;
+}
+
+static trace_ring_t *ring_new(trace_t *t, codec_out_t *out)
+{
+  trace_ring_t *r;
+
+  if ((r = (trace_ring_t *)malloc(sizeof(*r))) == NULL ||
+      (r->data = (char *)malloc(TRACE_RING_SIZE)) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  r->head = r->tail = 0;
+  r->out = out;
+  r->shared = (out == &t->out);
+  r->closed = r->done = 0;
+  r->next = t->rings;
+  while (!__atomic_compare_exchange_n(&t->rings, &r->next, r, 0,
+                                      __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    ;
+  return r;
+}
+
+/* Hands the rest of the ring to the compressor and waits until it is done */
+static void ring_close(trace_ring_t *r)
+{
+  __atomic_store_n(&r->closed, 1, __ATOMIC_RELEASE);
+  while (!__atomic_load_n(&r->done, __ATOMIC_ACQUIRE))
+    sched_yield();
+  free(r->data);
+  r->data = NULL;
+}
+
+/* ################################################################### *
+ * STREAMS
+ * ################################################################### */
+
+void trace_open(trace_t *t, const char *path, trace_format_t format,
+                const char *prefix, const codec_t *codec, int resume)
+{
+  char name[PATH_MAX];
+
+  if (prefix != NULL) {
+    /* Initial contents go to <prefix>.init.bin */
+    snprintf(name, sizeof(name), "%s.init.bin", prefix);
+    path = name;
+  }
+  if (path == NULL) {
+    /* Historical behavior: trace goes to stderr */
+    t->fd = STDERR_FILENO;
+  } else if (strcmp(path, "-") == 0) {
+    t->fd = STDOUT_FILENO;
+  } else {
+    t->fd = resume ? trace_reopen(path) : trace_create(path);
+  }
+  t->format = format;
+  t->prefix = prefix;
+  pthread_mutex_init(&t->lock, NULL);
+  t->pin = t->mem = 0;
+  t->nb_nodes = 1;
+  t->nb_shards = 0;
+  t->codec.kind = CODEC_NONE;
+  t->codec.level = 0;
+  if (codec != NULL)
+    t->codec = *codec;
+  codec_out_open(&t->out, t->fd, &t->codec);
+  t->rings = NULL;
+  t->stop = 0;
+  t->nb_raw = t->nb_packed = 0;
+  t->resume = resume;
+  if (t->codec.kind != CODEC_NONE &&
+      pthread_create(&t->compressor, NULL, compressor, t) != 0) {
+    perror("pthread_create");
+    exit(1);
+  }
+}
+
+void trace_close(trace_t *t)
+{
+  trace_ring_t *r;
+
+  if (t->codec.kind != CODEC_NONE) {
+    __atomic_store_n(&t->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(t->compressor, NULL);
+    while ((r = t->rings) != NULL) {
+      t->rings = r->next;
+      free(r);
+    }
+  }
+  codec_out_close(&t->out);
+  t->nb_raw += t->out.nb_in;
+  t->nb_packed += t->out.nb_out;
+  if (t->fd > STDERR_FILENO)
+    close(t->fd);
+  pthread_mutex_destroy(&t->lock);
+}
+
+void trace_begin(trace_t *t, uint64_t nb_initial)
+{
+  if (t->format != TRACE_BINARY)
+    return;
+  pthread_mutex_lock(&t->lock);
+  write_header(&t->out, t, nb_initial, -1, -1);
+  pthread_mutex_unlock(&t->lock);
+}
+
+void trace_buf_init(trace_buf_t *b, trace_t *t, uint32_t tid, int cpu, int node)
+{
+  char name[PATH_MAX];
+
+  b->out = NULL;
+  if (t->prefix != NULL && tid != TRACE_TID_MAIN) {
+    snprintf(name, sizeof(name), "%s.%u.bin", t->prefix, tid);
+    if ((b->out = (codec_out_t *)malloc(sizeof(codec_out_t))) == NULL) {
+      perror("malloc");
+      exit(1);
+    }
+    codec_out_open(b->out, t->resume ? trace_reopen(name) : trace_create(name), &t->codec);
+    if (!t->resume)
+      write_header(b->out, t, 0, cpu, node);
+  }
+  b->ring = NULL;
+  if (t->codec.kind != CODEC_NONE)
+    b->ring = ring_new(t, b->out != NULL ? b->out : &t->out);
+  if ((b->data = (char *)malloc(TRACE_BUFSIZE)) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  b->trace = t;
+  b->len = 0;
+  b->tid = tid;
+  b->seq = 0;
+  b->now = 0;
+}
+
+void trace_buf_flush(trace_buf_t *b)
+{
+  if (b->len == 0)
+    return;
+  if (b->ring != NULL) {
+    ring_push(b->ring, b->data, b->len);
+    b->len = 0;
+    return;
+  }
+  if (b->out != NULL) {
+    codec_out_write(b->out, b->data, b->len);
+    b->len = 0;
+    return;
+  }
+  /* Threads share the stream: serialize whole chunks, not records */
+  pthread_mutex_lock(&b->trace->lock);
+  codec_out_write(&b->trace->out, b->data, b->len);
+  pthread_mutex_unlock(&b->trace->lock);
+  b->len = 0;
+}
+
+void trace_buf_destroy(trace_buf_t *b)
+{
+  trace_t *t = b->trace;
+
+  trace_buf_flush(b);
+  if (b->ring != NULL)
+    ring_close(b->ring);
+  if (b->out != NULL) {
+    /* The compressor ends compressed private streams */
+    if (b->ring == NULL) {
+      codec_out_close(b->out);
+      __atomic_add_fetch(&t->nb_raw, b->out->nb_in, __ATOMIC_RELAXED);
+      __atomic_add_fetch(&t->nb_packed, b->out->nb_out, __ATOMIC_RELAXED);
+    }
+    close(b->out->fd);
+    free(b->out);
+    b->out = NULL;
+  }
+  b->ring = NULL;
+  free(b->data);
+  b->data = NULL;
+}
+
+void trace_initial(trace_buf_t *b, int64_t val)
+{
+  char *p;
+
+  if (b->len + TRACE_TEXT_MAX > TRACE_BUFSIZE)
+    trace_buf_flush(b);
+  p = b->data + b->len;
+  if (b->trace->format == TRACE_BINARY) {
+    memcpy(p, &val, sizeof(val));
+    p += sizeof(val);
+  } else {
+    p = trace_fmt_int(p, val);
+    *p++ = ',';
+    *p++ = ' ';
+  }
+  b->len = p - b->data;
+}
+
+void trace_initial_end(trace_buf_t *b)
+{
+  if (b->trace->format == TRACE_TEXT)
+    b->data[b->len++] = '\n';
+  trace_buf_flush(b);
+}
+
+void trace_rec(trace_buf_t *b, const trace_rec_t *rec)
+{
+  char *p;
+
+  if (b->len + TRACE_TEXT_MAX > TRACE_BUFSIZE)
+    trace_buf_flush(b);
+  p = b->data + b->len;
+  if (b->trace->format == TRACE_BINARY) {
+    memcpy(p, rec, sizeof(*rec));
+    p += sizeof(*rec);
+  } else {
+    p = trace_fmt_rec(p, rec->op, rec->val);
+  }
+  b->len = p - b->data;
+}
+
+/* ################################################################### *
+ * CHECKPOINTS
+ * ################################################################### */
+
+/* The position in a file, else (pipes, /dev/null) the bytes written */
+static uint64_t out_offset(const codec_out_t *o)
+{
+  struct stat st;
+  off_t off;
+
+  if (fstat(o->fd, &st) != 0 || !S_ISREG(st.st_mode) || (off = lseek(o->fd, 0, SEEK_CUR)) < 0)
+    return o->nb_out;
+  return (uint64_t)off;
+}
+
+uint64_t trace_offset(const trace_t *t)
+{
+  return out_offset(&t->out);
+}
+
+uint64_t trace_buf_offset(const trace_buf_t *b)
+{
+  return b->out != NULL ? out_offset(b->out) : 0;
+}
+
+/* Drops whatever was written after off; -1 if there is less than that */
+static int cut_at(int fd, uint64_t off)
+{
+  struct stat st;
+
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (uint64_t)st.st_size < off)
+    return -1;
+  if (ftruncate(fd, (off_t)off) != 0 || lseek(fd, (off_t)off, SEEK_SET) < 0) {
+    perror("ftruncate");
+    exit(1);
+  }
+  return 0;
+}
+
+int trace_resume(trace_t *t, uint64_t off)
+{
+  return cut_at(t->fd, off) == 0;
+}
+
+void trace_buf_resume(trace_buf_t *b, uint64_t off, uint64_t seq)
+{
+  /* Unlike the shared stream, a per-thread trace cannot start halfway */
+  if (b->out != NULL && cut_at(b->out->fd, off) != 0) {
+    fprintf(stderr, "Per-thread trace of thread %u is shorter than the checkpoint\n", b->tid);
+    exit(1);
+  }
+  b->seq = seq;
+}
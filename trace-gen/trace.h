@@ -0,0 +1,275 @@
+/*
+ * File:
+ *   trace.h
+ * Description:
+ *   Buffered trace output for the integer set stress test.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _TRACE_H_
+# define _TRACE_H_
+
+# include <pthread.h>
+# include <stdint.h>
+# include <string.h>
+# include <time.h>
+
+# include "codec.h"
+
+# define TRACE_MAGIC                    0x52544d50      /* "PMTR" */
+# define TRACE_VERSION                  4
+/* Version 2 headers stop after nb_initial */
+# define TRACE_HEADER_V2_SIZE           16
+# define TRACE_BUFSIZE                  (1 << 20)
+/* Per-buffer ring to the compressor thread: holds whole flushed chunks */
+# define TRACE_RING_SIZE                (4 * TRACE_BUFSIZE)
+/* Compressor back-off when all rings are empty */
+# define TRACE_IDLE_NS                  100000
+/* Longest text record: "<op> <shard> <int64> <len>\n" */
+# define TRACE_TEXT_MAX                 48
+/* Thread id of the main (populating) thread's buffer */
+# define TRACE_TID_MAIN                 UINT32_MAX
+
+/* Operation codes (shared by the text and binary formats) */
+# define TRACE_OP_ADD                   0
+# define TRACE_OP_REMOVE                1
+# define TRACE_OP_CONTAINS              2
+/* Range scan: "3 - <lo> <len>", up to len keys from the first >= lo */
+# define TRACE_OP_SCAN                  3
+/* Start of a workload phase; the value is the phase index */
+# define TRACE_OP_PHASE                 9
+
+typedef enum {
+  TRACE_TEXT,
+  TRACE_BINARY
+} trace_format_t;
+
+/* Binary file layout: header, nb_initial int64_t values, records */
+typedef struct trace_header {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t rec_size;
+  uint64_t nb_initial;
+  /* Version 3: placement of the run (pin_kind_t, mem_kind_t in place.h) */
+  uint8_t pin;
+  uint8_t mem;
+  uint16_t nb_nodes;
+  int32_t cpu;                          /* CPU of a per-thread stream, or -1 */
+  int32_t node;                         /* NUMA node of that CPU, or -1 */
+  /* Version 4: shards of a sharded run, 0 if the set was shared */
+  uint16_t nb_shards;
+  uint16_t pad;
+} trace_header_t;
+
+/*
+ * The op field: the code in the low byte, then the length of a scan, then
+ * (version 4) 1 + the shard that served the op, or 0 if not sharded
+ */
+# define TRACE_OP_BITS                  8
+# define TRACE_LEN_BITS                 16
+# define TRACE_OP_CODE(op)              ((op) & ((1 << TRACE_OP_BITS) - 1))
+# define TRACE_OP_LEN(op)               (((op) >> TRACE_OP_BITS) & TRACE_SCAN_MAX)
+# define TRACE_OP_SHARD(op)             ((op) >> (TRACE_OP_BITS + TRACE_LEN_BITS))
+# define TRACE_OP_SHARDED(shard)        ((uint32_t)((shard) + 1) << (TRACE_OP_BITS + TRACE_LEN_BITS))
+# define TRACE_SCAN_MAX                 ((1 << TRACE_LEN_BITS) - 1)
+# define TRACE_SHARD_MAX                ((1 << (32 - TRACE_OP_BITS - TRACE_LEN_BITS)) - 2)
+
+/* Records are globally ordered by (ts, tid, seq); ts is the issue time */
+typedef struct trace_rec {
+  int64_t val;
+  uint64_t seq;
+  uint64_t ts;                          /* CLOCK_MONOTONIC, in ns */
+  uint32_t tid;
+  uint32_t op;
+} trace_rec_t;
+
+/*
+ * Single-producer, single-consumer byte ring from one buffer's owner to
+ * the compressor thread.  The producer publishes whole chunks only, so
+ * chunks of a shared stream never interleave mid-record.
+ */
+typedef struct trace_ring {
+  volatile uint64_t head;               /* Written by the producer */
+  char pad1[56];
+  volatile uint64_t tail;               /* Written by the compressor */
+  char pad2[56];
+  char *data;
+  codec_out_t *out;                     /* Private stream, or the shared one */
+  int shared;
+  int closed;                           /* The producer is done */
+  int done;                             /* Drained, and a private stream ended */
+  struct trace_ring *next;
+} trace_ring_t;
+
+/* Output stream shared by all threads */
+typedef struct trace {
+  int fd;
+  trace_format_t format;
+  /* If set, each thread writes its own <prefix>.<tid>.bin stream */
+  const char *prefix;
+  pthread_mutex_t lock;
+  /* Placement recorded in the headers */
+  uint8_t pin;
+  uint8_t mem;
+  uint16_t nb_nodes;
+  uint16_t nb_shards;
+  /* Compression: buffers feed the compressor thread through rings */
+  codec_t codec;
+  codec_out_t out;
+  trace_ring_t *rings;
+  pthread_t compressor;
+  int stop;
+  uint64_t nb_raw;                      /* Totals over all streams, once closed */
+  uint64_t nb_packed;
+  int resume;                           /* Streams are continued, not created */
+} trace_t;
+
+/* Per-thread output buffer, flushed to the stream in large chunks */
+typedef struct trace_buf {
+  trace_t *trace;
+  codec_out_t *out;                     /* Private stream, or NULL if shared */
+  trace_ring_t *ring;                   /* If compressed */
+  char *data;
+  size_t len;
+  uint32_t tid;
+  uint64_t seq;
+  uint64_t now;                         /* Timestamp of the current op */
+} trace_buf_t;
+
+int trace_create(const char *path);
+void trace_write_all(int fd, const void *data, size_t len);
+int trace_parse_format(const char *s, trace_format_t *format);
+/* With resume, files are kept for trace_resume() and trace_buf_resume() */
+void trace_open(trace_t *t, const char *path, trace_format_t format,
+                const char *prefix, const codec_t *codec, int resume);
+void trace_close(trace_t *t);
+void trace_begin(trace_t *t, uint64_t nb_initial);
+
+void trace_buf_init(trace_buf_t *b, trace_t *t, uint32_t tid, int cpu, int node);
+void trace_buf_flush(trace_buf_t *b);
+void trace_buf_destroy(trace_buf_t *b);
+/*
+ * Checkpoints (uncompressed streams only): where a stream ends once
+ * flushed, then continue it there.  trace_resume() cuts a regular file
+ * back to off; it returns 0 if the stream is shorter, or not a file, and
+ * only the rest of the trace is written.
+ */
+uint64_t trace_offset(const trace_t *t);
+uint64_t trace_buf_offset(const trace_buf_t *b);
+int trace_resume(trace_t *t, uint64_t off);
+void trace_buf_resume(trace_buf_t *b, uint64_t off, uint64_t seq);
+void trace_initial(trace_buf_t *b, int64_t val);
+void trace_initial_end(trace_buf_t *b);
+void trace_rec(trace_buf_t *b, const trace_rec_t *rec);
+
+static inline int trace_header_ok(const trace_header_t *h)
+{
+  return h->magic == TRACE_MAGIC && h->rec_size == sizeof(trace_rec_t) &&
+    h->version >= 2 && h->version <= TRACE_VERSION;
+}
+
+/* Offset of the initial values */
+static inline size_t trace_header_size(const trace_header_t *h)
+{
+  return h->version == 2 ? TRACE_HEADER_V2_SIZE : sizeof(trace_header_t);
+}
+
+/* Read a header of either version, filling in the version 3 fields */
+static inline void trace_header_copy(trace_header_t *dst, const void *src, size_t size)
+{
+  memset(dst, 0, sizeof(*dst));
+  dst->nb_nodes = 1;
+  dst->cpu = dst->node = -1;
+  memcpy(dst, src, size < sizeof(*dst) ? size : sizeof(*dst));
+}
+
+static inline int trace_rec_before(const trace_rec_t *a, const trace_rec_t *b)
+{
+  if (a->ts != b->ts)
+    return a->ts < b->ts;
+  if (a->tid != b->tid)
+    return a->tid < b->tid;
+  return a->seq < b->seq;
+}
+
+static inline uint64_t trace_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline char *trace_fmt_int(char *p, int64_t v)
+{
+  char tmp[24];
+  char *q = tmp + sizeof(tmp);
+  uint64_t u = (v < 0) ? -(uint64_t)v : (uint64_t)v;
+
+  do {
+    *--q = '0' + (u % 10);
+    u /= 10;
+  } while (u != 0);
+  if (v < 0)
+    *--q = '-';
+  memcpy(p, q, tmp + sizeof(tmp) - q);
+  return p + (tmp + sizeof(tmp) - q);
+}
+
+/* Text form of a record; returns the end */
+static inline char *trace_fmt_rec(char *p, uint32_t op, int64_t val)
+{
+  *p++ = '0' + TRACE_OP_CODE(op);
+  *p++ = ' ';
+  if (TRACE_OP_SHARD(op) != 0)
+    p = trace_fmt_int(p, TRACE_OP_SHARD(op) - 1);
+  else
+    *p++ = '-';
+  *p++ = ' ';
+  p = trace_fmt_int(p, val);
+  if (TRACE_OP_CODE(op) == TRACE_OP_SCAN) {
+    *p++ = ' ';
+    p = trace_fmt_int(p, TRACE_OP_LEN(op));
+  }
+  *p++ = '\n';
+  return p;
+}
+
+static inline void trace_op(trace_buf_t *b, uint32_t op, int64_t val)
+{
+  if (b->trace->format == TRACE_BINARY) {
+    trace_rec_t *r;
+    if (b->len + sizeof(trace_rec_t) > TRACE_BUFSIZE)
+      trace_buf_flush(b);
+    r = (trace_rec_t *)(b->data + b->len);
+    r->val = val;
+    r->seq = b->seq;
+    r->ts = b->now;
+    r->tid = b->tid;
+    r->op = op;
+    b->len += sizeof(trace_rec_t);
+  } else {
+    char *p;
+    if (b->len + TRACE_TEXT_MAX > TRACE_BUFSIZE)
+      trace_buf_flush(b);
+    p = trace_fmt_rec(b->data + b->len, op, val);
+    b->len = p - b->data;
+  }
+  b->seq++;
+}
+
+#endif /* _TRACE_H_ */
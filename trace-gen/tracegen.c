@@ -25,15 +25,36 @@
 
 #include <assert.h>
 #include <getopt.h>
+#include <math.h>
 #include <limits.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <sys/time.h>
 #include <time.h>
 
+#include "alloc.h"
+#include "barrier.h"
+#include "bulk.h"
+#include "ckpt.h"
+#include "crash.h"
+#include "dist.h"
+#include "ebr.h"
+#include "intset.h"
+#include "memtrace.h"
+#include "perf.h"
+#include "phase.h"
+#include "place.h"
+#include "pmem.h"
+#include "rng.h"
+#include "shard.h"
+#include "stats.h"
+#include "tm.h"
+#include "trace.h"
+
 
 #define DEFAULT_OPNUM                   10000
 #define DEFAULT_INITIAL                 256
@@ -41,6 +62,21 @@
 #define DEFAULT_RANGE                   (DEFAULT_INITIAL * 2)
 #define DEFAULT_SEED                    0
 #define DEFAULT_UPDATE                  20
+#define DEFAULT_SCAN                    0
+#define DEFAULT_DURATION                0
+#define DEFAULT_RATE                    0
+#define DEFAULT_FORMAT                  text
+#define DEFAULT_INTERLEAVE              0
+#define DEFAULT_CHECKPOINT_EVERY        0
+/* Lookups queued, at most, for one interleaved run */
+#define INTERLEAVE_QUEUE                64
+/* Populate: once fewer than 1 in 16 skewed draws are new, draw uniformly */
+#define POPULATE_RETRIES                16
+/* Pacing: sleep when the next arrival is further away than this (ns) */
+#define PACE_SLEEP_NS                   50000
+
+/* Latency histograms per thread: one per op type, scans included */
+#define NB_OP_TYPES                     (TRACE_OP_SCAN + 1)
 
 #define XSTR(s)                         STR(s)
 #define STR(s)                          #s
@@ -49,297 +85,364 @@
  * GLOBALS
  * ################################################################### */
 static volatile int stop;
-static unsigned short main_seed[3];
-
-static inline void rand_init(unsigned short *seed)
-{
-  seed[0] = (unsigned short)rand();
-  seed[1] = (unsigned short)rand();
-  seed[2] = (unsigned short)rand();
-}
-
-static inline int rand_range(int n, unsigned short *seed)
-{
-  /* Return a random number in range [0;n) */
-  int v = (int)(erand48(seed) * n);
-  assert (v >= 0 && v < n);
-  return v;
-}
+static rng_t main_rng;
 
 typedef struct thread_data {
   struct intset *set;
+  shard_set_t *shard;                   /* The set, if sharded */
+  int served_by;                        /* Shard of the current op */
   struct barrier *barrier;
   unsigned long nb_add;
   unsigned long nb_remove;
   unsigned long nb_contains;
   unsigned long nb_found;
-  unsigned short seed[3];
+  unsigned long nb_scan;
+  unsigned long nb_scanned;             /* Keys visited by scans */
+  unsigned long nb_flush;
+  unsigned long nb_fence;
+  unsigned long nb_access;
+  tm_stats_t tm;                        /* Transactions, once done */
+  ebr_stats_t ebr;                      /* Reclamation, once done */
+  shard_stats_t shards;                 /* Routing, once done */
+  const perf_spec_t *perf;              /* Hardware counters, or NULL */
+  perf_counts_t perf_total;             /* Measured phases, once done */
+  perf_counts_t perf_ops[NB_OP_TYPES];  /* Sampled ops, by op type */
+  rng_t rng;
+  const dist_t *dist;
+  dist_state_t dist_state;
   int ops;
   int diff;
   int range;
   int update;
+  int scan;
+  const len_dist_t *scan_len;
   int alternate;
+  uint64_t interval;                    /* Mean ns between arrivals, 0=closed loop */
+  int poisson;                          /* Exponential inter-arrival times */
+  int interleave;                       /* Lookups in flight at once, 0=one by one */
+  int nb_queued;                        /* Lookups waiting for an interleaved run */
+  val_t queued[INTERLEAVE_QUEUE];
+  uint64_t queued_t0[INTERLEAVE_QUEUE];
+  int queued_res[INTERLEAVE_QUEUE];
+  unsigned long nb_runs;                /* Interleaved runs */
+  hist_t *hist;                         /* Latency per op type, or NULL */
+  hist_t *tx_sets;                      /* Read, then write set sizes per op type */
+  trace_buf_t trace;
+  char *memtrace;                       /* Memory trace prefix, or NULL */
+  int cpu;                              /* Pinned CPU and its node, or -1 */
+  int node;
+  int numa_bind;                        /* Bind this thread's slabs to node */
+  const phase_t *phases;
+  int nb_phases;
+  int markers;                          /* Write phase markers (thread 0) */
+  int nb_threads;
+  ckpt_t *ckpt;                         /* Periodic checkpoints, or NULL */
+  const ckpt_thread_t *resume;          /* Where a resumed run goes on, or NULL */
+  int first_phase;
   char padding[64];
 } thread_data_t;
 
-
-
-
-
-
 /* ################################################################### *
- * LINKED LIST
+ * PACING
  * ################################################################### */
 
-typedef intptr_t val_t;
-# define VAL_MIN                        INT_MIN
-# define VAL_MAX                        INT_MAX
-
-typedef struct node {
-  val_t val;
-  struct node *next;
-} node_t;
-
-typedef struct intset {
-  node_t *head;
-} intset_t;
-
-static node_t *new_node(val_t val, node_t *next, int transactional)
-{
-  node_t *node;
-
-  node = (node_t *)malloc(sizeof(node_t));
-  if (node == NULL) {
-    perror("malloc");
-    exit(1);
-  }
-
-  node->val = val;
-  node->next = next;
-
-  return node;
-}
-
-static intset_t *set_new()
+/* Wait until the (absolute, CLOCK_MONOTONIC) arrival time t */
+static void pace_wait(uint64_t t)
 {
-  intset_t *set;
-  node_t *min, *max;
-
-  if ((set = (intset_t *)malloc(sizeof(intset_t))) == NULL) {
-    perror("malloc");
-    exit(1);
+  struct timespec ts;
+  uint64_t now = trace_now();
+
+  if (now >= t)
+    return;
+  if (t - now > PACE_SLEEP_NS) {
+    t -= PACE_SLEEP_NS / 2;
+    ts.tv_sec = t / 1000000000ULL;
+    ts.tv_nsec = t % 1000000000ULL;
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    t += PACE_SLEEP_NS / 2;
   }
-  max = new_node(VAL_MAX, NULL, 0);
-  min = new_node(VAL_MIN, max, 0);
-  set->head = min;
-
-  return set;
+  while (trace_now() < t)
+    ;
 }
 
-static void set_delete(intset_t *set)
+static uint64_t pace_next(thread_data_t *d)
 {
-  node_t *node, *next;
-
-  node = set->head;
-  while (node != NULL) {
-    next = node->next;
-    free(node);
-    node = next;
-  }
-  free(set);
+  if (d->poisson)
+    return (uint64_t)(-log(1.0 - rand_double(&d->rng)) * d->interval);
+  return d->interval;
 }
 
-static int set_size(intset_t *set)
-{
-  int size = 0;
-  node_t *node;
-
-  /* We have at least 2 elements */
-  node = set->head->next;
-  while (node->next != NULL) {
-    size++;
-    node = node->next;
-  }
-
-  return size;
-}
+/* ################################################################### *
+ * STRESS TEST
+ * ################################################################### */
 
-static int set_contains(intset_t *set, val_t val)
+/* One op on the shared set, or on the shard of its key */
+static inline int set_op(thread_data_t *d, uint32_t op, val_t val, int len)
 {
-  int result;
-  node_t *prev, *next;
-  val_t v;
-
-# ifdef DEBUG
-  printf("++> set_contains(%d)\n", val);
-  IO_FLUSH;
-# endif
-
-  prev = set->head;
-  next = prev->next;
-  while (next->val < val) {
-    prev = next;
-    next = prev->next;
+  if (d->shard != NULL)
+    return shard_exec(d->shard, d->trace.tid, op, val, len, &d->served_by);
+  switch (op) {
+   case TRACE_OP_ADD:
+     return set_add(d->set, val);
+   case TRACE_OP_REMOVE:
+     return set_remove(d->set, val);
+   case TRACE_OP_CONTAINS:
+     return set_contains(d->set, val);
   }
-  result = (next->val == val);
-
-  return result;
+  return set_scan(d->set, val, len);
 }
 
-static int set_add(intset_t *set, val_t val)
+/* The queued lookups, as one interleaved run; each completes with the run */
+static void run_queued(thread_data_t *d, hist_t *hist)
 {
-  int result;
-  node_t *prev, *next;
-  val_t v;
-
-# ifdef DEBUG
-  printf("++> set_add(%d)\n", val);
-  IO_FLUSH;
-# endif
-
-  prev = set->head;
-  next = prev->next;
-  while (next->val < val) {
-    prev = next;
-    next = prev->next;
-  }
-  result = (next->val != val);
-  if (result) {
-    prev->next = new_node(val, next, 0);
+  uint64_t t1;
+  int i;
+
+  d->nb_found += set_contains_interleaved(d->set, d->queued, d->nb_queued, d->queued_res,
+                                          d->interleave);
+  if (hist != NULL) {
+    t1 = stats_ticks();
+    for (i = 0; i < d->nb_queued; i++)
+      hist_record(&hist[TRACE_OP_CONTAINS],
+                  (uint64_t)((t1 - d->queued_t0[i]) * stats_ns_per_tick));
   }
-
-  return result;
+  d->nb_queued = 0;
+  d->nb_runs++;
 }
 
-static int set_remove(intset_t *set, val_t val)
+/* Every thread stops at the same op, and thread 0 saves the quiescent run */
+static void checkpoint(thread_data_t *d, hist_t *hist, int p, long n, int last)
 {
-  int result;
-  node_t *prev, *next;
-  val_t v;
-  node_t *n;
-
-# ifdef DEBUG
-  printf("++> set_remove(%d)\n", val);
-  IO_FLUSH;
-# endif
-
-  prev = set->head;
-  next = prev->next;
-  while (next->val < val) {
-    prev = next;
-    next = prev->next;
-  }
-  result = (next->val == val);
-  if (result) {
-    prev->next = next->next;
-    free(next);
-  }
-  return result;
+  ckpt_t *c = d->ckpt;
+  ckpt_thread_t *t = &c->threads[d->trace.tid];
+
+  if (d->nb_queued > 0)
+    run_queued(d, hist);
+  trace_buf_flush(&d->trace);
+  t->rng = d->rng;
+  t->dist_state = d->dist_state;
+  t->last = last;
+  t->n = n;
+  t->seq = d->trace.seq;
+  t->offset = trace_buf_offset(&d->trace);
+  barrier_cross(&c->barrier);
+  if (d->trace.tid == 0)
+    ckpt_write(c, d->set, d->nb_threads, p, trace_offset(d->trace.trace));
+  barrier_cross(&c->barrier);
 }
 
-
-
-/* ################################################################### *
- * BARRIER
- * ################################################################### */
-
-typedef struct barrier {
-  pthread_cond_t complete;
-  pthread_mutex_t mutex;
-  int count;
-  int crossing;
-} barrier_t;
-
-static void barrier_init(barrier_t *b, int n)
-{
-  pthread_cond_init(&b->complete, NULL);
-  pthread_mutex_init(&b->mutex, NULL);
-  b->count = n;
-  b->crossing = 0;
-}
-
-static void barrier_cross(barrier_t *b)
-{
-  pthread_mutex_lock(&b->mutex);
-  /* One more thread through */
-  b->crossing++;
-  /* If not all here, wait */
-  if (b->crossing < b->count) {
-    pthread_cond_wait(&b->complete, &b->mutex);
-  } else {
-    pthread_cond_broadcast(&b->complete);
-    /* Reset for next time */
-    b->crossing = 0;
-  }
-  pthread_mutex_unlock(&b->mutex);
-}
-
-/* ################################################################### *
- * STRESS TEST
- * ################################################################### */
-
 static void *test(void *data)
 {
-  int op, val, last = -1;
+  int op, val, len = 0, type, last, p;
   thread_data_t *d = (thread_data_t *)data;
+  const phase_t *ph;
+  hist_t *hist, *tx_sets;
+  int stamp = (d->trace.trace->format == TRACE_BINARY);
+  uint64_t arrival, t0 = 0;
+  uint32_t tag = 0;
+  long n, n0;
+  memtrace_t mt;
+  perf_group_t pg;
+  perf_counts_t pc0, pc1;
+  int counting = 0, sample = 0, queue = 0;
+
+  if (d->memtrace != NULL) {
+    /* Accesses are tagged with the sequence number of the current op */
+    memtrace_init(&mt, d->memtrace, d->trace.tid, &d->trace.seq);
+    memtrace_tls = &mt;
+  }
+  if (d->numa_bind)
+    alloc_thread_node(d->node);
+  /* Opened disabled: only the measured phases are counted */
+  if (d->perf != NULL)
+    perf_open(&pg, d->perf, 0);
+  /* Write-backs are logged with the op they belong to */
+  if (pmem_logging)
+    pmem_log.seq = &d->trace.seq;
+  last = d->resume != NULL ? d->resume->last : -1;
+
+  for (p = d->first_phase; p < d->nb_phases; p++) {
+    ph = &d->phases[p];
+    d->ops = (ph->duration > 0) ? -1 : ph->ops;
+    d->range = ph->range;
+    d->update = ph->update;
+    d->scan = ph->scan;
+    d->scan_len = &ph->scan_len;
+    d->alternate = ph->alternate;
+    d->interval = (ph->rate > 0) ? (uint64_t)(1e9 * d->nb_threads / ph->rate) : 0;
+    d->poisson = ph->poisson;
+    d->dist = &ph->dist;
+    dist_state_init(d->dist, &d->dist_state, d->trace.tid, d->nb_threads);
+    /* Warmup ops are run and timed, but not recorded */
+    hist = ph->warmup ? NULL : d->hist;
+    tx_sets = ph->warmup ? NULL : d->tx_sets;
+    /* Lookups are queued in a closed loop only: paced ops run on arrival */
+    queue = (d->interleave > 0 && d->interval == 0);
+    n0 = 0;
+    if (d->resume != NULL && p == d->first_phase) {
+      /* Back where the checkpoint left the phase */
+      n0 = d->resume->n;
+      d->dist_state = d->resume->dist_state;
+    }
+    /* Everybody is done with the previous phase and waits for this one */
+    if (d->markers && d->trace.tid == 0 && n0 == 0) {
+      d->trace.now = trace_now();
+      trace_op(&d->trace, TRACE_OP_PHASE, p);
+    }
 
-  /* Wait on barrier */
-  barrier_cross(d->barrier);
-
-  while (d->ops--) {
-    op = rand_range(100, d->seed);
-    if (op < d->update) {
-      if (d->alternate) {
-        /* Alternate insertions and removals */
-        if (last < 0) {
-          /* Add random value */
-          val = rand_range(d->range, d->seed) + 1;
+    /* Wait on barrier */
+    barrier_cross(d->barrier);
+    if ((counting = (d->perf != NULL && !ph->warmup)))
+      perf_enable(&pg);
+
+    /* A negative op count runs until stop is set */
+    arrival = trace_now();
+    for (n = n0; (d->ops < 0 || n < d->ops) && !stop; n++) {
+      /* Only phases of a fixed op count bring every thread to the same n */
+      if (d->ckpt != NULL && d->ops > 0 && n > n0 && n % d->ckpt->every == 0)
+        checkpoint(d, hist, p, n, last);
+      if (d->shard != NULL)
+        shard_serve(d->shard, d->trace.tid);
+      if (d->interval != 0) {
+        /* Open loop: ops are issued at their arrival time, not back to back */
+        pace_wait(arrival);
+        d->trace.now = arrival;
+        arrival += pace_next(d);
+      } else if (stamp) {
+        d->trace.now = trace_now();
+      }
+      op = rand_range(100, &d->rng);
+      /* Queued lookups run before an update or a scan, or once enough */
+      if (d->nb_queued > 0 && (op < d->update + d->scan || d->nb_queued == INTERLEAVE_QUEUE))
+        run_queued(d, hist);
+      /* Counted alone, outside the latency of the op */
+      if ((sample = (counting && !queue && n % PERF_OP_PERIOD == 0)))
+        perf_read(&pg, &pc0);
+      if (hist != NULL && d->interval == 0)
+        t0 = stats_ticks();
+      if (op < d->update) {
+        if (d->alternate) {
+          /* Alternate insertions and removals */
+          if (last < 0) {
+            /* Add random value */
+            val = dist_next(d->dist, &d->dist_state, &d->rng);
           
-          if (set_add(d->set, val)) {
-            d->diff++;
-            last = val;
-          }
-          d->nb_add++;
+            if (set_op(d, TRACE_OP_ADD, val, 0)) {
+              d->diff++;
+              last = val;
+              dist_inserted(&d->dist_state, val);
+            }
+            d->nb_add++;
+            type = TRACE_OP_ADD;
+          } else {
+            /* Remove last value */
+            if (set_op(d, TRACE_OP_REMOVE, last, 0))
+              d->diff--;
           
-          fprintf(stderr, "0 - %d\n", val);
+            d->nb_remove++;
+            type = TRACE_OP_REMOVE;
+            val = last;
+            last = -1;
+          }
         } else {
-          /* Remove last value */
-          if (set_remove(d->set, last))
-            d->diff--;
+          /* Randomly perform insertions and removals */
+          val = dist_next(d->dist, &d->dist_state, &d->rng);
+          if ((op & 0x01) == 0) {
+            /* Add random value */
           
-          d->nb_remove++;
-          last = -1;
-          fprintf(stderr, "1 - %d\n", val);
+            if (set_op(d, TRACE_OP_ADD, val, 0)) {
+              d->diff++;
+              dist_inserted(&d->dist_state, val);
+            }
+            d->nb_add++;
+            type = TRACE_OP_ADD;
+          } else {
+            /* Remove random value */
+            if (set_op(d, TRACE_OP_REMOVE, val, 0))
+              d->diff--;
+            d->nb_remove++;
+            type = TRACE_OP_REMOVE;
+          }
         }
+      } else if (op < d->update + d->scan) {
+        /* Scan forward from a random lower bound */
+        val = dist_next(d->dist, &d->dist_state, &d->rng);
+        len = len_dist_next(d->scan_len, &d->rng);
+        d->nb_scanned += set_op(d, TRACE_OP_SCAN, val, len);
+        d->nb_scan++;
+        type = TRACE_OP_SCAN;
       } else {
-        /* Randomly perform insertions and removals */
-        val = rand_range(d->range, d->seed) + 1;
-        if ((op & 0x01) == 0) {
-          /* Add random value */
-          
-          if (set_add(d->set, val))
-            d->diff++;
-          d->nb_add++;
-          
-          fprintf(stderr, "0 - %d\n", val);
-        } else {
-          /* Remove random value */
-          if (set_remove(d->set, val))
-            d->diff--;
-          d->nb_remove++;
-          fprintf(stderr, "1 - %d\n", val);
-        }
-      }
-    } else {
-      /* Look for random value */
-      val = rand_range(d->range, d->seed) + 1;
+        /* Look for random value */
+        val = dist_next(d->dist, &d->dist_state, &d->rng);
       
-      if (set_contains(d->set, val))
-        d->nb_found++;
+        if (queue) {
+          /* Recorded now, run with the lookups that follow */
+          d->queued_t0[d->nb_queued] = t0;
+          d->queued[d->nb_queued++] = val;
+        } else if (set_op(d, TRACE_OP_CONTAINS, val, 0))
+          d->nb_found++;
       
-      d->nb_contains++;
-      fprintf(stderr, "2 - %d\n", val);
+        d->nb_contains++;
+        type = TRACE_OP_CONTAINS;
+      }
+      if (hist != NULL && !(queue && type == TRACE_OP_CONTAINS)) {
+        /* Open loop latency counts from the scheduled arrival */
+        if (d->interval != 0)
+          hist_record(&hist[type], trace_now() - d->trace.now);
+        else
+          hist_record(&hist[type], (uint64_t)((stats_ticks() - t0) * stats_ns_per_tick));
+      }
+      if (sample) {
+        perf_read(&pg, &pc1);
+        perf_accumulate(&d->perf_ops[type], &pc0, &pc1);
+        d->perf_ops[type].ops++;
+      }
+      if (tx_sets != NULL && !(queue && type == TRACE_OP_CONTAINS)) {
+        /* Words accessed by the op's committed transaction */
+        hist_record(&tx_sets[type], tm_stats.reads);
+        hist_record(&tx_sets[NB_OP_TYPES + type], tm_stats.writes);
+      }
+      if (d->shard != NULL)
+        tag = TRACE_OP_SHARDED(d->served_by);
+      if (type == TRACE_OP_SCAN)
+        trace_op(&d->trace, TRACE_OP_SCAN | (len << TRACE_OP_BITS) | tag, val);
+      else
+        trace_op(&d->trace, type | tag, val);
+    }
+    if (d->nb_queued > 0)
+      run_queued(d, hist);
+    if (counting) {
+      perf_disable(&pg);
+      d->perf_total.ops += n;
     }
+
+    /* Delegated ops are served until every thread is done */
+    if (d->shard != NULL)
+      shard_quiesce(d->shard, d->trace.tid, p);
+
+    /* Wait for the whole phase to end */
+    barrier_cross(d->barrier);
+  }
+  trace_buf_flush(&d->trace);
+  if (pmem_logging)
+    pmem_log.seq = NULL;
+  d->nb_flush = pmem_stats.flushes;
+  d->nb_fence = pmem_stats.fences;
+  d->tm = tm_stats;
+  tm_thread_fini();
+  ebr_thread_fini();
+  d->ebr = ebr_stats;
+  d->shards = shard_stats;
+  if (d->perf != NULL) {
+    n = d->perf_total.ops;
+    perf_read(&pg, &d->perf_total);
+    d->perf_total.ops = n;
+    perf_close(&pg);
+  }
+  if (d->memtrace != NULL) {
+    memtrace_tls = NULL;
+    d->nb_access = mt.nb_access;
+    memtrace_destroy(&mt);
   }
 
   return NULL;
@@ -357,31 +460,110 @@ int main(int argc, char **argv)
     {"range",                     required_argument, NULL, 'r'},
     {"seed",                      required_argument, NULL, 's'},
     {"update-rate",               required_argument, NULL, 'u'},
+    {"scan-rate",                 required_argument, NULL, 'S'},
+    {"scan-length",               required_argument, NULL, 'K'},
+    {"format",                    required_argument, NULL, 'f'},
+    {"per-thread",                required_argument, NULL, 'p'},
+    {"set",                       required_argument, NULL, 'b'},
+    {"alloc",                     required_argument, NULL, 'm'},
+    {"arena-size",                required_argument, NULL, 'M'},
+    {"pmem",                      required_argument, NULL, 'P'},
+    {"memtrace",                  required_argument, NULL, 'T'},
+    {"rng",                       required_argument, NULL, 'g'},
+    {"dist",                      required_argument, NULL, 'd'},
+    {"duration",                  required_argument, NULL, 'D'},
+    {"rate",                      required_argument, NULL, 'R'},
+    {"latency",                   no_argument,       NULL, 'l'},
+    {"bulk-load",                 no_argument,       NULL, 'L'},
+    {"workload",                  required_argument, NULL, 'W'},
+    {"compress",                  required_argument, NULL, 'Z'},
+    {"pin",                       required_argument, NULL, 'c'},
+    {"numa-mem",                  required_argument, NULL, 'N'},
+    {"tm",                        required_argument, NULL, 'X'},
+    {"perf",                      required_argument, NULL, 'E'},
+    {"shard",                     required_argument, NULL, 'H'},
+    {"interleave",                required_argument, NULL, 'G'},
+    {"crash",                     no_argument,       NULL, 'C'},
+    {"checkpoint",                required_argument, NULL, 'k'},
+    {"checkpoint-every",          required_argument, NULL, 'e'},
+    {"resume",                    required_argument, NULL, 'J'},
     {NULL, 0, NULL, 0}
   };
 
   intset_t *set;
-  int i, c, val, size, ret;
-  unsigned long reads, updates;
+  const set_ops_t *set_ops = NULL;
+  int i, c, size, ret;
+  unsigned long reads, updates, scans, n;
+  double elapsed;
   thread_data_t *data;
   pthread_t *threads;
   pthread_attr_t attr;
   barrier_t barrier;
-//  struct timeval start, end;
-//  struct timespec timeout;
+  trace_t trace;
+  trace_buf_t main_trace;
+  trace_format_t format = TRACE_TEXT;
+  codec_t codec = { CODEC_NONE, 0 };
+  char *prefix = NULL;
+  alloc_kind_t alloc = ALLOC_MALLOC;
+  int arena_mb = DEFAULT_ARENA_SIZE;
+  char *pmem = NULL;
+  char *memtrace = NULL;
+  rng_kind_t rng = RNG_ERAND48;
+  dist_t dist = { DIST_UNIFORM };
+  dist_state_t main_dist;
+  val_t *vals;
+  int *added, nb_vals, nb_added, uniform;
+  struct timespec start, end, timeout, phase_start;
+  hist_t *lat = NULL;
+  int latency = 0;
+  int bulk = 0;
+  static place_t place;
+  char *workload = NULL;
+  static phase_t phases[PHASE_MAX];
+  phase_t main_phase;
+  int nb_phases, ph;
+  unsigned long phase_txs, txs;
+  double phase_ms;
+  int duration = DEFAULT_DURATION;
+  double rate = DEFAULT_RATE;
+  int poisson = 0;
+  char *p;
   int ops = DEFAULT_OPNUM;
   int initial = DEFAULT_INITIAL;
   int nb_threads = DEFAULT_NB_THREADS;
   int range = DEFAULT_RANGE;
   int seed = DEFAULT_SEED;
   int update = DEFAULT_UPDATE;
+  int scan = DEFAULT_SCAN;
+  len_dist_t scan_len;
   int alternate = 1;
-  sigset_t block_set;
-
+  tm_kind_t tm = TM_STM;
+  int tm_opt = 0;
+  hist_t *tx_sets = NULL;
+  unsigned long commits, aborts, fallbacks, conflicts, capacity;
+  unsigned long retired, freed, advances, pending;
+  uint64_t reclaim_ns;
+  static perf_spec_t perf;
+  int perf_opt = 0;
+  perf_group_t uncore;
+  perf_counts_t perf_total, perf_ops[NB_OP_TYPES];
+  shard_cfg_t shard = { SHARD_NONE, SHARD_THREAD, SHARD_DIRECT };
+  int interleave = DEFAULT_INTERLEAVE;
+  int crash = 0;
+  crash_stats_t crash_st;
+  char *ckpt_path = NULL;
+  long ckpt_every = DEFAULT_CHECKPOINT_EVERY;
+  char *resume_path = NULL;
+  static ckpt_t ckpt, resume;
+  int resuming = 0, first_phase = 0, resumed;
+  shard_set_t *shards = NULL;
+  unsigned long local, remote, delegated;
+
+  len_dist_parse(XSTR(DEFAULT_SCAN_LENGTH), &scan_len);
   while(1) {
     i = 0;
-    c = getopt_long(argc, argv, "ha"
-                    "o:i:n:r:s:u:"
+    c = getopt_long(argc, argv, "halLC"
+                    "o:i:n:r:s:u:f:p:b:m:M:P:T:g:d:D:R:c:N:W:Z:S:K:X:E:H:G:k:e:J:"
                     , long_options, &i);
 
     if(c == -1)
@@ -407,17 +589,112 @@ int main(int argc, char **argv)
               "        Do not alternate insertions and removals\n"
 	            "  -o, --operations <int>\n"
               "        Number of operations (default=" XSTR(DEFAULT_OPNUM) ")\n"
+              "  -D, --duration <int>\n"
+              "        Run for <int> ms instead of a number of operations\n"
+              "        (0=use -o, default=" XSTR(DEFAULT_DURATION) ")\n"
+              "  -l, --latency\n"
+              "        Record per-op latency histograms (p50/p99/p99.9 by op type)\n"
+              "  -R, --rate <ops/s>[:poisson]\n"
+              "        Open-loop generation: issue ops at this total rate, evenly\n"
+              "        paced or with exponential inter-arrival times\n"
+              "        (0=back to back, default=" XSTR(DEFAULT_RATE) ")\n"
+              "  -W, --workload <file>\n"
+              "        Run the phases listed in <file>, one per line: a name, then\n"
+              "        ops=, duration=, update=, scan=, scanlen=, alternate=, range=,\n"
+              "        dist=, rate= or warmup= settings (unset ones come from the\n"
+              "        options above; warmup=1 phases are left out of the histograms)\n"
               "  -i, --initial-size <int>\n"
               "        Number of elements to insert before test (default=" XSTR(DEFAULT_INITIAL) ")\n"
+              "  -L, --bulk-load\n"
+              "        Sample the initial keys without replacement, sort them and\n"
+              "        build the set in one pass (changes the initial contents)\n"
               "  -n, --num-threads <int>\n"
               "        Number of threads (default=" XSTR(DEFAULT_NB_THREADS) ")\n"
+              "  -c, --pin <none|compact|scatter|list:<cpus>>\n"
+              "        Pin threads to CPUs: filling one NUMA node first, round-robin\n"
+              "        across nodes, or from a list such as 0-3,8 (default=" XSTR(DEFAULT_PIN) ")\n"
+              "  -N, --numa-mem <first-touch|bind|interleave>\n"
+              "        Node memory policy: pages local to the first writer, arena slabs\n"
+              "        bound to the allocating thread's node (--alloc=arena), or the\n"
+              "        arena interleaved across nodes (default=" XSTR(DEFAULT_NUMA_MEM) ")\n"
               "  -r, --range <int>\n"
               "        Range of integer values inserted in set (default=" XSTR(DEFAULT_RANGE) ")\n"
               "  -s, --seed <int>\n"
               "        RNG seed (0=time-based, default=" XSTR(DEFAULT_SEED) ")\n"
+              "  -g, --rng <erand48|xoshiro|pcg>\n"
+              "        Random generator: erand48, 4-lane SIMD xoshiro256** or pcg32\n"
+              "        (default=" XSTR(DEFAULT_RNG) ")\n"
+              "  -d, --dist <spec>\n"
+              "        Key distribution (default=" XSTR(DEFAULT_DIST) "):\n"
+              "          uniform\n"
+              "          zipf[:<theta>]        Zipfian, 0 < theta < 1 (default 0.99)\n"
+              "          hotspot:<frac>:<prob> <prob> of accesses to the first\n"
+              "                                <frac> of the range\n"
+              "          sequential            Each thread cycles through the range\n"
+              "          latest[:<theta>]      Zipfian below the thread's latest insert\n"
               "  -u, --update-rate <int>\n"
               "        Percentage of update transactions (default=" XSTR(DEFAULT_UPDATE) ")\n"
+              "  -S, --scan-rate <int>\n"
+              "        Percentage of range scans, taken from the reads (default=" XSTR(DEFAULT_SCAN) ")\n"
+              "  -K, --scan-length <spec>\n"
+              "        Keys per scan (default=" XSTR(DEFAULT_SCAN_LENGTH) "):\n"
+              "          <n>                   Always n\n"
+              "          uniform:<max>         Uniform in [1;max]\n"
+              "          zipf:<max>[:<theta>]  Zipfian in [1;max], short scans first\n"
+              "  -f, --format <text|binary>\n"
+              "        Trace output format (default=" XSTR(DEFAULT_FORMAT) ")\n"
+              "  -Z, --compress <none|gzip|zstd|lz4>[:<level>]\n"
+              "        Compress the trace on a background thread\n"
+              "        (default=" XSTR(DEFAULT_COMPRESS) "; zstd and lz4 need make ZSTD=1 / LZ4=1)\n"
+              "  -p, --per-thread <prefix>\n"
+              "        Write one binary stream per thread to <prefix>.<tid>.bin\n"
+              "        and the initial set to <prefix>.init.bin (see tracemerge)\n"
+              "  -m, --alloc <malloc|pool|arena|huge>\n"
+              "        Node allocator: malloc per node, per-thread slab pools,\n"
+              "        pools carved from one contiguous arena, or a huge page\n"
+              "        backed arena (default=" XSTR(DEFAULT_ALLOC) ")\n"
+              "  -M, --arena-size <int>\n"
+              "        Address space reserved for the arena, in MB (default=" XSTR(DEFAULT_ARENA_SIZE) ")\n"
+              "  -P, --pmem <file>\n"
+              "        Allocate nodes from a pool of -M MB mapped from <file> (use a\n"
+              "        DAX file system) and write back + fence every persistent store\n"
+              "  -T, --memtrace <prefix>\n"
+              "        Record the loads and stores of each operation to\n"
+              "        <prefix>.<tid>.mem (see memdump)\n"
+              "  -X, --tm <stm|htm>\n"
+              "        Transactions of the tx backend: word-based STM, or Intel RTM\n"
+              "        falling back to a global lock (default=" XSTR(DEFAULT_TM) ")\n"
+              "  -E, --perf <default|<event>,...>\n"
+              "        Count hardware events in the measured phases, per thread and\n"
+              "        per op type (1 op in " XSTR(PERF_OP_PERIOD) "): cycles, instructions, llc-loads,\n"
+              "        llc-misses, dtlb-misses, node-misses, branch-misses, raw:<hex>\n"
+              "        or <pmu>/<hex> (uncore, e.g. uncore_imc_0/0x304); default is\n"
+              "        " PERF_DEFAULT "\n"
+              "  -H, --shard <none|range|hash>[:thread|node][:direct|delegate]\n"
+              "        Partition the keys into sub-sets of the backend, one per thread\n"
+              "        or per NUMA node of the pinned threads; ops on another thread's\n"
+              "        shard run directly, or on its owner (default=" XSTR(DEFAULT_SHARD) ")\n"
+              "  -G, --interleave <width>\n"
+              "        Queue consecutive lookups (up to " XSTR(INTERLEAVE_QUEUE) ") and run them with\n"
+              "        up to <width> walks in flight, each prefetching its next node\n"
+              "        (0=one by one, default=" XSTR(DEFAULT_INTERLEAVE) ")\n"
+              "  -C, --crash\n"
+              "        With --pmem, log every write-back, then simulate a crash after\n"
+              "        each one and check that the set recovers (one thread)\n"
+              "  -k, --checkpoint <file>\n"
+              "        Save the set once populated, then the whole run every\n"
+              "        --checkpoint-every ops of each thread, to <file>\n"
+              "  -e, --checkpoint-every <int>\n"
+              "        Ops per thread between checkpoints, in phases of a fixed op\n"
+              "        count (0=initial set only, default=" XSTR(DEFAULT_CHECKPOINT_EVERY) ")\n"
+              "  -J, --resume <file>\n"
+              "        Go on from a checkpoint with the same options, cutting the\n"
+              "        trace back to it (2>> the same file); from an initial set\n"
+              "        checkpoint, load that set instead of populating\n"
+              "  -b, --set <name>\n"
+              "        Set backend (default=" XSTR(DEFAULT_SET) "):\n"
          );
+       set_print_backends(stdout);
        exit(0);
      case 'a':
        alternate = 0;
@@ -431,6 +708,21 @@ int main(int argc, char **argv)
      case 'n':
        nb_threads = atoi(optarg);
        break;
+     case 'W':
+       workload = optarg;
+       break;
+     case 'c':
+       if (place_parse_pin(optarg, &place) != 0) {
+         printf("Unknown pinning policy: %s\n", optarg);
+         exit(1);
+       }
+       break;
+     case 'N':
+       if (place_parse_mem(optarg, &place) != 0) {
+         printf("Unknown memory policy: %s\n", optarg);
+         exit(1);
+       }
+       break;
      case 'r':
        range = atoi(optarg);
        break;
@@ -440,6 +732,116 @@ int main(int argc, char **argv)
      case 'u':
        update = atoi(optarg);
        break;
+     case 'S':
+       scan = atoi(optarg);
+       break;
+     case 'K':
+       if (len_dist_parse(optarg, &scan_len) != 0 || scan_len.max > TRACE_SCAN_MAX) {
+         printf("Invalid scan length: %s\n", optarg);
+         exit(1);
+       }
+       break;
+     case 'f':
+       if (trace_parse_format(optarg, &format) != 0) {
+         printf("Unknown trace format: %s\n", optarg);
+         exit(1);
+       }
+       break;
+     case 'Z':
+       if (codec_parse(optarg, &codec) != 0) {
+         printf("Unknown or unavailable codec: %s\n", optarg);
+         exit(1);
+       }
+       break;
+     case 'p':
+       prefix = optarg;
+       break;
+     case 'm':
+       if (alloc_parse(optarg, &alloc) != 0) {
+         printf("Unknown allocator: %s\n", optarg);
+         exit(1);
+       }
+       break;
+     case 'M':
+       arena_mb = atoi(optarg);
+       break;
+     case 'P':
+       pmem = optarg;
+       break;
+     case 'T':
+       memtrace = optarg;
+       break;
+     case 'l':
+       latency = 1;
+       break;
+     case 'L':
+       bulk = 1;
+       break;
+     case 'D':
+       duration = atoi(optarg);
+       break;
+     case 'R':
+       rate = strtod(optarg, &p);
+       if (strcmp(p, ":poisson") == 0) {
+         poisson = 1;
+       } else if (*p != '\0') {
+         printf("Invalid rate: %s\n", optarg);
+         exit(1);
+       }
+       break;
+     case 'd':
+       if (dist_parse(optarg, &dist) != 0) {
+         printf("Invalid key distribution: %s\n", optarg);
+         exit(1);
+       }
+       break;
+     case 'g':
+       if (rng_parse(optarg, &rng) != 0) {
+         printf("Unknown random generator: %s\n", optarg);
+         exit(1);
+       }
+       break;
+     case 'X':
+       if (tm_parse(optarg, &tm) != 0) {
+         printf("Unknown transaction mode: %s\n", optarg);
+         exit(1);
+       }
+       tm_opt = 1;
+       break;
+     case 'E':
+       if (perf_parse(optarg, &perf) != 0) {
+         printf("Invalid perf events: %s\n", optarg);
+         exit(1);
+       }
+       perf_opt = 1;
+       break;
+     case 'H':
+       if (shard_parse(optarg, &shard) != 0) {
+         printf("Invalid sharding: %s\n", optarg);
+         exit(1);
+       }
+       break;
+     case 'G':
+       interleave = atoi(optarg);
+       break;
+     case 'C':
+       crash = 1;
+       break;
+     case 'k':
+       ckpt_path = optarg;
+       break;
+     case 'e':
+       ckpt_every = atol(optarg);
+       break;
+     case 'J':
+       resume_path = optarg;
+       break;
+     case 'b':
+       if ((set_ops = set_lookup(optarg)) == NULL) {
+         printf("Unknown set backend: %s\n", optarg);
+         exit(1);
+       }
+       break;
      case '?':
        printf("Use -h or --help for help\n");
        exit(0);
@@ -453,22 +855,191 @@ int main(int argc, char **argv)
   assert(nb_threads > 0);
   assert(range > 0 && range >= initial);
   assert(update >= 0 && update <= 100);
+  assert(scan >= 0 && update + scan <= 100);
+  assert(arena_mb > 0);
+  assert(duration >= 0);
+  assert(rate >= 0);
+  assert(interleave >= 0 && interleave <= SET_INTERLEAVE_MAX);
+  assert(ckpt_every >= 0);
+
+  if (set_ops == NULL)
+    set_ops = set_lookup(XSTR(DEFAULT_SET));
+  /* With delegation, it depends on the threads per shard (see below) */
+  if (nb_threads > 1 && !set_ops->concurrent &&
+      !(shard.part != SHARD_NONE && shard.route == SHARD_DELEGATE))
+    printf("WARNING: set backend %s is not thread-safe\n", set_ops->name);
+  if (pmem != NULL && !set_ops->persistent)
+    printf("WARNING: set backend %s does not flush its stores\n", set_ops->name);
+  if (tm_opt && !set_ops->transactional)
+    printf("WARNING: set backend %s does not run transactions\n", set_ops->name);
+  if ((memtrace != NULL && !MEMTRACE_BUILT) || (pmem != NULL && !PMEM_BUILT)) {
+    printf("This build has no %s hooks (made with %s=0)\n",
+           pmem != NULL ? "pmem" : "memtrace", pmem != NULL ? "PMEM" : "MEMTRACE");
+    exit(1);
+  }
+  if (crash) {
+    if (pmem == NULL || set_ops->recover == NULL || shard.part != SHARD_NONE) {
+      printf("Crash checking needs --pmem, no --shard and a backend with recovery\n");
+      exit(1);
+    }
+    if (nb_threads > 1) {
+      printf("WARNING: crash checking runs one thread\n");
+      nb_threads = 1;
+    }
+  }
+  if (ckpt_path != NULL &&
+      (codec.kind != CODEC_NONE || (shard.part != SHARD_NONE && shard.route == SHARD_DELEGATE))) {
+    printf("Checkpoints need an uncompressed trace and no delegated shards\n");
+    exit(1);
+  }
+  if (interleave > 0 && shard.part != SHARD_NONE) {
+    printf("WARNING: lookups are not interleaved across shards\n");
+    interleave = 0;
+  }
+  if (interleave > 0 && memtrace != NULL) {
+    /* A batch's loads would all be tagged with the op running it */
+    printf("WARNING: lookups are not interleaved with --memtrace\n");
+    interleave = 0;
+  }
+
+  if (prefix != NULL && format != TRACE_BINARY) {
+    printf("WARNING: per-thread traces are always binary\n");
+    format = TRACE_BINARY;
+  }
+
+  /* Options set the defaults of every phase */
+  snprintf(main_phase.name, sizeof(main_phase.name), "main");
+  main_phase.ops = ops;
+  main_phase.duration = duration;
+  main_phase.update = update;
+  main_phase.scan = scan;
+  main_phase.scan_len = scan_len;
+  main_phase.alternate = alternate;
+  main_phase.range = range;
+  main_phase.dist = dist;
+  main_phase.rate = rate;
+  main_phase.poisson = poisson;
+  main_phase.warmup = 0;
+  nb_phases = 1;
+  if (workload != NULL)
+    nb_phases = phase_load(workload, &main_phase, phases);
+  for (ph = 0; ph < nb_phases; ph++) {
+    if ((workload != NULL ? phases[ph].scan : scan) > 0 && set_ops->scan == NULL) {
+      printf("Set backend %s does not support range scans\n", set_ops->name);
+      exit(1);
+    }
+    if ((workload != NULL ? phases[ph].scan : scan) > 0 && shard.part == SHARD_HASH) {
+      printf("Hash shards do not support range scans\n");
+      exit(1);
+    }
+  }
 
-  printf("Operations   : %d\n", ops);
-  printf("Initial size : %d\n", initial);
+  if (resume_path != NULL) {
+    ckpt_read(&resume, resume_path);
+    initial = (int)resume.h.nb_keys;
+    bulk = 0;
+    /* Without threads, it is only an initial set */
+    if ((resuming = (resume.h.nb_threads > 0))) {
+      if ((int)resume.h.nb_threads != nb_threads || (int)resume.h.phase >= nb_phases ||
+          codec.kind != CODEC_NONE) {
+        printf("Checkpoint %s was taken with %u threads in phase %u, uncompressed\n",
+               resume_path, resume.h.nb_threads, resume.h.phase);
+        exit(1);
+      }
+      first_phase = resume.h.phase;
+    }
+  }
+
+  if (duration > 0)
+    printf("Duration     : %d ms\n", duration);
+  else
+    printf("Operations   : %d\n", ops);
+  if (rate > 0)
+    printf("Rate         : %g ops/s (%s)\n", rate, poisson ? "poisson" : "paced");
+  printf("Initial size : %d%s\n", initial, bulk ? " (bulk load)" : "");
   printf("Nb threads   : %d\n", nb_threads);
+  place_init(&place);
+  printf("Placement    : ");
+  place_print(&place, stdout);
+  printf("\n");
   printf("Value range  : %d\n", range);
   printf("Seed         : %d\n", seed);
+  printf("Generator    : %s\n", rng_name(rng));
+  printf("Distribution : ");
+  dist_print(&dist, stdout);
+  printf("\n");
   printf("Update rate  : %d\n", update);
+  printf("Scan rate    : %d\n", scan);
+  if (scan > 0) {
+    printf("Scan length  : ");
+    len_dist_print(&scan_len, stdout);
+    printf("\n");
+  }
   printf("Alternate    : %d\n", alternate);
-  printf("Type sizes   : int=%d/long=%d/ptr=%d/word=%d\n",
+  if (workload != NULL) {
+    printf("Workload     : %s (%d phases)\n", workload, nb_phases);
+    for (ph = 0; ph < nb_phases; ph++) {
+      printf("  Phase %-5d: ", ph);
+      phase_print(&phases[ph], stdout);
+      printf("\n");
+    }
+  }
+  printf("Set backend  : %s\n", set_ops->name);
+  if (shard.part != SHARD_NONE) {
+    printf("Sharding     : ");
+    shard_print(&shard, stdout);
+    printf("\n");
+  }
+  if (set_ops->transactional)
+    printf("Transactions : %s\n", tm_name(tm));
+  if (interleave > 0)
+    printf("Interleave   : %d%s\n", interleave,
+           set_ops->contains_interleaved == NULL ? " (backend batch)" : "");
+  printf("Allocator    : %s\n", pmem != NULL ? "pmem" : alloc_name(alloc));
+  printf("Trace format : %s\n", format == TRACE_BINARY ? "binary" : "text");
+  if (codec.kind != CODEC_NONE)
+    printf("Compression  : %s:%d\n", codec_name(codec.kind), codec.level);
+  if (prefix != NULL)
+    printf("Trace prefix : %s\n", prefix);
+  if (ckpt_path != NULL && ckpt_every > 0)
+    printf("Checkpoint   : %s (every %ld ops)\n", ckpt_path, ckpt_every);
+  else if (ckpt_path != NULL)
+    printf("Checkpoint   : %s (initial set)\n", ckpt_path);
+  if (resuming)
+    printf("Resume       : %s (phase %u, op %lu)\n", resume_path, resume.h.phase,
+           (unsigned long)resume.threads[0].n);
+  else if (resume_path != NULL)
+    printf("Initial set  : %s (%lu keys)\n", resume_path, (unsigned long)resume.h.nb_keys);
+  if (perf_opt) {
+    perf_init(&perf);
+    perf_opt = (perf.nb > 0);
+    printf("Counters     : ");
+    perf_print(&perf, stdout);
+    printf("\n");
+  }
+  printf("Type sizes   : int=%d/long=%d/ptr=%d/word=%d/key=%d\n",
          (int)sizeof(int),
          (int)sizeof(long),
          (int)sizeof(void *),
-         (int)sizeof(size_t));
+         (int)sizeof(size_t),
+         (int)sizeof(val_t));
+  if (!MEMTRACE_BUILT || !PMEM_BUILT)
+    printf("Compiled out :%s%s\n", MEMTRACE_BUILT ? "" : " memtrace", PMEM_BUILT ? "" : " pmem");
+
+  if (latency) {
+    stats_init();
+    /* Per thread and merged histograms, then all op types together */
+    if ((lat = (hist_t *)calloc((nb_threads + 1) * NB_OP_TYPES + 1, sizeof(hist_t))) == NULL) {
+      perror("calloc");
+      exit(1);
+    }
+  }
 
-//  timeout.tv_sec = duration / 1000;
-//  timeout.tv_nsec = (duration % 1000) * 1000000;
+  if (set_ops->transactional &&
+      (tx_sets = (hist_t *)calloc((nb_threads + 1) * 2 * NB_OP_TYPES, sizeof(hist_t))) == NULL) {
+    perror("calloc");
+    exit(1);
+  }
 
   if ((data = (thread_data_t *)malloc(nb_threads * sizeof(thread_data_t))) == NULL) {
     perror("malloc");
@@ -484,33 +1055,137 @@ int main(int argc, char **argv)
   else
     srand(seed);
 
-  set = set_new();
+  if (pmem != NULL) {
+    pmem_logging = crash;
+    pmem_init(pmem, arena_mb);
+    printf("Pmem pool    : %s (%d MB, %s)\n", pmem, arena_mb, pmem_flush_name());
+    if (crash)
+      printf("Crash check  : every write-back\n");
+  } else {
+    alloc_init(alloc, arena_mb);
+  }
+  alloc_place(place.mem, place.nb_nodes);
+  /* The initial set lives on thread 0's node */
+  if (place.mem == MEM_BIND)
+    alloc_thread_node(place_node(&place, place_cpu(&place, 0)));
+  if (shard.part != SHARD_NONE) {
+    set = shard_new(&shard, set_ops, range, nb_threads, &place);
+    shards = (shard_set_t *)set;
+    printf("Shards       : %d\n", shards->nb);
+    if (shard.unit == SHARD_NODE && place.pin == PIN_NONE)
+      printf("WARNING: per-node shards need pinned threads (--pin)\n");
+    if (nb_threads > 1 && !set_ops->concurrent && shard.route == SHARD_DELEGATE &&
+        !shard_exclusive(shards))
+      printf("WARNING: set backend %s is not thread-safe\n", set_ops->name);
+  } else {
+    set = set_new(set_ops);
+  }
+
+  trace_open(&trace, NULL, format, prefix, &codec, resuming);
+  trace.pin = place.pin;
+  trace.mem = place.mem;
+  trace.nb_nodes = place.nb_nodes;
+  trace.nb_shards = shards != NULL ? shards->nb : 0;
+  if (resuming) {
+    /* The trace as it was at the checkpoint, whatever the run wrote after */
+    resumed = trace_resume(&trace, resume.h.offset);
+    printf("Trace        : %s\n", resumed ? "cut back to the checkpoint" :
+           "shorter than at the checkpoint, only the rest is written");
+  } else {
+    trace_begin(&trace, resume_path != NULL ? resume.h.nb_keys : (uint64_t)initial);
+  }
+  trace_buf_init(&main_trace, &trace, TRACE_TID_MAIN, -1, -1);
 
   stop = 0;
 
   /* Thread-local seed for main thread */
-  rand_init(main_seed);
+  rng_init(&main_rng, rng);
+  dist_init(&dist, range);
+  dist_state_init(&dist, &main_dist, 0, 1);
+  if (workload == NULL) {
+    phases[0] = main_phase;
+    phases[0].dist = dist;
+  }
 
   /* Init STM */
-//  printf("Initializing STM\n");
+  if (set_ops->transactional)
+    tm_init(tm);
 
   if (alternate == 0 && range != initial * 2)
     printf("WARNING: range is not twice the initial set size\n");
 
   /* Populate set */
-  printf("Adding %d entries to set\n", initial);
-  i = 0;
-  while (i < initial) {
-    val = rand_range(range, main_seed) + 1;
-    if (set_add(set, val)) {
-      fprintf(stderr, "%d, ", val);    
-      i++;
+  if (resume_path != NULL) {
+    /* The saved set is sorted: one bulk load */
+    printf("Loading %lu entries from %s\n", (unsigned long)resume.h.nb_keys, resume_path);
+    if (!resuming) {
+      for (i = 0; i < (int)resume.h.nb_keys; i++)
+        trace_initial(&main_trace, resume.keys[i]);
     }
+    set_load(set, resume.keys, (int)resume.h.nb_keys);
+  } else if (bulk) {
+    printf("Adding %d entries to set\n", initial);
+    /* Distinct keys, sorted, linked in one pass */
+    if ((vals = (val_t *)malloc(initial * sizeof(val_t))) == NULL) {
+      perror("malloc");
+      exit(1);
+    }
+    bulk_sample(&dist, &main_dist, &main_rng, range, vals, initial);
+    bulk_sort(vals, initial);
+    for (i = 0; i < initial; i++)
+      trace_initial(&main_trace, vals[i]);
+    set_load(set, vals, initial);
+    free(vals);
+  } else {
+    printf("Adding %d entries to set\n", initial);
+    /* Draw the missing keys in rounds, each added as one sorted batch */
+    if ((vals = (val_t *)malloc(initial * sizeof(val_t))) == NULL ||
+        (added = (int *)malloc(initial * sizeof(int))) == NULL) {
+      perror("malloc");
+      exit(1);
+    }
+    i = 0;
+    uniform = 0;
+    while (i < initial) {
+      nb_vals = initial - i;
+      for (c = 0; c < nb_vals; c++) {
+        if (!uniform)
+          vals[c] = dist_next(&dist, &main_dist, &main_rng);
+        else
+          vals[c] = rand_range(range, &main_rng) + 1;
+      }
+      nb_added = set_add_batch(set, vals, nb_vals, added);
+      for (c = 0; c < nb_vals; c++) {
+        if (added[c]) {
+          trace_initial(&main_trace, vals[c]);
+          dist_inserted(&main_dist, vals[c]);
+        }
+      }
+      i += nb_added;
+      uniform = (nb_added * POPULATE_RETRIES < nb_vals);
+    }
+    free(added);
+    free(vals);
   }
-  fprintf(stderr, "\n");    
+  if (!resuming)
+    trace_initial_end(&main_trace);
+  trace_buf_destroy(&main_trace);
+  tm_thread_fini();
   size = set_size(set);
   printf("Set size     : %d\n", size);
-  for (i=0; i<size; i++)
+
+  if (ckpt_path != NULL) {
+    ckpt.path = ckpt_path;
+    ckpt.every = ckpt_every;
+    barrier_init(&ckpt.barrier, nb_threads);
+    if ((ckpt.threads = (ckpt_thread_t *)calloc(nb_threads, sizeof(ckpt_thread_t))) == NULL) {
+      perror("calloc");
+      exit(1);
+    }
+    /* A resumed run already has its initial set saved */
+    if (!resuming)
+      ckpt_write(&ckpt, set, 0, 0, 0);
+  }
 
   /* Access set from all threads */
   barrier_init(&barrier, nb_threads + 1);
@@ -525,11 +1200,40 @@ int main(int argc, char **argv)
     data[i].nb_remove = 0;
     data[i].nb_contains = 0;
     data[i].nb_found = 0;
+    data[i].nb_scan = 0;
+    data[i].nb_scanned = 0;
+    data[i].interleave = interleave;
+    data[i].nb_queued = 0;
+    data[i].nb_runs = 0;
     data[i].diff = 0;
-    data[i].ops = ops;
-    rand_init(data[i].seed);
+    data[i].nb_access = 0;
+    data[i].memtrace = memtrace;
+    data[i].phases = phases;
+    data[i].nb_phases = nb_phases;
+    data[i].markers = (workload != NULL);
+    data[i].nb_threads = nb_threads;
+    data[i].ckpt = (ckpt_path != NULL && ckpt_every > 0) ? &ckpt : NULL;
+    data[i].resume = resuming ? &resume.threads[i] : NULL;
+    data[i].first_phase = first_phase;
+    data[i].hist = latency ? &lat[NB_OP_TYPES * (i + 1)] : NULL;
+    data[i].tx_sets = tx_sets != NULL ? &tx_sets[2 * NB_OP_TYPES * (i + 1)] : NULL;
+    data[i].perf = perf_opt ? &perf : NULL;
+    memset(&data[i].perf_total, 0, sizeof(data[i].perf_total));
+    memset(data[i].perf_ops, 0, sizeof(data[i].perf_ops));
+    rng_init(&data[i].rng, rng);
+    data[i].cpu = place_cpu(&place, i);
+    data[i].node = place_node(&place, data[i].cpu);
+    data[i].numa_bind = (place.mem == MEM_BIND);
+    trace_buf_init(&data[i].trace, &trace, i, data[i].cpu, data[i].node);
+    if (resuming) {
+      data[i].rng = resume.threads[i].rng;
+      trace_buf_resume(&data[i].trace, resume.threads[i].offset, resume.threads[i].seq);
+    }
     data[i].set = set;
+    data[i].shard = shards;
+    data[i].served_by = 0;
     data[i].barrier = &barrier;
+    place_attr(&place, &attr, i);
     if (pthread_create(&threads[i], &attr, test, (void *)(&data[i])) != 0) {
       fprintf(stderr, "Error creating thread\n");
       exit(1);
@@ -537,22 +1241,43 @@ int main(int argc, char **argv)
   }
   pthread_attr_destroy(&attr);
 
-  /* Start threads */
-  barrier_cross(&barrier);
-
-//  printf("STARTING...\n");
-//  gettimeofday(&start, NULL);
-/*
-  if (duration > 0) {
-    nanosleep(&timeout, NULL);
-  } else {
-    sigemptyset(&block_set);
-    sigsuspend(&block_set);
-  }
-*/
-  stop = 1;
-//  gettimeofday(&end, NULL);
-//  printf("STOPPING...\n");
+  /* Socket-wide counters follow the measured phases of the workers */
+  uncore.nb = 0;
+  if (perf_opt)
+    perf_open(&uncore, &perf, 1);
+
+  /* Start threads, then release them phase by phase */
+  printf("STARTING...\n");
+  txs = 0;
+  ph = first_phase;
+  memset(&start, 0, sizeof(start));
+  do {
+    stop = 0;
+    barrier_cross(&barrier);
+    clock_gettime(CLOCK_MONOTONIC, &phase_start);
+    if (ph == first_phase)
+      start = phase_start;
+    if (!phases[ph].warmup)
+      perf_enable(&uncore);
+    if (phases[ph].duration > 0) {
+      timeout.tv_sec = phases[ph].duration / 1000;
+      timeout.tv_nsec = (phases[ph].duration % 1000) * 1000000;
+      nanosleep(&timeout, NULL);
+      stop = 1;
+    }
+    barrier_cross(&barrier);
+    perf_disable(&uncore);
+    if (workload != NULL) {
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      phase_ms = (end.tv_sec - phase_start.tv_sec) * 1000.0 +
+        (end.tv_nsec - phase_start.tv_nsec) / 1000000.0;
+      for (i = 0, phase_txs = 0; i < nb_threads; i++)
+        phase_txs += data[i].nb_add + data[i].nb_remove + data[i].nb_contains + data[i].nb_scan;
+      printf("Phase %d (%s): %lu txs in %.3f ms (%f / s)\n", ph, phases[ph].name,
+             phase_txs - txs, phase_ms, (phase_txs - txs) * 1000.0 / phase_ms);
+      txs = phase_txs;
+    }
+  } while (++ph < nb_phases);
 
   /* Wait for thread completion */
   for (i = 0; i < nb_threads; i++) {
@@ -561,32 +1286,195 @@ int main(int argc, char **argv)
       exit(1);
     }
   }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  printf("STOPPING...\n");
 
-  //duration = (end.tv_sec * 1000 + end.tv_usec / 1000) - (start.tv_sec * 1000 + start.tv_usec / 1000);
+  elapsed = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0;
   reads = 0;
   updates = 0;
+  scans = 0;
+  commits = aborts = fallbacks = conflicts = capacity = 0;
+  retired = freed = advances = pending = 0;
+  reclaim_ns = 0;
+  memset(&perf_total, 0, sizeof(perf_total));
+  local = remote = delegated = 0;
+  memset(perf_ops, 0, sizeof(perf_ops));
   for (i = 0; i < nb_threads; i++) {
-    printf("Thread %d\n", i);
+    if (data[i].cpu >= 0)
+      printf("Thread %d (cpu %d, node %d)\n", i, data[i].cpu, data[i].node);
+    else
+      printf("Thread %d\n", i);
     printf("  #add        : %lu\n", data[i].nb_add);
     printf("  #remove     : %lu\n", data[i].nb_remove);
     printf("  #contains   : %lu\n", data[i].nb_contains);
     printf("  #found      : %lu\n", data[i].nb_found);
-    reads += data[i].nb_contains;
+    if (data[i].nb_scan > 0) {
+      printf("  #scan       : %lu\n", data[i].nb_scan);
+      printf("  #scanned    : %lu (%.2f / scan)\n", data[i].nb_scanned,
+             (double)data[i].nb_scanned / data[i].nb_scan);
+    }
+    if (data[i].nb_runs > 0)
+      printf("  #runs       : %lu (%.2f lookups / run)\n", data[i].nb_runs,
+             (double)data[i].nb_contains / data[i].nb_runs);
+    if (memtrace != NULL)
+      printf("  #access     : %lu\n", data[i].nb_access);
+    if (set_ops->transactional) {
+      printf("  #commit     : %lu\n", data[i].tm.commits);
+      printf("  #abort      : %lu (%.2f / commit)\n", data[i].tm.aborts,
+             data[i].tm.commits > 0 ? (double)data[i].tm.aborts / data[i].tm.commits : 0.0);
+      if (tm == TM_HTM)
+        printf("  #fallback   : %lu\n", data[i].tm.fallbacks);
+    }
+    if (data[i].ebr.retired > 0)
+      printf("  #retired    : %lu (%lu freed, peak %lu KB pending)\n", data[i].ebr.retired,
+             data[i].ebr.freed, (unsigned long)(data[i].ebr.pending_max >> 10));
+    if (shards != NULL)
+      printf("  #shard ops  : %lu local, %lu remote, %lu delegated, %lu served\n",
+             data[i].shards.local, data[i].shards.remote, data[i].shards.delegated,
+             data[i].shards.served);
+    if (perf_opt)
+      perf_counts_print(&perf, 0, &data[i].perf_total, "  #", 11, stdout);
+    if (pmem != NULL) {
+      n = data[i].nb_add + data[i].nb_remove + data[i].nb_contains + data[i].nb_scan;
+      printf("  #flush      : %lu (%.2f / op)\n", data[i].nb_flush,
+             n > 0 ? (double)data[i].nb_flush / n : 0.0);
+      printf("  #fence      : %lu (%.2f / op)\n", data[i].nb_fence,
+             n > 0 ? (double)data[i].nb_fence / n : 0.0);
+    }
+    trace_buf_destroy(&data[i].trace);
+    reads += data[i].nb_contains + data[i].nb_scan;
+    scans += data[i].nb_scan;
+    commits += data[i].tm.commits;
+    aborts += data[i].tm.aborts;
+    fallbacks += data[i].tm.fallbacks;
+    conflicts += data[i].tm.conflicts;
+    capacity += data[i].tm.capacity;
+    retired += data[i].ebr.retired;
+    freed += data[i].ebr.freed;
+    advances += data[i].ebr.advances;
+    pending += data[i].ebr.pending_max;
+    reclaim_ns += data[i].ebr.reclaim_ns;
+    local += data[i].shards.local;
+    remote += data[i].shards.remote;
+    delegated += data[i].shards.delegated;
+    perf_merge(&perf_total, &data[i].perf_total);
+    for (c = 0; c < NB_OP_TYPES; c++)
+      perf_merge(&perf_ops[c], &data[i].perf_ops[c]);
     updates += (data[i].nb_add + data[i].nb_remove);
     size += data[i].diff;
   }
   printf("Set size      : %d (expected: %d)\n", set_size(set), size);
   ret = (set_size(set) != size);
-//  printf("Duration      : %d (ms)\n", duration);
-//  printf("#txs          : %lu (%f / s)\n", reads + updates, (reads + updates) * 1000.0 / duration);
-//  printf("#read txs     : %lu (%f / s)\n", reads, reads * 1000.0 / duration);
-//  printf("#update txs   : %lu (%f / s)\n", updates, updates * 1000.0 / duration);
+  if (shards != NULL) {
+    printf("Shard sizes   :");
+    for (i = 0; i < shards->nb; i++)
+      printf(" %d", set_size(shards->sets[i]));
+    printf("\n");
+    n = local + remote + delegated;
+    printf("Shard ops     : %.2f%% local, %.2f%% remote, %.2f%% delegated\n",
+           n > 0 ? 100.0 * local / n : 0.0, n > 0 ? 100.0 * remote / n : 0.0,
+           n > 0 ? 100.0 * delegated / n : 0.0);
+  }
+  if (crash) {
+    /* Every crash image must recover; the last one to the final set */
+    crash_check(set_ops, &crash_st, stdout);
+    printf("Crash points  : %lu in %.1f ms (%.0f / s), %lu fences, %lu inconsistent\n",
+           crash_st.points, crash_st.elapsed,
+           crash_st.elapsed > 0 ? 1000.0 * crash_st.points / crash_st.elapsed : 0.0,
+           crash_st.fences, crash_st.failed);
+    printf("Recovered set : %d (expected: %d)\n", crash_st.keys, set_size(set));
+    ret |= (crash_st.failed > 0 || crash_st.keys != set_size(set));
+  }
+  if (alloc != ALLOC_MALLOC || pmem != NULL)
+    printf("Node memory   : %lu KB\n", (unsigned long)(alloc_used() >> 10));
+  if (retired > 0) {
+    /* The pending peaks of the threads need not coincide: an upper bound */
+    printf("Reclamation   : %lu retired, %lu freed in %lu epochs, <= %lu KB pending\n",
+           retired, freed, advances, pending >> 10);
+    printf("Reclaim cost  : %.3f ms (%.1f ns / freed node)\n", reclaim_ns / 1000000.0,
+           freed > 0 ? (double)reclaim_ns / freed : 0.0);
+  }
+  printf("Duration      : %.3f (ms)\n", elapsed);
+  printf("#txs          : %lu (%f / s)\n", reads + updates, (reads + updates) * 1000.0 / elapsed);
+  printf("#read txs     : %lu (%f / s)\n", reads, reads * 1000.0 / elapsed);
+  printf("#update txs   : %lu (%f / s)\n", updates, updates * 1000.0 / elapsed);
+  if (scans > 0)
+    printf("#scan txs     : %lu (%f / s)\n", scans, scans * 1000.0 / elapsed);
+  if (latency) {
+    /* The first NB_OP_TYPES histograms accumulate all threads */
+    for (i = 0; i < nb_threads; i++) {
+      hist_merge(&lat[TRACE_OP_ADD], &data[i].hist[TRACE_OP_ADD]);
+      hist_merge(&lat[TRACE_OP_REMOVE], &data[i].hist[TRACE_OP_REMOVE]);
+      hist_merge(&lat[TRACE_OP_CONTAINS], &data[i].hist[TRACE_OP_CONTAINS]);
+      hist_merge(&lat[TRACE_OP_SCAN], &data[i].hist[TRACE_OP_SCAN]);
+    }
+    printf("Latency\n");
+    hist_print(&lat[TRACE_OP_ADD], "add", stdout);
+    hist_print(&lat[TRACE_OP_REMOVE], "remove", stdout);
+    hist_print(&lat[TRACE_OP_CONTAINS], "contains", stdout);
+    if (scans > 0)
+      hist_print(&lat[TRACE_OP_SCAN], "scan", stdout);
+    for (c = 0; c < NB_OP_TYPES; c++)
+      hist_merge(&lat[(nb_threads + 1) * NB_OP_TYPES], &lat[c]);
+    hist_print(&lat[(nb_threads + 1) * NB_OP_TYPES], "all", stdout);
+  }
+  if (set_ops->transactional) {
+    printf("#commits      : %lu\n", commits);
+    printf("#aborts       : %lu (%.2f%%)\n", aborts,
+           commits + aborts > 0 ? 100.0 * aborts / (commits + aborts) : 0.0);
+    if (tm == TM_HTM)
+      printf("#fallbacks    : %lu (aborts: %lu conflict, %lu capacity)\n",
+             fallbacks, conflicts, capacity);
+    /* As for latency, the first histograms accumulate all threads */
+    for (i = 0; i < nb_threads; i++) {
+      for (c = 0; c < 2 * NB_OP_TYPES; c++)
+        hist_merge(&tx_sets[c], &data[i].tx_sets[c]);
+    }
+    for (c = 0; c < 2; c++) {
+      printf(c == 0 ? "Read set\n" : "Write set\n");
+      hist_print_unit(&tx_sets[c * NB_OP_TYPES + TRACE_OP_ADD], "add", "words", stdout);
+      hist_print_unit(&tx_sets[c * NB_OP_TYPES + TRACE_OP_REMOVE], "remove", "words", stdout);
+      hist_print_unit(&tx_sets[c * NB_OP_TYPES + TRACE_OP_CONTAINS], "contains", "words", stdout);
+      if (scans > 0)
+        hist_print_unit(&tx_sets[c * NB_OP_TYPES + TRACE_OP_SCAN], "scan", "words", stdout);
+    }
+  }
+
+  if (perf_opt) {
+    /* Whole measured phases, then the ops sampled alone */
+    printf("Counters\n");
+    perf_counts_print(&perf, 0, &perf_total, "  ", 12, stdout);
+    if (uncore.nb > 0) {
+      n = perf_total.ops;
+      perf_read(&uncore, &perf_total);
+      perf_total.ops = n;
+      perf_counts_print(&perf, 1, &perf_total, "  ", 12, stdout);
+    }
+    printf("Counters per op (1 in %d)\n", PERF_OP_PERIOD);
+    perf_ops_print(&perf, &perf_ops[TRACE_OP_ADD], "add", stdout);
+    perf_ops_print(&perf, &perf_ops[TRACE_OP_REMOVE], "remove", stdout);
+    perf_ops_print(&perf, &perf_ops[TRACE_OP_CONTAINS], "contains", stdout);
+    if (scans > 0)
+      perf_ops_print(&perf, &perf_ops[TRACE_OP_SCAN], "scan", stdout);
+  }
+  perf_close(&uncore);
 
   /* Delete set */
   set_delete(set);
+  alloc_fini();
+  pmem_fini();
+  trace_close(&trace);
+  if (codec.kind != CODEC_NONE)
+    printf("Trace size   : %lu -> %lu bytes (%.2fx)\n",
+           (unsigned long)trace.nb_raw, (unsigned long)trace.nb_packed,
+           trace.nb_packed > 0 ? (double)trace.nb_raw / trace.nb_packed : 0.0);
 
   free(threads);
   free(data);
+  free(lat);
+  free(tx_sets);
+  free(ckpt.threads);
+  ckpt_free(&resume);
 
   return ret;
 }
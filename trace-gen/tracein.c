@@ -0,0 +1,200 @@
+/*
+ * File:
+ *   tracein.c
+ * Description:
+ *   Zero-copy trace input: the file is memory-mapped and records are
+ *   parsed straight out of the mapping.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tracein.h"
+
+/*
+ * Compressed traces are inflated up front into anonymous memory: the
+ * replay threads each take a share of the whole trace.
+ */
+static int load_compressed(trace_in_t *in, size_t hint)
+{
+  codec_in_t src;
+  size_t cap = CODEC_BUFSIZE, len = 0, n;
+  char *p;
+
+  while (cap < 4 * hint)
+    cap *= 2;
+  p = mmap(NULL, cap, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    perror("mmap");
+    return -1;
+  }
+  codec_in_open(&src, in->fd);
+  while ((n = codec_in_read(&src, p + len, cap - len)) > 0) {
+    len += n;
+    if (len == cap) {
+      if ((p = mremap(p, cap, 2 * cap, MREMAP_MAYMOVE)) == MAP_FAILED) {
+        perror("mremap");
+        return -1;
+      }
+      cap *= 2;
+    }
+  }
+  codec_in_close(&src);
+  in->data = p;
+  in->size = len;
+  in->mapped = cap;
+
+  return 0;
+}
+
+int trace_in_open(trace_in_t *in, const char *path)
+{
+  const trace_header_t *h;
+  struct stat st;
+  const char *p;
+  char magic[4];
+
+  if ((in->fd = open(path, O_RDONLY)) < 0 || fstat(in->fd, &st) != 0) {
+    perror(path);
+    return -1;
+  }
+  in->size = in->mapped = st.st_size;
+  in->data = NULL;
+  in->codec = CODEC_NONE;
+  if (pread(in->fd, magic, sizeof(magic), 0) == sizeof(magic))
+    in->codec = codec_detect(magic, sizeof(magic));
+  if (in->codec != CODEC_NONE) {
+    if (load_compressed(in, st.st_size) != 0)
+      return -1;
+  } else if (in->size > 0) {
+    in->data = mmap(NULL, in->size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, in->fd, 0);
+    if (in->data == MAP_FAILED) {
+      perror("mmap");
+      return -1;
+    }
+    madvise((void *)in->data, in->size, MADV_SEQUENTIAL);
+  }
+  in->end = in->data + in->size;
+
+  h = (const trace_header_t *)in->data;
+  if (in->size >= TRACE_HEADER_V2_SIZE && h->magic == TRACE_MAGIC) {
+    if (!trace_header_ok(h) || trace_header_size(h) > in->size ||
+        trace_header_size(h) + h->nb_initial * sizeof(int64_t) > in->size) {
+      fprintf(stderr, "%s: unsupported or truncated binary trace\n", path);
+      return -1;
+    }
+    in->format = TRACE_BINARY;
+    trace_header_copy(&in->header, h, trace_header_size(h));
+    in->nb_initial = h->nb_initial;
+    in->initial = in->data + trace_header_size(h);
+    in->body = in->initial + h->nb_initial * sizeof(int64_t);
+    return 0;
+  }
+
+  /* Text: the first line lists the initial set as "v, v, ..." */
+  in->format = TRACE_TEXT;
+  trace_header_copy(&in->header, NULL, 0);
+  in->initial = in->data;
+  p = in->data ? memchr(in->data, '\n', in->size) : NULL;
+  in->body = p ? p + 1 : in->end;
+  in->nb_initial = 0;
+  for (p = in->initial; p < in->body; p++) {
+    if (*p == ',')
+      in->nb_initial++;
+  }
+  return 0;
+}
+
+void trace_in_close(trace_in_t *in)
+{
+  if (in->data != NULL)
+    munmap((void *)in->data, in->mapped);
+  close(in->fd);
+}
+
+/* The initial values as an array (malloc'ed, to be freed by the caller) */
+int64_t *trace_in_initial(const trace_in_t *in)
+{
+  int64_t *vals;
+  const char *p;
+  uint64_t i;
+
+  if ((vals = (int64_t *)malloc((in->nb_initial + 1) * sizeof(int64_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  if (in->format == TRACE_BINARY) {
+    memcpy(vals, in->initial, in->nb_initial * sizeof(int64_t));
+    return vals;
+  }
+  p = in->initial;
+  for (i = 0; i < in->nb_initial; i++) {
+    p = trace_parse_int(p, in->body, &vals[i]);
+    p += 2;                             /* ", " */
+  }
+  return vals;
+}
+
+/* Number of operation records (binary only; text needs a full scan) */
+uint64_t trace_in_count(const trace_in_t *in)
+{
+  const char *p;
+  uint64_t n = 0;
+
+  if (in->format == TRACE_BINARY)
+    return (in->end - in->body) / sizeof(trace_rec_t);
+  for (p = in->body; p < in->end && (p = memchr(p, '\n', in->end - p)) != NULL; p++)
+    n++;
+  return n;
+}
+
+/* The i-th of n contiguous shares of the records, split on record boundaries */
+void trace_in_split(const trace_in_t *in, int i, int n, trace_cursor_t *c)
+{
+  size_t len = in->end - in->body, lo, hi;
+  const char *q;
+
+  c->format = in->format;
+  c->nl_base = NULL;
+  c->nl = 0;
+  if (in->format == TRACE_BINARY) {
+    len /= sizeof(trace_rec_t);
+    c->p = in->body + (len * i / n) * sizeof(trace_rec_t);
+    c->end = in->body + (len * (i + 1) / n) * sizeof(trace_rec_t);
+    return;
+  }
+  lo = len * i / n;
+  hi = len * (i + 1) / n;
+  /* Each share starts right after a newline */
+  c->p = in->body + lo;
+  if (lo > 0 && c->p[-1] != '\n') {
+    q = memchr(c->p, '\n', in->end - c->p);
+    c->p = q ? q + 1 : in->end;
+  }
+  c->end = in->body + hi;
+  if (hi < len && c->end[-1] != '\n') {
+    q = memchr(c->end, '\n', in->end - c->end);
+    c->end = q ? q + 1 : in->end;
+  }
+}
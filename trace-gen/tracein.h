@@ -0,0 +1,233 @@
+/*
+ * File:
+ *   tracein.h
+ * Description:
+ *   Zero-copy trace input: the file is memory-mapped and records are
+ *   parsed straight out of the mapping.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _TRACEIN_H_
+# define _TRACEIN_H_
+
+# include <stddef.h>
+# include <stdint.h>
+# include <string.h>
+# ifdef __SSE2__
+#  include <emmintrin.h>
+# endif
+
+# include "trace.h"
+
+/* Text bytes searched for newlines at once */
+# define TRACE_NL_WINDOW                64
+
+typedef struct trace_in {
+  int fd;
+  const char *data;                     /* Whole file, decompressed */
+  size_t size;
+  size_t mapped;                        /* Length of the mapping */
+  codec_kind_t codec;
+  trace_format_t format;
+  trace_header_t header;                /* Binary traces; version 3 fields */
+  uint64_t nb_initial;
+  const char *initial;                  /* Initial values */
+  const char *body;                     /* First operation record */
+  const char *end;
+} trace_in_t;
+
+/* A cursor over [p, end): a whole trace or one thread's share of it */
+typedef struct trace_cursor {
+  const char *p;
+  const char *end;
+  trace_format_t format;
+  /* Text: the newlines of [nl_base, nl_base + TRACE_NL_WINDOW) not yet
+   * reached, as bits, so the next line is found without parsing this one */
+  const char *nl_base;
+  uint64_t nl;
+} trace_cursor_t;
+
+int trace_in_open(trace_in_t *in, const char *path);
+void trace_in_close(trace_in_t *in);
+int64_t *trace_in_initial(const trace_in_t *in);
+uint64_t trace_in_count(const trace_in_t *in);
+void trace_in_split(const trace_in_t *in, int i, int n, trace_cursor_t *c);
+
+static inline const char *trace_parse_int(const char *p, const char *end, int64_t *val)
+{
+  uint64_t v = 0;
+  int neg = 0;
+
+  if (p < end && *p == '-') {
+    neg = 1;
+    p++;
+  }
+  while (p < end && (unsigned)(*p - '0') < 10)
+    v = v * 10 + (*p++ - '0');
+  *val = neg ? -(int64_t)v : (int64_t)v;
+
+  return p;
+}
+
+/* Bit i set if p[i] is a newline, for i < TRACE_NL_WINDOW */
+static inline uint64_t trace_newlines(const char *p)
+{
+  uint64_t m = 0;
+  int i;
+
+# ifdef __SSE2__
+  const __m128i nl = _mm_set1_epi8('\n');
+
+  for (i = 0; i < TRACE_NL_WINDOW; i += 16)
+    m |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+      _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)), nl)) << i;
+# else
+  uint64_t w;
+
+  for (i = 0; i < TRACE_NL_WINDOW; i += 8) {
+    memcpy(&w, p + i, sizeof(w));
+    w ^= 0x0a0a0a0a0a0a0a0aULL;
+    /* 0x80 in exactly the bytes that were newlines, then one bit each */
+    w = ~(((w & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL) | w) & 0x8080808080808080ULL;
+#  if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    m |= ((w >> 7) * 0x0102040810204080ULL >> 56) << i;
+#  else
+    m |= ((w >> 7) * 0x8040201008040201ULL >> 56) << i;
+#  endif
+  }
+# endif
+
+  return m;
+}
+
+/*
+ * The n digits at p, 1 <= n <= 8, from one 8-byte load (p + 8 must be
+ * readable); returns -1 if they are not all digits.
+ */
+static inline int trace_parse_digits(const char *p, int n, int64_t *val)
+{
+  uint64_t w, bad;
+
+  memcpy(&w, p, sizeof(w));
+# if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  /* Bytes below '0' or above '9'; a borrow or carry only reaches bytes
+   * above a bad one */
+  bad = ((w - 0x3030303030303030ULL) | (w + 0x4646464646464646ULL)) &
+    0x8080808080808080ULL & (~0ULL >> (64 - 8 * n));
+  if (bad != 0)
+    return -1;
+  /* Right-align the digits behind zeros, then combine pairs, quads and
+   * octets of them */
+  w = (w << (64 - 8 * n)) & 0x0f0f0f0f0f0f0f0fULL;
+  w = ((w * 2561) >> 8) & 0x00ff00ff00ff00ffULL;
+  w = ((w * 6553601) >> 16) & 0x0000ffff0000ffffULL;
+  *val = (int64_t)((w * 42949672960001ULL) >> 32);
+# else
+  {
+    int64_t v = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+      if ((unsigned)(p[i] - '0') >= 10)
+        return -1;
+      v = v * 10 + (p[i] - '0');
+    }
+    *val = v;
+  }
+# endif
+  return 0;
+}
+
+/*
+ * Next record: returns 1, or 0 at the end, or -1 on a malformed text
+ * line. Text records leave seq, ts and tid zero.
+ */
+static inline int trace_cursor_next(trace_cursor_t *c, trace_rec_t *rec)
+{
+  const char *p = c->p, *eol = NULL;
+
+  if (c->format == TRACE_BINARY) {
+    if (p + sizeof(trace_rec_t) > c->end)
+      return 0;
+    *rec = *(const trace_rec_t *)p;
+    c->p = p + sizeof(trace_rec_t);
+    return 1;
+  }
+  if (p >= c->end)
+    return 0;
+  /* The end of the line, if it is in the current or a new window */
+  if (c->nl == 0 && c->end - p >= TRACE_NL_WINDOW) {
+    c->nl_base = p;
+    c->nl = trace_newlines(p);
+  }
+  if (c->nl != 0) {
+    int n;
+
+    eol = c->nl_base + __builtin_ctzll(c->nl);
+    c->nl &= c->nl - 1;
+    /* The common "<op> - <value>\n": every field at a known place;
+     * anything else takes the general path below */
+    n = (int)(eol - p) - 4;
+    if (n >= 1 && n <= 8 && p + 12 <= c->end && p[1] == ' ' && p[2] == '-' &&
+        p[3] == ' ' && p[0] != '0' + TRACE_OP_SCAN &&
+        trace_parse_digits(p + 4, n, &rec->val) == 0) {
+      rec->op = p[0] - '0';
+      rec->seq = rec->ts = 0;
+      rec->tid = 0;
+      c->p = eol + 1;
+      return 1;
+    }
+  }
+  /* "<op> - <value>\n", or "<op> <shard> <value>\n" if sharded */
+  if (p + 4 >= c->end || p[1] != ' ')
+    return -1;
+  rec->op = p[0] - '0';
+  rec->seq = rec->ts = 0;
+  rec->tid = 0;
+  if (p[2] == '-') {
+    p += 3;
+  } else {
+    int64_t shard;
+    p = trace_parse_int(p + 2, c->end, &shard);
+    if (shard < 0 || shard > TRACE_SHARD_MAX)
+      return -1;
+    rec->op |= TRACE_OP_SHARDED(shard);
+  }
+  if (p >= c->end || *p != ' ')
+    return -1;
+  p = trace_parse_int(p + 1, c->end, &rec->val);
+  if (TRACE_OP_CODE(rec->op) == TRACE_OP_SCAN) {
+    int64_t len;
+    if (p >= c->end || *p != ' ')
+      return -1;
+    p = trace_parse_int(p + 1, c->end, &len);
+    if (len < 0 || len > TRACE_SCAN_MAX)
+      return -1;
+    rec->op |= (uint32_t)len << TRACE_OP_BITS;
+  }
+  if (eol != NULL) {
+    if (p != eol)
+      return -1;
+    p++;
+  } else if (p < c->end && *p++ != '\n') {
+    return -1;
+  }
+  c->p = p;
+  return 1;
+}
+
+#endif /* _TRACEIN_H_ */
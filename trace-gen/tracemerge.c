@@ -0,0 +1,265 @@
+/*
+ * File:
+ *   tracemerge.c
+ * Description:
+ *   Merge per-thread binary traces into one globally ordered trace.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#define DEFAULT_FORMAT                  binary
+#define DEFAULT_OUTPUT                  -
+
+#define XSTR(s)                         STR(s)
+#define STR(s)                          #s
+
+/* ################################################################### *
+ * INPUT STREAMS
+ * ################################################################### */
+
+typedef struct input {
+  int fd;
+  codec_in_t src;                       /* Decompresses if needed */
+  char *data;
+  size_t pos;
+  size_t len;
+  trace_rec_t cur;
+} input_t;
+
+static int input_read(input_t *in, void *dst, size_t size)
+{
+  size_t n;
+
+  while (in->len - in->pos < size) {
+    /* Refill, keeping any partial record */
+    memmove(in->data, in->data + in->pos, in->len - in->pos);
+    in->len -= in->pos;
+    in->pos = 0;
+    n = codec_in_read(&in->src, in->data + in->len, TRACE_BUFSIZE - in->len);
+    if (n == 0)
+      return 0;
+    in->len += n;
+  }
+  memcpy(dst, in->data + in->pos, size);
+  in->pos += size;
+  return 1;
+}
+
+static int input_open(input_t *in, const char *path, trace_header_t *h)
+{
+  char raw[sizeof(trace_header_t)];
+
+  if ((in->fd = open(path, O_RDONLY)) < 0)
+    return 0;
+  if ((in->data = (char *)malloc(TRACE_BUFSIZE)) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  codec_in_open(&in->src, in->fd);
+  in->pos = in->len = 0;
+  /* Version 2 headers are shorter: read the common part first */
+  if (!input_read(in, raw, TRACE_HEADER_V2_SIZE) ||
+      !trace_header_ok((const trace_header_t *)raw) ||
+      !input_read(in, raw + TRACE_HEADER_V2_SIZE,
+                  trace_header_size((const trace_header_t *)raw) - TRACE_HEADER_V2_SIZE)) {
+    fprintf(stderr, "%s: not a version 2 to %d binary trace\n", path, TRACE_VERSION);
+    exit(1);
+  }
+  trace_header_copy(h, raw, trace_header_size((const trace_header_t *)raw));
+  return 1;
+}
+
+static void input_close(input_t *in)
+{
+  codec_in_close(&in->src);
+  close(in->fd);
+  free(in->data);
+}
+
+/* ################################################################### *
+ * MERGE
+ * ################################################################### */
+
+/* Binary min-heap of streams, ordered by their current record */
+static void heap_down(input_t **heap, int n, int i)
+{
+  int c;
+  input_t *tmp;
+
+  while ((c = 2 * i + 1) < n) {
+    if (c + 1 < n && trace_rec_before(&heap[c + 1]->cur, &heap[c]->cur))
+      c++;
+    if (!trace_rec_before(&heap[c]->cur, &heap[i]->cur))
+      break;
+    tmp = heap[i];
+    heap[i] = heap[c];
+    heap[c] = tmp;
+    i = c;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  struct option long_options[] = {
+    // These options don't set a flag
+    {"help",                      no_argument,       NULL, 'h'},
+    {"format",                    required_argument, NULL, 'f'},
+    {"output",                    required_argument, NULL, 'o'},
+    {"compress",                  required_argument, NULL, 'Z'},
+    {NULL, 0, NULL, 0}
+  };
+
+  char path[PATH_MAX];
+  trace_format_t format = TRACE_BINARY;
+  codec_t codec = { CODEC_NONE, 0 };
+  const char *output = XSTR(DEFAULT_OUTPUT);
+  input_t init, *inputs = NULL, **heap;
+  trace_t trace;
+  trace_buf_t buf;
+  trace_header_t h, th;
+  uint64_t i, n;
+  int64_t val;
+  int c, nb_inputs;
+
+  while(1) {
+    c = getopt_long(argc, argv, "hf:o:Z:", long_options, NULL);
+
+    if(c == -1)
+      break;
+
+    switch(c) {
+     case 'h':
+       printf("tracemerge "
+              "\n"
+              "Usage:\n"
+              "  tracemerge [options...] <prefix>\n"
+              "\n"
+              "Merges <prefix>.init.bin and <prefix>.<tid>.bin (as written by\n"
+              "tracegen -p) into a single trace ordered by timestamp, then by\n"
+              "thread id, then by sequence number.  Compressed inputs are\n"
+              "recognized and decompressed.\n"
+              "\n"
+              "Options:\n"
+              "  -h, --help\n"
+              "        Print this message\n"
+              "  -f, --format <text|binary>\n"
+              "        Output format (default=" XSTR(DEFAULT_FORMAT) ")\n"
+              "  -o, --output <file>\n"
+              "        Output file, - for stdout (default=" XSTR(DEFAULT_OUTPUT) ")\n"
+              "  -Z, --compress <none|gzip|zstd|lz4>[:<level>]\n"
+              "        Compress the output (default=" XSTR(DEFAULT_COMPRESS) ")\n"
+         );
+       exit(0);
+     case 'f':
+       if (trace_parse_format(optarg, &format) != 0) {
+         fprintf(stderr, "Unknown trace format: %s\n", optarg);
+         exit(1);
+       }
+       break;
+     case 'o':
+       output = optarg;
+       break;
+     case 'Z':
+       if (codec_parse(optarg, &codec) != 0) {
+         fprintf(stderr, "Unknown or unavailable codec: %s\n", optarg);
+         exit(1);
+       }
+       break;
+     case '?':
+       printf("Use -h or --help for help\n");
+       exit(0);
+     default:
+       exit(1);
+    }
+  }
+
+  if (optind != argc - 1) {
+    fprintf(stderr, "Use -h or --help for help\n");
+    exit(1);
+  }
+
+  snprintf(path, sizeof(path), "%s.init.bin", argv[optind]);
+  if (!input_open(&init, path, &h)) {
+    perror(path);
+    exit(1);
+  }
+
+  /* Per-thread streams are numbered contiguously from 0 */
+  for (nb_inputs = 0; ; nb_inputs++) {
+    if ((inputs = (input_t *)realloc(inputs, (nb_inputs + 1) * sizeof(input_t))) == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+    snprintf(path, sizeof(path), "%s.%d.bin", argv[optind], nb_inputs);
+    if (!input_open(&inputs[nb_inputs], path, &th))
+      break;
+  }
+  if ((heap = (input_t **)malloc((nb_inputs + 1) * sizeof(input_t *))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+
+  trace_open(&trace, output, format, NULL, &codec, 0);
+  trace.pin = h.pin;
+  trace.mem = h.mem;
+  trace.nb_nodes = h.nb_nodes;
+  trace.nb_shards = h.nb_shards;
+  trace_begin(&trace, h.nb_initial);
+  trace_buf_init(&buf, &trace, TRACE_TID_MAIN, -1, -1);
+  for (i = 0; i < h.nb_initial; i++) {
+    if (!input_read(&init, &val, sizeof(val))) {
+      fprintf(stderr, "Truncated initial set\n");
+      exit(1);
+    }
+    trace_initial(&buf, val);
+  }
+  trace_initial_end(&buf);
+  input_close(&init);
+
+  n = 0;
+  for (c = 0; c < nb_inputs; c++) {
+    if (input_read(&inputs[c], &inputs[c].cur, sizeof(trace_rec_t)))
+      heap[n++] = &inputs[c];
+  }
+  for (c = n / 2 - 1; c >= 0; c--)
+    heap_down(heap, n, c);
+  while (n > 0) {
+    trace_rec(&buf, &heap[0]->cur);
+    if (!input_read(heap[0], &heap[0]->cur, sizeof(trace_rec_t)))
+      heap[0] = heap[--n];
+    heap_down(heap, n, 0);
+  }
+  trace_buf_destroy(&buf);
+  trace_close(&trace);
+
+  for (c = 0; c < nb_inputs; c++)
+    input_close(&inputs[c]);
+  free(inputs);
+  free(heap);
+
+  return 0;
+}
@@ -0,0 +1,430 @@
+/*
+ * File:
+ *   tracereplay.c
+ * Description:
+ *   Replay a recorded trace against any set backend.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <assert.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "alloc.h"
+#include "barrier.h"
+#include "ebr.h"
+#include "intset.h"
+#include "tm.h"
+#include "tracein.h"
+
+#define DEFAULT_NB_THREADS              1
+#define DEFAULT_PARTITION               chunk
+#define DEFAULT_BATCH                   1
+
+#define XSTR(s)                         STR(s)
+#define STR(s)                          #s
+
+typedef struct replay_data {
+  intset_t *set;
+  barrier_t *barrier;
+  const trace_in_t *in;
+  int id;
+  int nb_threads;
+  int by_tid;                           /* Partition by recorded thread id */
+  int parse_only;
+  int batch;                            /* Longest run of ops applied at once */
+  unsigned long nb_add;
+  unsigned long nb_remove;
+  unsigned long nb_contains;
+  unsigned long nb_found;
+  unsigned long nb_scan;
+  unsigned long nb_scanned;
+  unsigned long nb_bad;
+  tm_stats_t tm;                        /* Transactions, once done */
+  long diff;
+  uint64_t checksum;                    /* Keeps --parse-only honest */
+  char padding[64];
+} replay_data_t;
+
+/* Apply a run of n ops of the same type as one batch */
+static void replay_batch(replay_data_t *d, uint32_t op, const val_t *vals, int n)
+{
+  switch (op) {
+   case TRACE_OP_ADD:
+     d->diff += set_add_batch(d->set, vals, n, NULL);
+     d->nb_add += n;
+     break;
+   case TRACE_OP_REMOVE:
+     d->diff -= set_remove_batch(d->set, vals, n, NULL);
+     d->nb_remove += n;
+     break;
+   case TRACE_OP_CONTAINS:
+     d->nb_found += set_contains_batch(d->set, vals, n, NULL);
+     d->nb_contains += n;
+     break;
+   default:
+     d->nb_bad += n;
+     break;
+  }
+}
+
+static void *replay(void *data)
+{
+  replay_data_t *d = (replay_data_t *)data;
+  trace_cursor_t c;
+  trace_rec_t rec;
+  uint64_t sum = 0;
+  val_t *vals = NULL;
+  uint32_t op, run_op = 0;
+  int r, nb_vals = 0;
+
+  if (d->batch > 1 &&
+      (vals = (val_t *)malloc(d->batch * sizeof(val_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+
+  if (d->by_tid)
+    trace_in_split(d->in, 0, 1, &c);
+  else
+    trace_in_split(d->in, d->id, d->nb_threads, &c);
+
+  barrier_cross(d->barrier);
+
+  while ((r = trace_cursor_next(&c, &rec)) != 0) {
+    if (r < 0) {
+      fprintf(stderr, "Malformed trace record\n");
+      exit(1);
+    }
+    if (d->by_tid && (int)(rec.tid % d->nb_threads) != d->id)
+      continue;
+    /* Phase markers carry no set operation; the shard is not replayed */
+    op = TRACE_OP_CODE(rec.op);
+    if (op == TRACE_OP_PHASE)
+      continue;
+    if (d->parse_only) {
+      sum += rec.op + rec.val;
+      continue;
+    }
+    if (op == TRACE_OP_SCAN) {
+      /* Scans are never batched, and end the current run */
+      if (nb_vals > 0) {
+        replay_batch(d, run_op, vals, nb_vals);
+        nb_vals = 0;
+      }
+      if (d->set->ops->scan == NULL) {
+        d->nb_bad++;
+        continue;
+      }
+      d->nb_scanned += set_scan(d->set, rec.val, TRACE_OP_LEN(rec.op));
+      d->nb_scan++;
+      continue;
+    }
+    if (vals != NULL) {
+      /* Only consecutive ops of one type are batched: same results */
+      if (nb_vals > 0 && (op != run_op || nb_vals == d->batch)) {
+        replay_batch(d, run_op, vals, nb_vals);
+        nb_vals = 0;
+      }
+      run_op = op;
+      vals[nb_vals++] = rec.val;
+      continue;
+    }
+    switch (op) {
+     case TRACE_OP_ADD:
+       if (set_add(d->set, rec.val))
+         d->diff++;
+       d->nb_add++;
+       break;
+     case TRACE_OP_REMOVE:
+       if (set_remove(d->set, rec.val))
+         d->diff--;
+       d->nb_remove++;
+       break;
+     case TRACE_OP_CONTAINS:
+       if (set_contains(d->set, rec.val))
+         d->nb_found++;
+       d->nb_contains++;
+       break;
+     default:
+       d->nb_bad++;
+       break;
+    }
+  }
+  if (nb_vals > 0)
+    replay_batch(d, run_op, vals, nb_vals);
+  free(vals);
+  d->checksum = sum;
+  d->tm = tm_stats;
+  tm_thread_fini();
+  ebr_thread_fini();
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct option long_options[] = {
+    // These options don't set a flag
+    {"help",                      no_argument,       NULL, 'h'},
+    {"num-threads",               required_argument, NULL, 'n'},
+    {"set",                       required_argument, NULL, 'b'},
+    {"alloc",                     required_argument, NULL, 'm'},
+    {"arena-size",                required_argument, NULL, 'M'},
+    {"partition",                 required_argument, NULL, 'p'},
+    {"batch",                     required_argument, NULL, 'B'},
+    {"parse-only",                no_argument,       NULL, 'x'},
+    {"tm",                        required_argument, NULL, 'X'},
+    {NULL, 0, NULL, 0}
+  };
+
+  trace_in_t in;
+  intset_t *set;
+  const set_ops_t *set_ops = NULL;
+  alloc_kind_t alloc = ALLOC_MALLOC;
+  int arena_mb = DEFAULT_ARENA_SIZE;
+  int nb_threads = DEFAULT_NB_THREADS;
+  int by_tid = 0, parse_only = 0;
+  int batch = DEFAULT_BATCH;
+  tm_kind_t tm = TM_STM;
+  val_t *vals;
+  replay_data_t *data;
+  pthread_t *threads;
+  barrier_t barrier;
+  struct timespec start, end;
+  double elapsed;
+  int64_t *initial;
+  unsigned long ops, bad;
+  long size;
+  uint64_t i;
+  int c, ret;
+
+  while(1) {
+    c = getopt_long(argc, argv, "hn:b:m:M:p:B:xX:", long_options, NULL);
+
+    if(c == -1)
+      break;
+
+    switch(c) {
+     case 'h':
+       printf("tracereplay "
+              "\n"
+              "Usage:\n"
+              "  tracereplay [options...] <trace>\n"
+              "\n"
+              "Loads the initial set of a text or binary trace, then replays its\n"
+              "operations.\n"
+              "\n"
+              "Options:\n"
+              "  -h, --help\n"
+              "        Print this message\n"
+              "  -n, --num-threads <int>\n"
+              "        Number of threads (default=" XSTR(DEFAULT_NB_THREADS) ")\n"
+              "  -p, --partition <chunk|tid>\n"
+              "        Give each thread a contiguous share of the trace, or (binary\n"
+              "        traces) the records of recorded threads tid %% n\n"
+              "        (default=" XSTR(DEFAULT_PARTITION) ")\n"
+              "  -B, --batch <int>\n"
+              "        Apply runs of up to <int> consecutive ops of the same type as one\n"
+              "        batch (default=" XSTR(DEFAULT_BATCH) ")\n"
+              "  -x, --parse-only\n"
+              "        Only parse the records (measures the parser)\n"
+              "  -m, --alloc <malloc|pool|arena|huge>\n"
+              "        Node allocator (default=" XSTR(DEFAULT_ALLOC) ")\n"
+              "  -M, --arena-size <int>\n"
+              "        Address space reserved for the arena, in MB (default=" XSTR(DEFAULT_ARENA_SIZE) ")\n"
+              "  -X, --tm <stm|htm>\n"
+              "        Transactions of the tx backend (default=" XSTR(DEFAULT_TM) ")\n"
+              "  -b, --set <name>\n"
+              "        Set backend (default=" XSTR(DEFAULT_SET) "):\n"
+         );
+       set_print_backends(stdout);
+       exit(0);
+     case 'n':
+       nb_threads = atoi(optarg);
+       break;
+     case 'b':
+       if ((set_ops = set_lookup(optarg)) == NULL) {
+         printf("Unknown set backend: %s\n", optarg);
+         exit(1);
+       }
+       break;
+     case 'm':
+       if (alloc_parse(optarg, &alloc) != 0) {
+         printf("Unknown allocator: %s\n", optarg);
+         exit(1);
+       }
+       break;
+     case 'M':
+       arena_mb = atoi(optarg);
+       break;
+     case 'p':
+       if (strcmp(optarg, "tid") == 0) {
+         by_tid = 1;
+       } else if (strcmp(optarg, "chunk") != 0) {
+         printf("Unknown partition: %s\n", optarg);
+         exit(1);
+       }
+       break;
+     case 'B':
+       batch = atoi(optarg);
+       break;
+     case 'x':
+       parse_only = 1;
+       break;
+     case 'X':
+       if (tm_parse(optarg, &tm) != 0) {
+         printf("Unknown transaction mode: %s\n", optarg);
+         exit(1);
+       }
+       break;
+     case '?':
+       printf("Use -h or --help for help\n");
+       exit(0);
+     default:
+       exit(1);
+    }
+  }
+
+  if (optind != argc - 1) {
+    printf("Use -h or --help for help\n");
+    exit(1);
+  }
+  assert(nb_threads > 0);
+  assert(batch > 0);
+  assert(arena_mb > 0);
+  if (set_ops == NULL)
+    set_ops = set_lookup(XSTR(DEFAULT_SET));
+  if (nb_threads > 1 && !set_ops->concurrent)
+    printf("WARNING: set backend %s is not thread-safe\n", set_ops->name);
+
+  if (trace_in_open(&in, argv[optind]) != 0)
+    exit(1);
+  if (by_tid && in.format != TRACE_BINARY) {
+    printf("Text traces have no thread ids, use -p chunk\n");
+    exit(1);
+  }
+
+  printf("Trace        : %s (%s", argv[optind],
+         in.format == TRACE_BINARY ? "binary" : "text");
+  if (in.codec != CODEC_NONE)
+    printf(", %s, %lu bytes", codec_name(in.codec), (unsigned long)in.size);
+  printf(")\n");
+  printf("Initial size : %lu\n", (unsigned long)in.nb_initial);
+  printf("Nb threads   : %d\n", nb_threads);
+  printf("Partition    : %s\n", by_tid ? "tid" : "chunk");
+  printf("Batch        : %d\n", batch);
+  printf("Set backend  : %s\n", set_ops->name);
+  if (set_ops->transactional)
+    printf("Transactions : %s\n", tm_name(tm));
+  printf("Allocator    : %s\n", alloc_name(alloc));
+
+  if ((data = (replay_data_t *)calloc(nb_threads, sizeof(replay_data_t))) == NULL ||
+      (threads = (pthread_t *)malloc(nb_threads * sizeof(pthread_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+
+  alloc_init(alloc, arena_mb);
+  if (set_ops->transactional)
+    tm_init(tm);
+  set = set_new(set_ops);
+
+  /* Preload */
+  initial = trace_in_initial(&in);
+  /* One more, so that an empty initial set does not get NULL */
+  if ((vals = (val_t *)malloc((in.nb_initial + 1) * sizeof(val_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  for (i = 0; i < in.nb_initial; i++)
+    vals[i] = initial[i];
+  set_add_batch(set, vals, (int)in.nb_initial, NULL);
+  free(vals);
+  free(initial);
+  tm_thread_fini();
+  size = set_size(set);
+  printf("Set size     : %ld\n", size);
+
+  barrier_init(&barrier, nb_threads + 1);
+  for (c = 0; c < nb_threads; c++) {
+    data[c].set = set;
+    data[c].barrier = &barrier;
+    data[c].in = &in;
+    data[c].id = c;
+    data[c].nb_threads = nb_threads;
+    data[c].by_tid = by_tid;
+    data[c].parse_only = parse_only;
+    data[c].batch = batch;
+    if (pthread_create(&threads[c], NULL, replay, &data[c]) != 0) {
+      fprintf(stderr, "Error creating thread\n");
+      exit(1);
+    }
+  }
+
+  barrier_cross(&barrier);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (c = 0; c < nb_threads; c++) {
+    if (pthread_join(threads[c], NULL) != 0) {
+      fprintf(stderr, "Error waiting for thread completion\n");
+      exit(1);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  elapsed = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0;
+
+  ops = bad = 0;
+  for (c = 0; c < nb_threads; c++) {
+    printf("Thread %d\n", c);
+    printf("  #add        : %lu\n", data[c].nb_add);
+    printf("  #remove     : %lu\n", data[c].nb_remove);
+    printf("  #contains   : %lu\n", data[c].nb_contains);
+    printf("  #found      : %lu\n", data[c].nb_found);
+    if (data[c].nb_scan > 0) {
+      printf("  #scan       : %lu\n", data[c].nb_scan);
+      printf("  #scanned    : %lu\n", data[c].nb_scanned);
+    }
+    if (set_ops->transactional) {
+      printf("  #commit     : %lu\n", data[c].tm.commits);
+      printf("  #abort      : %lu\n", data[c].tm.aborts);
+    }
+    ops += data[c].nb_add + data[c].nb_remove + data[c].nb_contains + data[c].nb_scan;
+    bad += data[c].nb_bad;
+    size += data[c].diff;
+  }
+  if (parse_only)
+    ops = trace_in_count(&in);
+  if (bad > 0)
+    printf("WARNING: %lu records with unknown op codes or unsupported scans\n", bad);
+  ret = (set_size(set) != size);
+  printf("Set size      : %d (expected: %ld)\n", set_size(set), size);
+  printf("Duration      : %.3f (ms)\n", elapsed);
+  printf("%s: %lu (%f / s)\n", parse_only ? "#records      " : "#txs          ",
+         ops, ops * 1000.0 / elapsed);
+
+  set_delete(set);
+  alloc_fini();
+  trace_in_close(&in);
+  free(threads);
+  free(data);
+
+  return ret;
+}
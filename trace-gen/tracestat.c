@@ -0,0 +1,513 @@
+/*
+ * File:
+ *   tracestat.c
+ * Description:
+ *   Op mix, key popularity, reuse distances and working set of a trace,
+ *   in one pass.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <assert.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tracein.h"
+
+#define DEFAULT_TOP                     10
+#define DEFAULT_WINDOW                  0
+
+/* Log2 buckets: [0], [1], [2, 3], [4, 7], ... */
+#define NB_BUCKETS                      64
+/* Initial sizes of the key table and of the access time range */
+#define KEYS_INIT                       (1 << 16)
+#define TIMES_INIT                      (1 << 20)
+
+#define XSTR(s)                         STR(s)
+#define STR(s)                          #s
+
+/* ################################################################### *
+ * KEY TABLE
+ * ################################################################### */
+
+typedef struct key {
+  int64_t val;
+  uint64_t count;                       /* Accesses; 0 for a free slot */
+  uint64_t last;                        /* Time of the last access */
+  uint64_t window;                      /* Last window it was seen in, + 1 */
+} key_stat_t;
+
+/* Open addressing, linear probing, at most half full */
+typedef struct keys {
+  key_stat_t *slots;
+  uint64_t mask;
+  uint64_t nb;
+} key_table_t;
+
+static inline uint64_t key_hash(int64_t val)
+{
+  /* Fibonacci hashing: accesses mostly follow nearby keys */
+  return (uint64_t)val * 0x9e3779b97f4a7c15ULL;
+}
+
+static key_stat_t *keys_alloc(uint64_t n)
+{
+  key_stat_t *slots;
+
+  if ((slots = (key_stat_t *)calloc(n, sizeof(key_stat_t))) == NULL) {
+    perror("calloc");
+    exit(1);
+  }
+  return slots;
+}
+
+static void keys_init(key_table_t *k)
+{
+  k->slots = keys_alloc(KEYS_INIT);
+  k->mask = KEYS_INIT - 1;
+  k->nb = 0;
+}
+
+static void keys_grow(key_table_t *k)
+{
+  key_stat_t *old = k->slots;
+  uint64_t i, j, n = k->mask + 1;
+
+  k->slots = keys_alloc(2 * n);
+  k->mask = 2 * n - 1;
+  for (i = 0; i < n; i++) {
+    if (old[i].count == 0)
+      continue;
+    for (j = key_hash(old[i].val) & k->mask; k->slots[j].count != 0; j = (j + 1) & k->mask)
+      ;
+    k->slots[j] = old[i];
+  }
+  free(old);
+}
+
+/* The key's slot; a new key is returned with a zero count (see keys_reserve) */
+static inline key_stat_t *keys_get(key_table_t *k, int64_t val)
+{
+  uint64_t i;
+
+  for (i = key_hash(val) & k->mask; k->slots[i].count != 0; i = (i + 1) & k->mask) {
+    if (k->slots[i].val == val)
+      return &k->slots[i];
+  }
+  k->slots[i].val = val;
+
+  return &k->slots[i];
+}
+
+/* Room for one more key: slots move, so before keys_get() */
+static inline void keys_reserve(key_table_t *k)
+{
+  if (2 * (k->nb + 1) > k->mask + 1)
+    keys_grow(k);
+}
+
+/* ################################################################### *
+ * REUSE DISTANCE
+ * ################################################################### */
+
+/*
+ * Bennett-Kruskal: a Fenwick tree over access times holds a 1 at the
+ * last access of every key, so the distinct keys between two accesses
+ * of a key are a range sum.  Times are renumbered (compacted) when they
+ * run out, which keeps the tree at most twice the number of keys.
+ */
+typedef struct reuse {
+  uint32_t *tree;                       /* 1-based */
+  int64_t *at;                          /* Key last accessed at each time */
+  uint8_t *live;                        /* That access is still its last */
+  uint64_t size;
+  uint64_t now;                         /* Last time given out */
+  uint64_t nb_live;                     /* Keys seen: the sum of the whole tree */
+  uint64_t compactions;
+} reuse_t;
+
+static void reuse_alloc(reuse_t *r, uint64_t size)
+{
+  free(r->tree);
+  free(r->at);
+  free(r->live);
+  r->size = size;
+  if ((r->tree = (uint32_t *)calloc(size + 1, sizeof(uint32_t))) == NULL ||
+      (r->at = (int64_t *)malloc((size + 1) * sizeof(int64_t))) == NULL ||
+      (r->live = (uint8_t *)calloc(size + 1, 1)) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+}
+
+static inline void reuse_add(reuse_t *r, uint64_t t, int d)
+{
+  for (; t <= r->size; t += t & -t)
+    r->tree[t] += d;
+}
+
+/* Live accesses at times <= t */
+static inline uint64_t reuse_sum(const reuse_t *r, uint64_t t)
+{
+  uint64_t s = 0;
+
+  for (; t > 0; t -= t & -t)
+    s += r->tree[t];
+  return s;
+}
+
+/* Last accesses renumbered 1..n in order, in a tree twice that size or more */
+static void reuse_compact(reuse_t *r, key_table_t *k)
+{
+  int64_t *at;
+  uint64_t t, n = 0, size = r->size;
+  key_stat_t *key;
+
+  if ((at = (int64_t *)malloc((k->nb + 1) * sizeof(int64_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  for (t = 1; t <= r->now; t++) {
+    if (r->live[t])
+      at[++n] = r->at[t];
+  }
+  if (2 * n > size)
+    size *= 2;
+  reuse_alloc(r, size);
+  /* Linear-time build: every node passes its sum on to its parent */
+  for (t = 1; t <= n; t++) {
+    r->at[t] = at[t];
+    r->live[t] = 1;
+    r->tree[t] += 1;
+    if (t + (t & -t) <= r->size)
+      r->tree[t + (t & -t)] += r->tree[t];
+    key = keys_get(k, at[t]);
+    key->last = t;
+  }
+  for (; t <= r->size; t++) {
+    if (t + (t & -t) <= r->size)
+      r->tree[t + (t & -t)] += r->tree[t];
+  }
+  r->now = n;
+  r->compactions++;
+  free(at);
+}
+
+/* Distinct other keys since the key's last access, or -1 on the first */
+static inline int64_t reuse_access(reuse_t *r, key_table_t *k, key_stat_t *key)
+{
+  int64_t d = -1;
+
+  /* Renumbering leaves the key table as it is */
+  if (r->now == r->size)
+    reuse_compact(r, k);
+  if (key->count > 1) {
+    d = (int64_t)(r->nb_live - reuse_sum(r, key->last));
+    reuse_add(r, key->last, -1);
+    r->live[key->last] = 0;
+  } else {
+    r->nb_live++;
+  }
+  key->last = ++r->now;
+  r->at[r->now] = key->val;
+  r->live[r->now] = 1;
+  reuse_add(r, r->now, 1);
+
+  return d;
+}
+
+/* ################################################################### *
+ * REPORTING
+ * ################################################################### */
+
+static inline int bucket(uint64_t v)
+{
+  return v == 0 ? 0 : 64 - __builtin_clzll(v);
+}
+
+static void print_bucket(int b, const char *indent)
+{
+  char buf[48];
+
+  if (b <= 1)
+    snprintf(buf, sizeof(buf), "%d", b);
+  else
+    snprintf(buf, sizeof(buf), "%llu-%llu", 1ULL << (b - 1), (1ULL << b) - 1);
+  printf("%s%-11s:", indent, buf);
+}
+
+static double pct(uint64_t n, uint64_t total)
+{
+  return total > 0 ? 100.0 * n / total : 0.0;
+}
+
+int main(int argc, char **argv)
+{
+  struct option long_options[] = {
+    // These options don't set a flag
+    {"help",                      no_argument,       NULL, 'h'},
+    {"top",                       required_argument, NULL, 'k'},
+    {"window",                    required_argument, NULL, 'w'},
+    {"no-reuse",                  no_argument,       NULL, 'x'},
+    {NULL, 0, NULL, 0}
+  };
+
+  trace_in_t in;
+  trace_cursor_t cur;
+  trace_rec_t rec;
+  key_table_t keys;
+  reuse_t reuse;
+  key_stat_t *key, **top;
+  struct timespec start, end;
+  double elapsed;
+  int nb_top = DEFAULT_TOP, no_reuse = 0;
+  uint64_t window = DEFAULT_WINDOW;
+  uint64_t ops[TRACE_OP_PHASE + 1], nb_ops, nb_bad, scanned, accesses, records;
+  uint64_t reuse_hist[NB_BUCKETS], cold, reuse_total;
+  uint64_t freq_keys[NB_BUCKETS], freq_acc[NB_BUCKETS];
+  uint64_t *ws = NULL, nb_ws = 0, max_ws = 0, cur_ws = 0;
+  uint64_t i, cum;
+  uint32_t op, max_tid = 0;
+  int64_t d;
+  int c, r, j, n;
+
+  while(1) {
+    c = getopt_long(argc, argv, "hk:w:x", long_options, NULL);
+
+    if(c == -1)
+      break;
+
+    switch(c) {
+     case 'h':
+       printf("tracestat "
+              "\n"
+              "Usage:\n"
+              "  tracestat [options...] <trace>\n"
+              "\n"
+              "Reads a text or binary trace once and reports its op mix, the key\n"
+              "access frequencies, the reuse distances of the keys and the working\n"
+              "set over time.\n"
+              "\n"
+              "Options:\n"
+              "  -h, --help\n"
+              "        Print this message\n"
+              "  -k, --top <int>\n"
+              "        Hottest keys listed (default=" XSTR(DEFAULT_TOP) ")\n"
+              "  -w, --window <int>\n"
+              "        Distinct keys in every window of <int> key accesses\n"
+              "        (0=none, default=" XSTR(DEFAULT_WINDOW) ")\n"
+              "  -x, --no-reuse\n"
+              "        Skip the reuse distances (the costliest part)\n"
+         );
+       exit(0);
+     case 'k':
+       nb_top = atoi(optarg);
+       break;
+     case 'w':
+       window = strtoull(optarg, NULL, 10);
+       break;
+     case 'x':
+       no_reuse = 1;
+       break;
+     case '?':
+       printf("Use -h or --help for help\n");
+       exit(0);
+     default:
+       exit(1);
+    }
+  }
+
+  if (optind != argc - 1) {
+    printf("Use -h or --help for help\n");
+    exit(1);
+  }
+  assert(nb_top >= 0);
+
+  if (trace_in_open(&in, argv[optind]) != 0)
+    exit(1);
+  printf("Trace        : %s (%s", argv[optind],
+         in.format == TRACE_BINARY ? "binary" : "text");
+  if (in.codec != CODEC_NONE)
+    printf(", %s, %lu bytes", codec_name(in.codec), (unsigned long)in.size);
+  printf(")\n");
+  printf("Initial size : %lu\n", (unsigned long)in.nb_initial);
+
+  keys_init(&keys);
+  memset(&reuse, 0, sizeof(reuse));
+  if (!no_reuse)
+    reuse_alloc(&reuse, TIMES_INIT);
+  memset(ops, 0, sizeof(ops));
+  memset(reuse_hist, 0, sizeof(reuse_hist));
+  nb_bad = scanned = accesses = records = cold = reuse_total = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  trace_in_split(&in, 0, 1, &cur);
+  while ((r = trace_cursor_next(&cur, &rec)) != 0) {
+    if (r < 0) {
+      fprintf(stderr, "Malformed trace record\n");
+      exit(1);
+    }
+    records++;
+    op = TRACE_OP_CODE(rec.op);
+    if (op > TRACE_OP_PHASE || (op > TRACE_OP_SCAN && op != TRACE_OP_PHASE)) {
+      nb_bad++;
+      continue;
+    }
+    ops[op]++;
+    if (op == TRACE_OP_PHASE)
+      continue;
+    if (rec.tid > max_tid)
+      max_tid = rec.tid;
+    /* A scan counts as an access to its lower bound */
+    if (op == TRACE_OP_SCAN)
+      scanned += TRACE_OP_LEN(rec.op);
+    keys_reserve(&keys);
+    key = keys_get(&keys, rec.val);
+    if (key->count++ == 0)
+      keys.nb++;
+    accesses++;
+    if (!no_reuse) {
+      if ((d = reuse_access(&reuse, &keys, key)) < 0) {
+        cold++;
+      } else {
+        reuse_hist[bucket(d)]++;
+        reuse_total += d;
+      }
+    }
+    if (window > 0) {
+      if (key->window != nb_ws + 1) {
+        key->window = nb_ws + 1;
+        cur_ws++;
+      }
+      if (accesses % window == 0) {
+        if (nb_ws == max_ws) {
+          max_ws = (max_ws == 0) ? 1024 : 2 * max_ws;
+          if ((ws = (uint64_t *)realloc(ws, max_ws * sizeof(uint64_t))) == NULL) {
+            perror("realloc");
+            exit(1);
+          }
+        }
+        ws[nb_ws++] = cur_ws;
+        cur_ws = 0;
+      }
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  elapsed = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0;
+
+  nb_ops = ops[TRACE_OP_ADD] + ops[TRACE_OP_REMOVE] + ops[TRACE_OP_CONTAINS] + ops[TRACE_OP_SCAN];
+  printf("Records      : %lu\n", (unsigned long)records);
+  if (in.format == TRACE_BINARY && nb_ops > 0)
+    printf("Threads      : %u\n", max_tid + 1);
+  printf("Duration     : %.3f (ms, %.0f records / s)\n", elapsed,
+         elapsed > 0 ? records * 1000.0 / elapsed : 0.0);
+  if (nb_bad > 0)
+    printf("WARNING: %lu records with unknown op codes\n", (unsigned long)nb_bad);
+
+  printf("Ops\n");
+  printf("  add        : %lu (%.2f%%)\n", (unsigned long)ops[TRACE_OP_ADD],
+         pct(ops[TRACE_OP_ADD], nb_ops));
+  printf("  remove     : %lu (%.2f%%)\n", (unsigned long)ops[TRACE_OP_REMOVE],
+         pct(ops[TRACE_OP_REMOVE], nb_ops));
+  printf("  contains   : %lu (%.2f%%)\n", (unsigned long)ops[TRACE_OP_CONTAINS],
+         pct(ops[TRACE_OP_CONTAINS], nb_ops));
+  if (ops[TRACE_OP_SCAN] > 0)
+    printf("  scan       : %lu (%.2f%%, %.2f keys / scan)\n", (unsigned long)ops[TRACE_OP_SCAN],
+           pct(ops[TRACE_OP_SCAN], nb_ops), (double)scanned / ops[TRACE_OP_SCAN]);
+  if (ops[TRACE_OP_PHASE] > 0)
+    printf("  phase      : %lu markers\n", (unsigned long)ops[TRACE_OP_PHASE]);
+
+  /* Keys by number of accesses */
+  memset(freq_keys, 0, sizeof(freq_keys));
+  memset(freq_acc, 0, sizeof(freq_acc));
+  n = 0;
+  if ((top = (key_stat_t **)calloc(nb_top + 1, sizeof(key_stat_t *))) == NULL) {
+    perror("calloc");
+    exit(1);
+  }
+  for (i = 0; i <= keys.mask; i++) {
+    key = &keys.slots[i];
+    if (key->count == 0)
+      continue;
+    freq_keys[bucket(key->count)]++;
+    freq_acc[bucket(key->count)] += key->count;
+    /* Insertion into the sorted top list */
+    for (j = n; j > 0 && (top[j - 1]->count < key->count ||
+                          (top[j - 1]->count == key->count && top[j - 1]->val > key->val)); j--)
+      top[j] = top[j - 1];
+    if (j < nb_top) {
+      top[j] = key;
+      if (n < nb_top)
+        n++;
+    }
+  }
+  printf("Keys         : %lu distinct, %.2f accesses / key\n", (unsigned long)keys.nb,
+         keys.nb > 0 ? (double)accesses / keys.nb : 0.0);
+  printf("Key frequency (accesses per key: keys, share of accesses)\n");
+  for (j = 1; j < NB_BUCKETS; j++) {
+    if (freq_keys[j] == 0)
+      continue;
+    print_bucket(j, "  ");
+    printf(" %lu keys (%.2f%%), %.2f%% of accesses\n", (unsigned long)freq_keys[j],
+           pct(freq_keys[j], keys.nb), pct(freq_acc[j], accesses));
+  }
+  if (n > 0) {
+    printf("Hottest keys\n");
+    for (j = 0; j < n; j++)
+      printf("  %-11lld: %lu (%.2f%%)\n", (long long)top[j]->val,
+             (unsigned long)top[j]->count, pct(top[j]->count, accesses));
+  }
+
+  if (!no_reuse) {
+    /* An LRU cache of c keys hits the accesses at distance < c */
+    printf("Reuse distance (distinct keys in between: accesses, LRU hits up to then)\n");
+    printf("  %-11s: %lu (%.2f%%)\n", "cold", (unsigned long)cold, pct(cold, accesses));
+    cum = 0;
+    for (j = 0; j < NB_BUCKETS; j++) {
+      if (reuse_hist[j] == 0)
+        continue;
+      cum += reuse_hist[j];
+      print_bucket(j, "  ");
+      printf(" %lu (%.2f%%, %.2f%%)\n", (unsigned long)reuse_hist[j],
+             pct(reuse_hist[j], accesses), pct(cum, accesses));
+    }
+    printf("  %-11s: %.2f (%lu compactions)\n", "mean",
+           accesses > cold ? (double)reuse_total / (accesses - cold) : 0.0,
+           (unsigned long)reuse.compactions);
+  }
+
+  if (window > 0) {
+    printf("Working set (distinct keys per %lu accesses)\n", (unsigned long)window);
+    for (i = 0; i < nb_ws; i++)
+      printf("  %-11lu: %lu\n", (unsigned long)(i * window), (unsigned long)ws[i]);
+    if (accesses % window != 0)
+      printf("  %-11lu: %lu (last %lu accesses)\n", (unsigned long)(nb_ws * window),
+             (unsigned long)cur_ws, (unsigned long)(accesses % window));
+  }
+
+  free(ws);
+  free(top);
+  free(keys.slots);
+  free(reuse.tree);
+  free(reuse.at);
+  free(reuse.live);
+  trace_in_close(&in);
+
+  return 0;
+}
@@ -0,0 +1,338 @@
+/*
+ * File:
+ *   unrolled.c
+ * Description:
+ *   Unrolled linked list set: several sorted keys per cache-line node.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "crash.h"
+#include "intset.h"
+#include "memtrace.h"
+#include "pmem.h"
+
+/* Keys per node: with the next pointer, a node fills one cache line */
+#define UNODE_KEYS                      ((int)((ALLOC_LINE - sizeof(void *)) / sizeof(val_t)))
+/* Keys left in the first node when a full node is split */
+#define UNODE_SPLIT                     ((UNODE_KEYS + 1) / 2)
+/* Keys in each half of a node, the last ones sharing theirs with the pointer */
+#define UNODE_LANES                     ((int)(ALLOC_LINE / 2 / sizeof(val_t)))
+
+/* ################################################################### *
+ * UNROLLED LINKED LIST
+ * ################################################################### */
+
+typedef struct unode {
+  val_t keys[UNODE_KEYS];               /* Sorted; unused slots hold VAL_MAX */
+  struct unode *next;
+} unode_t;
+
+typedef struct unrolled {
+  intset_t base;
+  unode_t *head;                        /* Never freed, may be empty */
+} unrolled_t;
+
+/* Half a node: the first keys, or the last ones and the next pointer */
+typedef val_t vhalf_t __attribute__((vector_size(ALLOC_LINE / 2)));
+
+_Static_assert(sizeof(unode_t) == ALLOC_LINE, "unrolled nodes must fill a cache line");
+_Static_assert(sizeof(vhalf_t) * 2 == sizeof(unode_t), "two vectors must cover a node");
+
+static unode_t *new_unode(void)
+{
+  unode_t *node;
+  int i;
+
+  node = (unode_t *)node_alloc(sizeof(unode_t));
+  for (i = 0; i < UNODE_KEYS; i++)
+    MT_ST(node->keys[i], VAL_MAX);
+  MT_ST(node->next, NULL);
+
+  return node;
+}
+
+/* Number of keys below val, from two half-line compares (folded at -O2) */
+static inline int unode_rank(const unode_t *node, val_t val)
+{
+  vhalf_t lo, hi, v, keys_only, c;
+  int i, rank = 0;
+
+  for (i = 0; i < UNODE_LANES; i++) {
+    v[i] = val;
+    keys_only[i] = (UNODE_LANES + i < UNODE_KEYS) ? -1 : 0;
+  }
+  for (i = 0; i < UNODE_KEYS; i++)
+    memtrace_load(&node->keys[i], sizeof(val_t));
+  memcpy(&lo, node, sizeof(lo));
+  memcpy(&hi, (const char *)node + sizeof(lo), sizeof(hi));
+  c = (lo < v) + ((hi < v) & keys_only);
+  for (i = 0; i < UNODE_LANES; i++)
+    rank -= (int)c[i];
+
+  return rank;
+}
+
+static intset_t *unrolled_new()
+{
+  unrolled_t *set;
+
+  if ((set = (unrolled_t *)malloc(sizeof(unrolled_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  set->head = new_unode();
+  pmem_persist(set->head, sizeof(unode_t));
+  pmem_set_root(set->head);
+
+  return &set->base;
+}
+
+static void unrolled_delete(intset_t *s)
+{
+  unrolled_t *set = (unrolled_t *)s;
+  unode_t *node, *next;
+
+  for (node = set->head; node != NULL; node = next) {
+    next = node->next;
+    node_free(node, sizeof(unode_t));
+  }
+  free(set);
+}
+
+static int unrolled_size(intset_t *s)
+{
+  unrolled_t *set = (unrolled_t *)s;
+  unode_t *node;
+  int i, size = 0;
+
+  for (node = set->head; node != NULL; node = node->next) {
+    for (i = 0; i < UNODE_KEYS && node->keys[i] != VAL_MAX; i++)
+      size++;
+  }
+
+  return size;
+}
+
+static int unrolled_snapshot(intset_t *s, val_t *vals, int max)
+{
+  unrolled_t *set = (unrolled_t *)s;
+  unode_t *node;
+  int i, n = 0;
+
+  for (node = set->head; node != NULL; node = node->next) {
+    for (i = 0; i < UNODE_KEYS && node->keys[i] != VAL_MAX && n < max; i++)
+      vals[n++] = node->keys[i];
+  }
+
+  return n;
+}
+
+/* Last node whose first key is <= val (or the head), and its predecessor */
+static unode_t *unrolled_walk(unrolled_t *set, val_t val, unode_t **prev)
+{
+  unode_t *p = NULL, *n, *next;
+
+  n = set->head;
+  while ((next = MT_LD(n->next)) != NULL && MT_LD(next->keys[0]) <= val) {
+    p = n;
+    n = next;
+  }
+  *prev = p;
+
+  return n;
+}
+
+static int unrolled_contains(intset_t *s, val_t val)
+{
+  unode_t *prev, *node;
+  int r;
+
+  node = unrolled_walk((unrolled_t *)s, val, &prev);
+  r = unode_rank(node, val);
+
+  return r < UNODE_KEYS && node->keys[r] == val;
+}
+
+static int unrolled_add(intset_t *s, val_t val)
+{
+  unode_t *prev, *node, *split;
+  int i, r;
+
+  node = unrolled_walk((unrolled_t *)s, val, &prev);
+  r = unode_rank(node, val);
+  if (r < UNODE_KEYS && node->keys[r] == val)
+    return 0;
+  if (node->keys[UNODE_KEYS - 1] != VAL_MAX) {
+    /* Full: move the upper keys to a new node, durable before it is linked */
+    split = new_unode();
+    for (i = UNODE_SPLIT; i < UNODE_KEYS; i++)
+      MT_ST(split->keys[i - UNODE_SPLIT], MT_LD(node->keys[i]));
+    MT_ST(split->next, MT_LD(node->next));
+    pmem_persist(split, sizeof(*split));
+    MT_ST(node->next, split);
+    for (i = UNODE_SPLIT; i < UNODE_KEYS; i++)
+      MT_ST(node->keys[i], VAL_MAX);
+    if (r > UNODE_SPLIT) {
+      pmem_flush(node, sizeof(*node));
+      node = split;
+      r -= UNODE_SPLIT;
+    }
+  }
+  for (i = UNODE_KEYS - 1; i > r; i--)
+    MT_ST(node->keys[i], MT_LD(node->keys[i - 1]));
+  MT_ST(node->keys[r], val);
+  pmem_persist(node, sizeof(*node));
+
+  return 1;
+}
+
+static int unrolled_remove(intset_t *s, val_t val)
+{
+  unode_t *prev, *node;
+  int i, r;
+
+  node = unrolled_walk((unrolled_t *)s, val, &prev);
+  r = unode_rank(node, val);
+  if (r == UNODE_KEYS || node->keys[r] != val)
+    return 0;
+  for (i = r; i < UNODE_KEYS - 1; i++)
+    MT_ST(node->keys[i], MT_LD(node->keys[i + 1]));
+  MT_ST(node->keys[UNODE_KEYS - 1], VAL_MAX);
+  if (node->keys[0] == VAL_MAX && prev != NULL) {
+    /* Only the head may be empty */
+    MT_ST(prev->next, MT_LD(node->next));
+    pmem_persist(&prev->next, sizeof(prev->next));
+    node_free(node, sizeof(unode_t));
+  } else {
+    pmem_persist(node, sizeof(*node));
+  }
+
+  return 1;
+}
+
+/*
+ * Fills each node completely, in key order.  The new nodes are chained
+ * and made durable first, then published by persisting the last node
+ * of the set, which is one cache line.
+ */
+static void unrolled_load(intset_t *s, const val_t *vals, int n)
+{
+  unrolled_t *set = (unrolled_t *)s;
+  unode_t *node, *last, *first = NULL, *tail = NULL;
+  int i = 0, j;
+
+  last = set->head;
+  while (last->next != NULL)
+    last = last->next;
+  /* An empty head takes the first keys in place */
+  if (last->keys[0] == VAL_MAX) {
+    for (; i < UNODE_KEYS && i < n; i++)
+      MT_ST(last->keys[i], vals[i]);
+  }
+  for (; i < n; i += UNODE_KEYS) {
+    node = new_unode();
+    for (j = 0; j < UNODE_KEYS && i + j < n; j++)
+      MT_ST(node->keys[j], vals[i + j]);
+    if (tail == NULL) {
+      first = node;
+    } else {
+      MT_ST(tail->next, node);
+      pmem_flush(tail, sizeof(*tail));
+    }
+    tail = node;
+  }
+  if (tail != NULL) {
+    pmem_persist(tail, sizeof(*tail));
+    MT_ST(last->next, first);
+  }
+  pmem_persist(last, sizeof(*last));
+}
+
+/*
+ * Keys are counted a node at a time, and the next node is prefetched
+ * before the keys of the current one are ranked.
+ */
+static int unrolled_scan(intset_t *s, val_t lo, int len)
+{
+  unode_t *prev, *node, *next;
+  int n = 0, r, k;
+
+  node = unrolled_walk((unrolled_t *)s, lo, &prev);
+  r = unode_rank(node, lo);
+  while (node != NULL && n < len) {
+    if ((next = MT_LD(node->next)) != NULL)
+      __builtin_prefetch(next);
+    /* Unused slots hold VAL_MAX: this counts the keys >= lo */
+    k = unode_rank(node, VAL_MAX) - r;
+    n += (k < len - n) ? k : len - n;
+    r = 0;
+    node = next;
+  }
+
+  return n;
+}
+
+/* Keys increase within and across nodes, unused slots end each node */
+static int unrolled_recover(const pmem_image_t *img, const char **why)
+{
+  const unode_t *node;
+  uintptr_t p = pmem_image_root(img);
+  size_t nodes = 0;
+  val_t last = VAL_MIN;
+  int i, keys = 0;
+
+  for (; p != 0; p = (uintptr_t)node->next) {
+    if (p % sizeof(uintptr_t) != 0 || (node = pmem_image_at(img, p, sizeof(unode_t))) == NULL) {
+      *why = "link out of the pool";
+      return -1;
+    }
+    /* Empty nodes do not order anything: bound the walk instead */
+    if (++nodes > img->size / sizeof(unode_t)) {
+      *why = "cycle";
+      return -1;
+    }
+    for (i = 0; i < UNODE_KEYS && node->keys[i] != VAL_MAX; i++) {
+      if (node->keys[i] <= last) {
+        *why = "keys out of order";
+        return -1;
+      }
+      last = node->keys[i];
+      keys++;
+    }
+    for (; i < UNODE_KEYS; i++) {
+      if (node->keys[i] != VAL_MAX) {
+        *why = "key after an unused slot";
+        return -1;
+      }
+    }
+  }
+
+  return keys;
+}
+
+const set_ops_t set_unrolled_ops = {
+  "unrolled", "Unrolled linked list, a cache line of keys per node (single thread only)", 0,
+  unrolled_new, unrolled_delete, unrolled_size,
+  unrolled_contains, unrolled_add, unrolled_remove, 1,
+  0, NULL, NULL, NULL, unrolled_load, unrolled_scan, 0, NULL, unrolled_recover,
+  unrolled_snapshot
+};